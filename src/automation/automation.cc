@@ -1,9 +1,16 @@
 #include "automation/automation.h"
 
+#include <GLFW/glfw3.h>
+
 #include <algorithm>
 
 #include "system.h"
+#include "automation/input_injector.h"
+#include "automation/key_map.h"
+#include "automation/lua_memory_view.h"
 #include "automation/lua_repl_context.h"
+#include "bus/c256_system_bus.h"
+#include "bus/vicky.h"
 
 namespace {
 
@@ -19,6 +26,57 @@ Automation* GetAutomation(lua_State* L) {
 
 System *GetSystem(lua_State *L) { return GetAutomation(L)->system(); }
 
+// Set on the CPU thread while a debug hook callback is running.
+thread_local bool in_pc_hook = false;
+
+// Accepts either a numeric address or a symbol name at stack index 'idx'.
+bool ToAddress(lua_State* L, int idx, cpuaddr_t* address) {
+  if (lua_isinteger(L, idx)) {
+    *address = lua_tointeger(L, idx);
+    return true;
+  }
+  if (lua_type(L, idx) != LUA_TSTRING)
+    return false;
+  auto found = GetSystem(L)->symbols()->Lookup(lua_tostring(L, idx));
+  if (!found)
+    return false;
+  *address = *found;
+  return true;
+}
+
+cpuaddr_t CheckAddress(lua_State* L, int idx) {
+  cpuaddr_t address = 0;
+  if (!ToAddress(L, idx, &address))
+    luaL_error(L, "c256emu: unknown address or symbol: %s",
+               luaL_tolstring(L, idx, nullptr));
+  return address;
+}
+
+// Takes [offset, offset + length) within 'size' bytes from the optional
+// arguments at 1 and 2. Raises a Lua error if it's out of range.
+void CheckRange(lua_State* L, size_t size, size_t* offset, size_t* length) {
+  lua_Integer o = luaL_optinteger(L, 1, 0);
+  if (o < 0 || static_cast<size_t>(o) > size)
+    luaL_argerror(L, 1, "offset out of range");
+  lua_Integer l = luaL_optinteger(L, 2, size - o);
+  if (l < 0 || static_cast<size_t>(o + l) > size)
+    luaL_argerror(L, 2, "length out of range");
+  *offset = o;
+  *length = l;
+}
+
+// Pushes a view of [offset, offset + length) of 'data', with the range taken
+// from the optional arguments at 1 and 2.
+int PushView(lua_State* L, uint8_t* data, size_t size, cpuaddr_t address,
+             bool writable) {
+  size_t offset, length;
+  CheckRange(L, size, &offset, &length);
+  LuaMemoryView::Push(L, {data + offset, length,
+                          static_cast<cpuaddr_t>(address + offset),
+                          writable});
+  return 1;
+}
+
 void PushTable(lua_State* L, const std::string& label, bool val) {
   lua_pushstring(L, label.c_str());
   lua_pushboolean(L, val);
@@ -35,17 +93,40 @@ const ::luaL_Reg Automation::c256emu_methods[] = {
     {"add_breakpoint", Automation::LuaAddBreakpoint},
     {"clear_breakpoint", Automation::LuaClearBreakpoint},
     {"breakpoints", Automation::LuaGetBreakpoints},
+    {"add_watchpoint", Automation::LuaAddWatchpoint},
+    {"clear_watchpoint", Automation::LuaClearWatchpoint},
+    {"watchpoints", Automation::LuaGetWatchpoints},
     {"cpu_state", Automation::LuaGetCpuState},
     {"peek", Automation::LuaPeek},
     {"poke", Automation::LuaPoke},
     {"peek16", Automation::LuaPeek16},
     {"poke16", Automation::LuaPoke16},
     {"peekbuf", Automation::LuaPeekBuf},
+    {"ram", Automation::LuaRamView},
+    {"vram", Automation::LuaVramView},
+    {"framebuffer", Automation::LuaFrameBufferView},
+    {"scaled_framebuffer", Automation::LuaScaledFrameBuffer},
+    {"set_scale", Automation::LuaSetScale},
     {"load_hex", Automation::LuaLoadHex},
     {"load_bin", Automation::LuaLoadBin},
     {"load_o65", Automation::LuaLoadO65},
     {"disassemble", Automation::LuaDisasm},
     {"sys", Automation::LuaSys},
+    {"spawn", Automation::LuaSpawn},
+    {"wait_frames", Automation::LuaWaitFrames},
+    {"wait_pc", Automation::LuaWaitPc},
+    {"wait_until", Automation::LuaWaitUntil},
+    {"type_text", Automation::LuaTypeText},
+    {"inject", Automation::LuaInject},
+    {"load_input", Automation::LuaLoadInput},
+    {"record_video", Automation::LuaRecordVideo},
+    {"stop_video", Automation::LuaStopVideo},
+    {"pass", Automation::LuaPass},
+    {"fail", Automation::LuaFail},
+    {"frame", Automation::LuaFrame},
+    {"load_symbols", Automation::LuaLoadSymbols},
+    {"symbol", Automation::LuaSymbol},
+    {"address", Automation::LuaAddress},
     {0, 0}};
 
 Automation::Automation(WDC65C816* cpu,
@@ -61,11 +142,16 @@ Automation::Automation(WDC65C816* cpu,
 
   luaL_newlib(lua_state_, c256emu_methods);
   lua_setglobal(lua_state_, "c256emu");
+  LuaMemoryView::Register(lua_state_);
 
   repl_context_ = std::make_unique<LuaReplContext>(lua_state_);
+
+  system_->system_bus()->set_watchpoint_handler(
+      [this](const C256SystemBus::WatchpointHit& hit) { OnWatchpoint(hit); });
 }
 
 Automation::~Automation() {
+  system_->system_bus()->set_watchpoint_handler(nullptr);
   lua_close(lua_state_);
 }
 
@@ -91,72 +177,713 @@ std::string Automation::Eval(const std::string& expression) {
   return repl_context_->Eval(expression);
 }
 
-void Automation::AddBreakpoint(cpuaddr_t address,
-                               const std::string& function_name) {
-  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+bool Automation::AddBreakpoint(cpuaddr_t address,
+                               const std::string& function_name,
+                               const std::string& condition,
+                               uint64_t ignore_count) {
+  return AddBreakpoint({address, function_name, condition, ignore_count, 0},
+                       LUA_NOREF);
+}
+
+bool Automation::AddBreakpoint(const Breakpoint& info, int lua_function_ref) {
+  auto breakpoint = std::make_shared<ActiveBreakpoint>();
+  breakpoint->info = info;
+  breakpoint->lua_function_ref = lua_function_ref;
+  breakpoint->pause_only =
+      lua_function_ref == LUA_NOREF && info.lua_function_name.empty();
+  if (!info.condition.empty()) {
+    std::string error;
+    breakpoint->condition =
+        BreakpointCondition::Compile(info.condition, system_->symbols(), &error);
+    if (!breakpoint->condition) {
+      LOG(ERROR) << "Bad breakpoint condition '" << info.condition
+                 << "': " << error;
+      ReleaseBreakpoint(breakpoint.get());
+      return false;
+    }
+  }
+
+  std::shared_ptr<ActiveBreakpoint> replaced;
+  {
+    std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+    auto& slot = breakpoints_[info.address];
+    replaced = std::move(slot);
+    slot = breakpoint;
+  }
+  if (replaced)
+    ReleaseBreakpoint(replaced.get());
 
-  auto bp = std::find_if(
-      breakpoints_.begin(), breakpoints_.end(),
-      [address](const Breakpoint &b) { return b.address == address; });
-  if (bp != breakpoints_.end()) {
+  UpdatePcHook(info.address);
+  return true;
+}
+
+void Automation::UpdatePcHook(cpuaddr_t address) {
+  std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+  if (in_pc_hook) {
+    // Replacing the hook that is running would destroy it mid-call; redo it
+    // once the current instruction is done.
+    if (stale_pc_hooks_.empty()) {
+      system_->ScheduleEvent(0, [this]() {
+        std::vector<cpuaddr_t> stale;
+        {
+          std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+          stale.swap(stale_pc_hooks_);
+        }
+        for (cpuaddr_t address : stale)
+          UpdatePcHook(address);
+      });
+    }
+    stale_pc_hooks_.push_back(address);
     return;
   }
 
-  breakpoints_.push_back({address, function_name});
-  debug_interface_->SetBreakpoint(address, [this, address](EmulatedCpu*) {
-    std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
-    for (auto& bp : breakpoints_) {
-      if (bp.address == address) {
-        lua_getglobal(lua_state_, bp.lua_function_name.c_str());
-        lua_pcall(lua_state_, 0, 0, 0);
-        break;
-      }
+  std::shared_ptr<ActiveBreakpoint> breakpoint;
+  auto found = breakpoints_.find(address);
+  if (found != breakpoints_.end())
+    breakpoint = found->second;
+  bool waited = pc_waits_.count(address) != 0;
+  if (!breakpoint && !waited) {
+    debug_interface_->ClearBreakpoint(address);
+    return;
+  }
+  // The callback owns its breakpoint, so a hit never needs to search for it.
+  debug_interface_->SetBreakpoint(
+      address, [this, breakpoint, address, waited](EmulatedCpu*) {
+        in_pc_hook = true;
+        if (breakpoint)
+          OnBreakpoint(breakpoint.get());
+        if (waited)
+          OnPcReached(address);
+        in_pc_hook = false;
+      });
+}
+
+BreakpointContext Automation::CurrentContext(uint64_t hits) {
+  const auto& regs = cpu_->cpu_state.regs;
+  return {cpu_->a(),
+          cpu_->x(),
+          cpu_->y(),
+          cpu_->program_address(),
+          regs.sp.u16,
+          regs.d.u16,
+          cpu_->cpu_state.cycle,
+          hits,
+          system_->system_bus()};
+}
+
+void Automation::OnBreakpoint(ActiveBreakpoint* breakpoint) {
+  if (breakpoint->condition &&
+      !breakpoint->condition->Evaluate(CurrentContext(
+          breakpoint->hits.load(std::memory_order_relaxed)))) {
+    return;
+  }
+  uint64_t hits = breakpoint->hits.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (hits <= breakpoint->info.ignore_count)
+    return;
+
+  if (breakpoint->pause_only) {
+    debug_interface_->Pause();
+    return;
+  }
+
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  if (breakpoint->released)
+    return;
+  const std::string& function_name = breakpoint->info.lua_function_name;
+  if (breakpoint->lua_function_ref == LUA_NOREF) {
+    // Named functions are resolved on first use, so that a script can set
+    // breakpoints before defining their handlers.
+    lua_getglobal(lua_state_, function_name.c_str());
+    if (!lua_isfunction(lua_state_, -1)) {
+      lua_pop(lua_state_, 1);
+      LOG(ERROR) << "Breakpoint function is not defined: " << function_name;
+      return;
     }
-  });
+    breakpoint->lua_function_ref = luaL_ref(lua_state_, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(lua_state_, LUA_REGISTRYINDEX, breakpoint->lua_function_ref);
+  if (lua_pcall(lua_state_, 0, 0, 0) != 0) {
+    LOG(ERROR) << "Breakpoint function failed: "
+               << lua_tostring(lua_state_, -1);
+    lua_pop(lua_state_, 1);
+  }
+}
+
+void Automation::ReleaseBreakpoint(ActiveBreakpoint* breakpoint) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  if (breakpoint->lua_function_ref != LUA_NOREF) {
+    luaL_unref(lua_state_, LUA_REGISTRYINDEX, breakpoint->lua_function_ref);
+    breakpoint->lua_function_ref = LUA_NOREF;
+  }
+  // A cleared breakpoint whose callback is still running must not resolve
+  // its function again.
+  breakpoint->released = true;
 }
 
 void Automation::ClearBreakpoint(cpuaddr_t address) {
-  auto bp = std::find_if(
-      breakpoints_.begin(), breakpoints_.end(),
-      [address](const Breakpoint& b) { return b.address == address; });
-  if (bp != breakpoints_.end()) {
-    breakpoints_.erase(bp);
-    debug_interface_->ClearBreakpoint(address);
+  std::shared_ptr<ActiveBreakpoint> breakpoint;
+  {
+    std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+    auto found = breakpoints_.find(address);
+    if (found == breakpoints_.end())
+      return;
+    breakpoint = std::move(found->second);
+    breakpoints_.erase(found);
   }
+  UpdatePcHook(address);
+  ReleaseBreakpoint(breakpoint.get());
 }
 
 std::vector<Automation::Breakpoint> Automation::GetBreakpoints() const {
-  return breakpoints_;
+  std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+  std::vector<Breakpoint> breakpoints;
+  breakpoints.reserve(breakpoints_.size());
+  for (const auto& entry : breakpoints_) {
+    Breakpoint info = entry.second->info;
+    info.hit_count = entry.second->hits.load(std::memory_order_relaxed);
+    breakpoints.push_back(info);
+  }
+  std::sort(breakpoints.begin(), breakpoints.end(),
+            [](const Breakpoint& a, const Breakpoint& b) {
+              return a.address < b.address;
+            });
+  return breakpoints;
 }
 
 bool Automation::HasBreakpoint(cpuaddr_t addr) const {
-  return std::find_if(breakpoints_.begin(), breakpoints_.end(),
-                      [addr](const Breakpoint &b) {
-                        return b.address == addr;
-                      }) != breakpoints_.end();
+  std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+  return breakpoints_.count(addr) != 0;
+}
+
+int Automation::AddWatchpoint(cpuaddr_t start, uint32_t size, uint8_t kinds,
+                              const std::string& function_name) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  int function_ref = LUA_NOREF;
+  if (!function_name.empty()) {
+    lua_getglobal(lua_state_, function_name.c_str());
+    if (lua_isfunction(lua_state_, -1))
+      function_ref = luaL_ref(lua_state_, LUA_REGISTRYINDEX);
+    else
+      lua_pop(lua_state_, 1);
+  }
+  return AddWatchpoint(start, size, kinds, function_ref);
+}
+
+int Automation::AddWatchpoint(cpuaddr_t start, uint32_t size, uint8_t kinds,
+                              int lua_function_ref) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  int id = system_->system_bus()->AddWatchpoint(start, size, kinds);
+  if (lua_function_ref != LUA_NOREF)
+    watchpoint_functions_[id] = lua_function_ref;
+  return id;
+}
+
+void Automation::ClearWatchpoint(int id) {
+  system_->system_bus()->RemoveWatchpoint(id);
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  auto found = watchpoint_functions_.find(id);
+  if (found != watchpoint_functions_.end()) {
+    luaL_unref(lua_state_, LUA_REGISTRYINDEX, found->second);
+    watchpoint_functions_.erase(found);
+  }
+}
+
+void Automation::OnWatchpoint(const C256SystemBus::WatchpointHit& hit) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  auto found = watchpoint_functions_.find(hit.id);
+  if (found == watchpoint_functions_.end()) {
+    LOG(INFO) << "Watchpoint " << hit.id << " hit at " << std::hex
+              << hit.addr << ": " << (int)hit.old_value << " -> "
+              << (int)hit.new_value;
+    debug_interface_->Pause();
+    return;
+  }
+  const char* kind = hit.kind == C256SystemBus::kWatchRead    ? "read"
+                     : hit.kind == C256SystemBus::kWatchWrite ? "write"
+                                                              : "change";
+  lua_rawgeti(lua_state_, LUA_REGISTRYINDEX, found->second);
+  lua_pushinteger(lua_state_, hit.addr);
+  lua_pushstring(lua_state_, kind);
+  lua_pushinteger(lua_state_, hit.old_value);
+  lua_pushinteger(lua_state_, hit.new_value);
+  if (lua_pcall(lua_state_, 4, 0, 0) != 0) {
+    LOG(ERROR) << "Watchpoint function failed: "
+               << lua_tostring(lua_state_, -1);
+    lua_pop(lua_state_, 1);
+  }
+}
+
+bool Automation::RunTest(const std::string& path) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  if (luaL_loadfile(lua_state_, path.c_str()) != 0) {
+    LOG(ERROR) << "RunTest load failure: " << lua_tostring(lua_state_, -1);
+    lua_pop(lua_state_, 1);
+    return false;
+  }
+  LOG(INFO) << "Running test: " << path;
+  StartTask(lua_state_, 0, true);
+  return true;
+}
+
+Automation::Task* Automation::StartTask(lua_State* L, int nargs,
+                                        bool is_test) {
+  auto task = std::make_unique<Task>();
+  task->thread = lua_newthread(L);
+  task->thread_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  task->is_test = is_test;
+  // Move the function and its arguments over to the new thread.
+  lua_xmove(L, task->thread, nargs + 1);
+  Task* started = task.get();
+  tasks_.push_back(std::move(task));
+  ResumeTask(started, nargs);
+  return started;
+}
+
+void Automation::ResumeTask(Task* task, int nargs) {
+  Task* resumer = current_task_;
+  current_task_ = task;
+  task->wait = Task::Wait::kReady;
+#if LUA_VERSION_NUM >= 504
+  int nresults;
+  int status = lua_resume(task->thread, nullptr, nargs, &nresults);
+#else
+  int status = lua_resume(task->thread, nullptr, nargs);
+#endif
+  current_task_ = resumer;
+
+  if (status == LUA_YIELD) {
+    lua_settop(task->thread, 0);
+    if (task->wait == Task::Wait::kStopped) {
+      FinishTask(task);
+    } else if (task->wait == Task::Wait::kReady) {
+      // A plain coroutine.yield() waits for the next frame.
+      task->wait = Task::Wait::kFrames;
+      task->frame = frame_ + 1;
+    }
+    return;
+  }
+  if (status != LUA_OK) {
+    const char* error = lua_tostring(task->thread, -1);
+    std::string message = error ? error : "unknown error";
+    LOG(ERROR) << "Automation coroutine failed: " << message;
+    if (task->is_test)
+      SetTestResult(TestResult::kFail, message);
+  } else if (task->is_test) {
+    SetTestResult(TestResult::kPass, "");
+  }
+  FinishTask(task);
+}
+
+void Automation::FinishTask(Task* task) {
+  task->done = true;
+  task->wait = Task::Wait::kStopped;
+  luaL_unref(lua_state_, LUA_REGISTRYINDEX, task->condition_ref);
+  task->condition_ref = LUA_NOREF;
+  luaL_unref(lua_state_, LUA_REGISTRYINDEX, task->thread_ref);
+  task->thread_ref = LUA_NOREF;
+}
+
+void Automation::ReleasePcWait(Task* task) {
+  {
+    std::lock_guard<std::mutex> lock(breakpoints_mutex_);
+    auto found = pc_waits_.find(task->pc);
+    if (found != pc_waits_.end() && --found->second == 0)
+      pc_waits_.erase(found);
+  }
+  UpdatePcHook(task->pc);
+}
+
+void Automation::OnPcReached(cpuaddr_t address) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  std::vector<Task*> reached;
+  for (const auto& task : tasks_) {
+    if (task->wait == Task::Wait::kPc && task->pc == address)
+      reached.push_back(task.get());
+  }
+  for (Task* task : reached) {
+    ReleasePcWait(task);
+    lua_pushboolean(task->thread, true);
+    ResumeTask(task, 1);
+  }
+}
+
+void Automation::OnFrame(uint64_t frame) {
+  std::lock_guard<std::recursive_mutex> lua_lock(lua_mutex_);
+  frame_ = frame;
+  if (tasks_.empty())
+    return;
+
+  std::vector<Task*> tasks;
+  for (const auto& task : tasks_)
+    tasks.push_back(task.get());
+  for (Task* task : tasks) {
+    // A task can be finished by one that was resumed before it.
+    if (task->done)
+      continue;
+    bool timed_out = task->frame && frame >= task->frame;
+    switch (task->wait) {
+      case Task::Wait::kFrames:
+        if (frame >= task->frame)
+          ResumeTask(task, 0);
+        break;
+      case Task::Wait::kPc:
+        if (timed_out) {
+          ReleasePcWait(task);
+          lua_pushboolean(task->thread, false);
+          ResumeTask(task, 1);
+        }
+        break;
+      case Task::Wait::kUntil: {
+        bool met = CheckWaitCondition(task);
+        if (met || timed_out) {
+          luaL_unref(lua_state_, LUA_REGISTRYINDEX, task->condition_ref);
+          task->condition_ref = LUA_NOREF;
+          task->condition.reset();
+          lua_pushboolean(task->thread, met);
+          ResumeTask(task, 1);
+        }
+        break;
+      }
+      case Task::Wait::kInput:
+        if (system_->input_injector()->idle())
+          ResumeTask(task, 0);
+        break;
+      case Task::Wait::kReady:
+      case Task::Wait::kStopped:
+        break;
+    }
+  }
+  tasks_.remove_if([](const std::unique_ptr<Task>& task) { return task->done; });
+}
+
+bool Automation::CheckWaitCondition(Task* task) {
+  if (task->condition)
+    return task->condition->Evaluate(CurrentContext(0));
+
+  lua_rawgeti(lua_state_, LUA_REGISTRYINDEX, task->condition_ref);
+  if (lua_pcall(lua_state_, 0, 1, 0) != 0) {
+    LOG(ERROR) << "wait_until condition failed: "
+               << lua_tostring(lua_state_, -1);
+    lua_pop(lua_state_, 1);
+    return false;
+  }
+  bool met = lua_toboolean(lua_state_, -1);
+  lua_pop(lua_state_, 1);
+  return met;
+}
+
+void Automation::SetTestResult(TestResult result, const std::string& message) {
+  TestResult none = TestResult::kNone;
+  if (!test_result_.compare_exchange_strong(none, result))
+    return;
+  if (result == TestResult::kPass)
+    LOG(INFO) << "Test passed" << (message.empty() ? "" : ": ") << message;
+  else
+    LOG(ERROR) << "Test failed: " << message;
+  system_->SetStop();
+}
+
+// static
+Automation::Task* Automation::CheckTask(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  Task* task = automation->current_task_;
+  if (!task || task->thread != L) {
+    luaL_error(L, "c256emu: waits must be made from a test or a coroutine "
+                  "started with c256emu.spawn");
+  }
+  return task;
+}
+
+// static
+int Automation::LuaSpawn(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  std::lock_guard<std::recursive_mutex> lua_lock(automation->lua_mutex_);
+  automation->StartTask(L, lua_gettop(L) - 1, false);
+  return 0;
+}
+
+// static
+int Automation::LuaWaitFrames(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  Task* task = CheckTask(L);
+  lua_Integer frames = luaL_optinteger(L, 1, 1);
+  task->wait = Task::Wait::kFrames;
+  task->frame = automation->frame_ + std::max<lua_Integer>(frames, 1);
+  return lua_yield(L, 0);
+}
+
+// static
+int Automation::LuaWaitPc(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  Task* task = CheckTask(L);
+  cpuaddr_t address = CheckAddress(L, 1);
+  lua_Integer timeout = luaL_optinteger(L, 2, 0);
+  task->wait = Task::Wait::kPc;
+  task->pc = address;
+  task->frame = timeout > 0 ? automation->frame_ + timeout : 0;
+  {
+    std::lock_guard<std::mutex> lock(automation->breakpoints_mutex_);
+    automation->pc_waits_[address]++;
+  }
+  automation->UpdatePcHook(address);
+  return lua_yield(L, 0);
+}
+
+// static
+int Automation::LuaWaitUntil(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  Task* task = CheckTask(L);
+  lua_Integer timeout = luaL_optinteger(L, 2, 0);
+  if (lua_type(L, 1) == LUA_TSTRING) {
+    std::string error;
+    task->condition = BreakpointCondition::Compile(
+        lua_tostring(L, 1), automation->system_->symbols(), &error);
+    if (!task->condition)
+      return luaL_error(L, "c256emu: bad condition: %s", error.c_str());
+  } else {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_pushvalue(L, 1);
+    task->condition_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  task->wait = Task::Wait::kUntil;
+  task->frame = timeout > 0 ? automation->frame_ + timeout : 0;
+  return lua_yield(L, 0);
+}
+
+// static
+int Automation::LuaTypeText(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  InputInjector* input = automation->system_->input_injector();
+  bool all_typed = input->QueueText(luaL_checkstring(L, 1));
+  // Outside a coroutine the text is typed in the background.
+  Task* task = automation->current_task_;
+  if (!task || task->thread != L) {
+    lua_pushboolean(L, all_typed);
+    return 1;
+  }
+  task->wait = Task::Wait::kInput;
+  return lua_yield(L, 0);
+}
+
+// static
+int Automation::LuaInject(lua_State* L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  std::vector<InputEvent> events;
+  lua_Integer count = luaL_len(L, 1);
+  for (lua_Integer i = 1; i <= count; i++) {
+    lua_geti(L, 1, i);
+    luaL_checktype(L, -1, LUA_TTABLE);
+    lua_getfield(L, -1, "type");
+    std::string type = luaL_optstring(L, -1, "key");
+    lua_getfield(L, -2, "time");
+    InputEvent event{InputEvent::Type::kKey,
+                     static_cast<uint64_t>(luaL_optinteger(L, -1, 0))};
+    lua_getfield(L, -3, "action");
+    std::string action = luaL_optstring(L, -1, "press");
+    event.action = action == "release" ? GLFW_RELEASE : GLFW_PRESS;
+    lua_pop(L, 3);
+
+    // Shifted characters are pressed with the shift key held, as
+    // type_text does.
+    bool shift = false;
+    if (type == "key" || type == "button") {
+      event.type = type == "key" ? InputEvent::Type::kKey
+                                 : InputEvent::Type::kMouseButton;
+      lua_getfield(L, -1, type.c_str());
+      if (lua_type(L, -1) == LUA_TSTRING) {
+        if (type == "button")
+          return luaL_error(L, "c256emu: mouse buttons are numbers");
+        const char* character = lua_tostring(L, -1);
+        if (!KeyForCharacter(character[0], &event.key, &shift))
+          return luaL_error(L, "c256emu: no key for '%s'", character);
+      } else {
+        event.key = luaL_checkinteger(L, -1);
+      }
+      lua_pop(L, 1);
+    } else if (type == "move" || type == "scroll") {
+      event.type = type == "move" ? InputEvent::Type::kMouseMove
+                                  : InputEvent::Type::kMouseScroll;
+      lua_getfield(L, -1, "x");
+      lua_getfield(L, -2, "y");
+      event.x = luaL_checknumber(L, -2);
+      event.y = luaL_checknumber(L, -1);
+      lua_pop(L, 2);
+    } else {
+      return luaL_error(L, "c256emu: unknown input event type '%s'",
+                        type.c_str());
+    }
+    lua_pop(L, 1);
+    InputEvent shift_event = event;
+    shift_event.key = GLFW_KEY_LEFT_SHIFT;
+    if (shift && event.action == GLFW_PRESS) {
+      events.push_back(shift_event);
+      event.time_us = 0;
+    }
+    events.push_back(event);
+    if (shift && event.action == GLFW_RELEASE) {
+      shift_event.time_us = 0;
+      events.push_back(shift_event);
+    }
+  }
+  GetAutomation(L)->system_->input_injector()->Queue(events);
+  return 0;
+}
+
+// static
+int Automation::LuaLoadInput(lua_State* L) {
+  InputInjector* input = GetAutomation(L)->system_->input_injector();
+  lua_pushboolean(L, input->LoadFile(luaL_checkstring(L, 1)));
+  return 1;
+}
+
+// static
+int Automation::LuaRecordVideo(lua_State* L) {
+  std::string path = luaL_checkstring(L, 1);
+  VideoRecorder::Options options;
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "format");
+    std::string format = luaL_optstring(L, -1, "y4m");
+    if (!VideoRecorder::ParseFormat(format, &options.format))
+      return luaL_error(L, "c256emu: unknown video format '%s'",
+                        format.c_str());
+    lua_getfield(L, 2, "every");
+    options.every = luaL_optinteger(L, -1, 1);
+    lua_getfield(L, 2, "changed_only");
+    options.changed_only = lua_toboolean(L, -1);
+    lua_pop(L, 3);
+  }
+  lua_pushboolean(L, GetSystem(L)->StartVideoRecording(path, options));
+  return 1;
+}
+
+// static
+int Automation::LuaStopVideo(lua_State* L) {
+  GetSystem(L)->StopVideoRecording();
+  return 0;
+}
+
+// static
+int Automation::LuaPass(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  automation->SetTestResult(TestResult::kPass, luaL_optstring(L, 1, ""));
+  Task* task = automation->current_task_;
+  if (task && task->thread == L) {
+    task->wait = Task::Wait::kStopped;
+    return lua_yield(L, 0);
+  }
+  return 0;
+}
+
+// static
+int Automation::LuaFail(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  automation->SetTestResult(TestResult::kFail,
+                            luaL_optstring(L, 1, "c256emu.fail()"));
+  Task* task = automation->current_task_;
+  if (task && task->thread == L) {
+    task->wait = Task::Wait::kStopped;
+    return lua_yield(L, 0);
+  }
+  return 0;
+}
+
+// static
+int Automation::LuaFrame(lua_State* L) {
+  lua_pushinteger(L, GetAutomation(L)->frame_);
+  return 1;
+}
+
+// static
+int Automation::LuaAddWatchpoint(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  cpuaddr_t start = CheckAddress(L, 1);
+  uint32_t size = luaL_optinteger(L, 2, 1);
+  std::string kind_names = luaL_optstring(L, 3, "w");
+  uint8_t kinds = 0;
+  for (char c : kind_names) {
+    if (c == 'r')
+      kinds |= C256SystemBus::kWatchRead;
+    else if (c == 'w')
+      kinds |= C256SystemBus::kWatchWrite;
+    else if (c == 'c')
+      kinds |= C256SystemBus::kWatchChange;
+    else
+      return luaL_error(L, "c256emu: watch kinds are r, w and c; got: %s",
+                        kind_names.c_str());
+  }
+  int function_ref = LUA_NOREF;
+  if (lua_isfunction(L, 4)) {
+    lua_pushvalue(L, 4);
+    function_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  lua_pushinteger(L,
+                  automation->AddWatchpoint(start, size, kinds, function_ref));
+  return 1;
+}
+
+// static
+int Automation::LuaClearWatchpoint(lua_State* L) {
+  Automation* automation = GetAutomation(L);
+  automation->ClearWatchpoint(luaL_checkinteger(L, -1));
+  return 0;
+}
+
+// static
+int Automation::LuaGetWatchpoints(lua_State* L) {
+  System* sys = GetSystem(L);
+  auto watchpoints = sys->system_bus()->watchpoints();
+
+  lua_createtable(L, watchpoints.size(), 0);
+  for (size_t i = 0; i < watchpoints.size(); i++) {
+    const auto& watchpoint = watchpoints[i];
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, watchpoint.id);
+    lua_setfield(L, -2, "id");
+    lua_pushinteger(L, watchpoint.start);
+    lua_setfield(L, -2, "address");
+    lua_pushinteger(L, watchpoint.size);
+    lua_setfield(L, -2, "size");
+    std::string kinds;
+    if (watchpoint.kinds & C256SystemBus::kWatchRead)
+      kinds += "r";
+    if (watchpoint.kinds & C256SystemBus::kWatchWrite)
+      kinds += "w";
+    if (watchpoint.kinds & C256SystemBus::kWatchChange)
+      kinds += "c";
+    lua_pushstring(L, kinds.c_str());
+    lua_setfield(L, -2, "kinds");
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
 }
 
 // static
 int Automation::LuaAddBreakpoint(lua_State* L) {
   Automation *automation = GetAutomation(L);
-  int8_t num_args = lua_gettop(L);
-  uint32_t addr = lua_tointeger(L, -1 * num_args);
-  if (num_args == 1) {
-    automation->AddBreakpoint(addr);
-  } else {
-    size_t len;
-    const char *function_cstr = lua_tolstring(L, -1, &len);
-    std::string function(function_cstr, len);
-    automation->AddBreakpoint(addr, function);
+  Breakpoint info{CheckAddress(L, 1), "", "", 0, 0};
+  int function_ref = LUA_NOREF;
+  if (lua_isfunction(L, 2)) {
+    lua_pushvalue(L, 2);
+    function_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  } else if (!lua_isnoneornil(L, 2)) {
+    info.lua_function_name = luaL_checkstring(L, 2);
   }
+  if (!lua_isnoneornil(L, 3))
+    info.condition = luaL_checkstring(L, 3);
+  info.ignore_count = luaL_optinteger(L, 4, 0);
 
+  if (!automation->AddBreakpoint(info, function_ref))
+    return luaL_error(L, "c256emu: bad breakpoint condition: %s",
+                      info.condition.c_str());
   return 0;
 }
 
 // static
 int Automation::LuaClearBreakpoint(lua_State* L) {
   Automation* automation = GetAutomation(L);
-  uint32_t addr = lua_tointeger(L, -1);
+  cpuaddr_t addr = CheckAddress(L, -1);
   automation->ClearBreakpoint(addr);
 
   return 0;
@@ -169,9 +896,19 @@ int Automation::LuaGetBreakpoints(lua_State* L) {
 
   lua_createtable(L, breakpoints.size(), 0);
   for (size_t i = 0; i < breakpoints.size(); i++) {
-    const auto breakpoint = breakpoints[i];
+    const auto& breakpoint = breakpoints[i];
+    lua_createtable(L, 0, 5);
     lua_pushinteger(L, breakpoint.address);
-    lua_settable(L, i);
+    lua_setfield(L, -2, "address");
+    lua_pushstring(L, breakpoint.lua_function_name.c_str());
+    lua_setfield(L, -2, "function");
+    lua_pushstring(L, breakpoint.condition.c_str());
+    lua_setfield(L, -2, "condition");
+    lua_pushinteger(L, breakpoint.ignore_count);
+    lua_setfield(L, -2, "ignore");
+    lua_pushinteger(L, breakpoint.hit_count);
+    lua_setfield(L, -2, "hits");
+    lua_rawseti(L, -2, i + 1);
   }
 
   return 1;
@@ -219,17 +956,66 @@ int Automation::LuaPeekBuf(lua_State* L) {
   uint32_t start_addr = lua_tointeger(L, -2);
   uint32_t buf_size = lua_tointeger(L, -1);
 
-  uint32_t end_addr(start_addr + buf_size);
-  std::vector<uint8_t> buffer;
-  for (auto i = start_addr; i < end_addr; i++) {
-    buffer.push_back(sys->ReadByte(i));
-  }
+  std::vector<uint8_t> buffer(buf_size);
+  sys->system_bus()->PeekBlock(start_addr, buffer.data(), buf_size);
 
   lua_pushlstring(L, (const char*)buffer.data(), buf_size);
 
   return 1;
 }
 
+// static
+int Automation::LuaRamView(lua_State* L) {
+  C256SystemBus* bus = GetSystem(L)->system_bus();
+  return PushView(L, bus->ram(), C256SystemBus::kRamSize, 0, true);
+}
+
+// static
+int Automation::LuaVramView(lua_State* L) {
+  Vicky* vicky = GetSystem(L)->vicky();
+  return PushView(L, vicky->vram(), vicky->vram_size(), 0xB00000, true);
+}
+
+// static
+int Automation::LuaFrameBufferView(lua_State* L) {
+  Vicky* vicky = GetSystem(L)->vicky();
+  return PushView(L, reinterpret_cast<uint8_t*>(vicky->frame_buffer()),
+                  vicky->frame_width() * vicky->frame_height() *
+                      sizeof(uint32_t),
+                  0, false);
+}
+
+// static
+int Automation::LuaScaledFrameBuffer(lua_State* L) {
+  int width, height;
+  const uint32_t* pixels = GetSystem(L)->vicky()->ScaledFrame(&width, &height);
+  // A copy, as the scaler reuses its buffer for the next frame.
+  size_t offset, length;
+  CheckRange(L, width * height * sizeof(uint32_t), &offset, &length);
+  lua_pushlstring(L, reinterpret_cast<const char*>(pixels) + offset, length);
+  lua_pushinteger(L, width);
+  lua_pushinteger(L, height);
+  return 3;
+}
+
+// static
+int Automation::LuaSetScale(lua_State* L) {
+  Vicky* vicky = GetSystem(L)->vicky();
+  double scale = luaL_checknumber(L, 1);
+  if (scale <= 0)
+    return luaL_argerror(L, 1, "scale must be positive");
+  if (!lua_isnoneornil(L, 2)) {
+    std::string name = luaL_checkstring(L, 2);
+    Vicky::ScalingQuality quality;
+    if (!ParseScalingQuality(name, &quality))
+      return luaL_error(L, "c256emu: unknown scaling quality '%s'",
+                        name.c_str());
+    vicky->set_scaling_quality(quality);
+  }
+  vicky->set_scale(scale);
+  return 0;
+}
+
 // static
 int Automation::LuaLoadHex(lua_State* L) {
   System* sys = GetSystem(L);
@@ -263,7 +1049,7 @@ int Automation::LuaSys(lua_State* L) {
   System* sys = GetSystem(L);
   Automation* automation = GetAutomation(L);
 
-  uint32_t addr = lua_tointeger(L, -1);
+  cpuaddr_t addr = CheckAddress(L, -1);
 
   automation->debug_interface_->Pause();
   sys->Sys(addr);
@@ -279,8 +1065,7 @@ int Automation::LuaDisasm(lua_State* L) {
   auto disassembler = cpu->GetDisassembler();
   cpuaddr_t addr;
   int8_t num_args = lua_gettop(L);
-  if (lua_isnumber(L, num_args == 2 ? -2 : -1)) {
-    addr = (cpuaddr_t)lua_tointeger(L, num_args == 2 ? -2 : -1);
+  if (num_args > 0 && ToAddress(L, 1, &addr)) {
   } else if (!automation->debug_interface_->paused()) {
     return luaL_error(
         L, "c256emu: cannot disassemble current address while not paused");
@@ -292,14 +1077,50 @@ int Automation::LuaDisasm(lua_State* L) {
     config.max_instruction_count = (uint32_t)lua_tointeger(L, -1);
 
   auto list = disassembler->Disassemble(config, addr);
+  const SymbolTable* symbols = sys->symbols();
   lua_newtable(L);
   for (uint32_t i = 0; i < list.size(); i++) {
-    lua_pushlstring(L, list[i].asm_string.c_str(), list[i].asm_string.size());
+    std::string line = list[i].asm_string;
+    auto symbol = symbols->Find(list[i].canonical_address);
+    if (symbol && symbol->address == list[i].canonical_address)
+      line += " ; " + symbol->name;
+    lua_pushlstring(L, line.c_str(), line.size());
     lua_rawseti(L, -2, i + 1);
   }
   return 1;
 }
 
+// static
+int Automation::LuaLoadSymbols(lua_State* L) {
+  System* sys = GetSystem(L);
+  const std::string path = luaL_checkstring(L, -1);
+  lua_pushboolean(L, sys->symbols()->LoadFile(path));
+  return 1;
+}
+
+// static
+int Automation::LuaSymbol(lua_State* L) {
+  System* sys = GetSystem(L);
+  cpuaddr_t addr = luaL_checkinteger(L, -1);
+  std::string description = sys->symbols()->Describe(addr);
+  if (description.empty())
+    lua_pushnil(L);
+  else
+    lua_pushlstring(L, description.c_str(), description.size());
+  return 1;
+}
+
+// static
+int Automation::LuaAddress(lua_State* L) {
+  System* sys = GetSystem(L);
+  auto address = sys->symbols()->Lookup(luaL_checkstring(L, -1));
+  if (address)
+    lua_pushinteger(L, *address);
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
 // static
 int Automation::LuaStopCpu(lua_State* L) {
   Automation* automation = GetAutomation(L);
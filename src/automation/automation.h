@@ -3,12 +3,18 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <list>
 #include <lua.hpp>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <unordered_map>
 #include <vector>
 
+#include "automation/breakpoint_condition.h"
 #include "automation/lua_describe.h"
+#include "bus/c256_system_bus.h"
 #include "bus/int_controller.h"
 #include "cpu/65816/cpu_65c816.h"
 #include "debug_interface.h"
@@ -29,17 +35,46 @@ class Automation {
   bool LoadScript(const std::string& path);
   std::string Eval(const std::string& expression);
 
-  void AddBreakpoint(cpuaddr_t address, const std::string &function_name = "");
+  // Runs the script at 'path' as a test coroutine. Tests wait on emulator
+  // events with c256emu.wait_* and report with c256emu.pass/fail; the first
+  // verdict (or an error, or the script returning) stops the system.
+  bool RunTest(const std::string& path);
+
+  enum class TestResult { kNone, kPass, kFail };
+  TestResult test_result() const { return test_result_; }
+
+  // Resumes coroutines waiting on frames; called at the end of every frame.
+  void OnFrame(uint64_t frame);
+
+  // Adds or replaces the breakpoint at 'address'. 'condition' is compiled to
+  // a native predicate (see BreakpointCondition) that is checked before any
+  // Lua is run; the first 'ignore_count' hits that pass it are skipped. With
+  // no function the CPU is paused instead. Returns false if the condition
+  // doesn't compile.
+  bool AddBreakpoint(cpuaddr_t address, const std::string &function_name = "",
+                     const std::string &condition = "",
+                     uint64_t ignore_count = 0);
   void ClearBreakpoint(cpuaddr_t address);
 
   struct Breakpoint {
     cpuaddr_t address;
     std::string lua_function_name;
+    std::string condition;
+    uint64_t ignore_count;
+    uint64_t hit_count;
   };
   std::vector<Breakpoint> GetBreakpoints() const;
 
   bool HasBreakpoint(cpuaddr_t addr) const;
 
+  // Watch [start, start + size) for the C256SystemBus::WatchKind accesses in
+  // 'kinds'. On a hit the named Lua function is called with (addr, kind,
+  // old_value, new_value), or the CPU paused if there is none. Returns the
+  // watchpoint id.
+  int AddWatchpoint(cpuaddr_t start, uint32_t size, uint8_t kinds,
+                    const std::string &function_name = "");
+  void ClearWatchpoint(int id);
+
   System* system() { return system_; }
 
  private:
@@ -55,14 +90,89 @@ class Automation {
   static int LuaPeek16(lua_State* L);
   static int LuaPoke16(lua_State* L);
   static int LuaPeekBuf(lua_State* L);
+  static int LuaRamView(lua_State* L);
+  static int LuaVramView(lua_State* L);
+  static int LuaFrameBufferView(lua_State* L);
+  static int LuaScaledFrameBuffer(lua_State* L);
+  static int LuaSetScale(lua_State* L);
   static int LuaLoadHex(lua_State* L);
   static int LuaLoadBin(lua_State* L);
   static int LuaLoadO65(lua_State* L);
   static int LuaSys(lua_State* L);
   static int LuaDisasm(lua_State* L);
+  static int LuaAddWatchpoint(lua_State* L);
+  static int LuaClearWatchpoint(lua_State* L);
+  static int LuaGetWatchpoints(lua_State* L);
+  static int LuaSpawn(lua_State* L);
+  static int LuaWaitFrames(lua_State* L);
+  static int LuaWaitPc(lua_State* L);
+  static int LuaWaitUntil(lua_State* L);
+  static int LuaTypeText(lua_State* L);
+  static int LuaInject(lua_State* L);
+  static int LuaLoadInput(lua_State* L);
+  static int LuaRecordVideo(lua_State* L);
+  static int LuaStopVideo(lua_State* L);
+  static int LuaPass(lua_State* L);
+  static int LuaFail(lua_State* L);
+  static int LuaFrame(lua_State* L);
+  static int LuaLoadSymbols(lua_State* L);
+  static int LuaSymbol(lua_State* L);
+  static int LuaAddress(lua_State* L);
 
   static const ::luaL_Reg c256emu_methods[];
 
+  struct ActiveBreakpoint {
+    Breakpoint info;
+    std::optional<BreakpointCondition> condition;
+    std::atomic<uint64_t> hits{0};
+    bool pause_only = false;
+    // Registry reference to the Lua function; guarded by lua_mutex_, as is
+    // 'released'.
+    int lua_function_ref = LUA_NOREF;
+    bool released = false;
+  };
+
+  bool AddBreakpoint(const Breakpoint &info, int lua_function_ref);
+  void OnBreakpoint(ActiveBreakpoint *breakpoint);
+  void ReleaseBreakpoint(ActiveBreakpoint *breakpoint);
+
+  // Installs the debug hook at 'address' for whatever breakpoint and
+  // coroutine waits currently need it, or removes it if nothing does.
+  void UpdatePcHook(cpuaddr_t address);
+  BreakpointContext CurrentContext(uint64_t hits);
+
+  // A coroutine started by RunTest or c256emu.spawn, and what it waits for.
+  struct Task {
+    enum class Wait { kReady, kFrames, kPc, kUntil, kInput, kStopped };
+
+    lua_State* thread;
+    int thread_ref;
+    bool is_test;
+    Wait wait = Wait::kReady;
+    // The frame to resume at for kFrames, otherwise the timeout (0 = none).
+    uint64_t frame = 0;
+    cpuaddr_t pc = 0;
+    int condition_ref = LUA_NOREF;
+    std::optional<BreakpointCondition> condition;
+    bool done = false;
+  };
+
+  // Starts a coroutine running the function below 'nargs' arguments on top
+  // of L's stack.
+  Task* StartTask(lua_State* L, int nargs, bool is_test);
+  // Resumes 'task' with the 'nargs' values on top of its own stack.
+  void ResumeTask(Task* task, int nargs);
+  void FinishTask(Task* task);
+  void ReleasePcWait(Task* task);
+  void OnPcReached(cpuaddr_t address);
+  bool CheckWaitCondition(Task* task);
+  void SetTestResult(TestResult result, const std::string& message);
+  static Task* CheckTask(lua_State* L);
+
+  int AddWatchpoint(cpuaddr_t start, uint32_t size, uint8_t kinds,
+                    int lua_function_ref);
+  void OnWatchpoint(const C256SystemBus::WatchpointHit &hit);
+
   std::recursive_mutex lua_mutex_;
 
   WDC65C816* cpu_;
@@ -73,5 +183,23 @@ class Automation {
 
   std::unique_ptr<LuaReplContext> repl_context_;
 
-  std::vector<Breakpoint> breakpoints_;
+  mutable std::mutex breakpoints_mutex_;
+  std::unordered_map<cpuaddr_t, std::shared_ptr<ActiveBreakpoint>>
+      breakpoints_;
+
+  // Watchpoint id to Lua registry reference; guarded by lua_mutex_.
+  std::unordered_map<int, int> watchpoint_functions_;
+
+  // Coroutines; guarded by lua_mutex_.
+  std::list<std::unique_ptr<Task>> tasks_;
+  Task* current_task_ = nullptr;
+  uint64_t frame_ = 0;
+  std::atomic<TestResult> test_result_{TestResult::kNone};
+
+  // Number of coroutines waiting at each address; guarded by
+  // breakpoints_mutex_.
+  std::unordered_map<cpuaddr_t, int> pc_waits_;
+  // Addresses whose hooks changed from inside a hook callback, to be updated
+  // after the current instruction; guarded by breakpoints_mutex_.
+  std::vector<cpuaddr_t> stale_pc_hooks_;
 };
@@ -0,0 +1,255 @@
+#include "automation/breakpoint_condition.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include "automation/symbol_table.h"
+#include "bus/c256_system_bus.h"
+
+namespace {
+
+class ConditionParser {
+ public:
+  ConditionParser(const std::string& expression, const SymbolTable* symbols)
+      : expression_(expression), symbols_(symbols) {}
+
+  void SkipSpace() {
+    while (pos_ < expression_.size() &&
+           isspace(static_cast<unsigned char>(expression_[pos_])))
+      pos_++;
+  }
+
+  bool AtEnd() {
+    SkipSpace();
+    return pos_ >= expression_.size();
+  }
+
+  bool Peek(const char* token) {
+    SkipSpace();
+    return expression_.compare(pos_, strlen(token), token) == 0;
+  }
+
+  // Consumes 'token' if it is next in the input.
+  bool Accept(const char* token) {
+    if (!Peek(token))
+      return false;
+    pos_ += strlen(token);
+    return true;
+  }
+
+  bool ParseNumber(uint32_t* value) {
+    SkipSpace();
+    int base = 10;
+    if (Accept("$")) {
+      base = 16;
+    } else if (expression_.compare(pos_, 2, "0x") == 0 ||
+               expression_.compare(pos_, 2, "0X") == 0) {
+      base = 16;
+      pos_ += 2;
+    }
+    const char* start = expression_.c_str() + pos_;
+    char* end;
+    unsigned long v = strtoul(start, &end, base);
+    if (end == start)
+      return false;
+    pos_ += end - start;
+    *value = v;
+    return true;
+  }
+
+  bool ParseIdentifier(std::string* identifier) {
+    SkipSpace();
+    size_t start = pos_;
+    while (pos_ < expression_.size() &&
+           (isalnum(static_cast<unsigned char>(expression_[pos_])) ||
+            expression_[pos_] == '_'))
+      pos_++;
+    if (start == pos_ ||
+        isdigit(static_cast<unsigned char>(expression_[start]))) {
+      pos_ = start;
+      return false;
+    }
+    *identifier = expression_.substr(start, pos_ - start);
+    return true;
+  }
+
+  // A number or symbol name.
+  bool ParseAddress(uint32_t* address, std::string* error) {
+    if (ParseNumber(address))
+      return true;
+    std::string name;
+    if (!ParseIdentifier(&name)) {
+      *error = "expected a number or symbol at " + Position();
+      return false;
+    }
+    auto found = symbols_ ? symbols_->Lookup(name) : std::nullopt;
+    if (!found) {
+      *error = "unknown symbol: " + name;
+      return false;
+    }
+    *address = *found;
+    return true;
+  }
+
+  std::string Position() const { return "offset " + std::to_string(pos_); }
+
+ private:
+  const std::string& expression_;
+  const SymbolTable* symbols_;
+  size_t pos_ = 0;
+};
+
+}  // namespace
+
+// static
+std::optional<BreakpointCondition> BreakpointCondition::Compile(
+    const std::string& expression, const SymbolTable* symbols,
+    std::string* error) {
+  ConditionParser parser(expression, symbols);
+  BreakpointCondition condition;
+
+  auto parse_operand = [&](Operand* operand) {
+    if (parser.Accept("[")) {
+      if (!parser.ParseAddress(&operand->value, error))
+        return false;
+      if (!parser.Accept("]")) {
+        *error = "expected ']' at " + parser.Position();
+        return false;
+      }
+      operand->source = parser.Accept(".w") ? Source::kWord : Source::kByte;
+      return true;
+    }
+    operand->source = Source::kConstant;
+    if (parser.ParseNumber(&operand->value))
+      return true;
+    std::string name;
+    if (!parser.ParseIdentifier(&name)) {
+      *error = "expected an operand at " + parser.Position();
+      return false;
+    }
+    static const struct {
+      const char* name;
+      Source source;
+    } kRegisters[] = {{"a", Source::kA},         {"x", Source::kX},
+                      {"y", Source::kY},         {"pc", Source::kPC},
+                      {"sp", Source::kSP},       {"d", Source::kD},
+                      {"cycle", Source::kCycle}, {"hits", Source::kHits}};
+    for (const auto& reg : kRegisters) {
+      if (name == reg.name) {
+        operand->source = reg.source;
+        return true;
+      }
+    }
+    auto found = symbols ? symbols->Lookup(name) : std::nullopt;
+    if (!found) {
+      *error = "unknown register or symbol: " + name;
+      return false;
+    }
+    operand->value = *found;
+    return true;
+  };
+
+  do {
+    Clause clause;
+    if (!parse_operand(&clause.lhs))
+      return std::nullopt;
+    // Longer operators must be tried first.
+    static const struct {
+      const char* token;
+      Op op;
+    } kOps[] = {{"==", Op::kEq}, {"!=", Op::kNe}, {"<=", Op::kLe},
+                {">=", Op::kGe}, {"<", Op::kLt},  {">", Op::kGt}};
+    bool found_op = false;
+    for (const auto& op : kOps) {
+      if (parser.Accept(op.token)) {
+        clause.op = op.op;
+        found_op = true;
+        break;
+      }
+    }
+    // '&' is only a bit test if it isn't the start of '&&'.
+    if (!found_op && !parser.Peek("&&") && parser.Accept("&")) {
+      clause.op = Op::kAnd;
+      found_op = true;
+    }
+    if (!found_op) {
+      *error = "expected a comparison at " + parser.Position();
+      return std::nullopt;
+    }
+    if (!parse_operand(&clause.rhs))
+      return std::nullopt;
+    condition.clauses_.push_back(clause);
+  } while (parser.Accept("&&"));
+
+  if (!parser.AtEnd()) {
+    *error = "unexpected input at " + parser.Position();
+    return std::nullopt;
+  }
+  return condition;
+}
+
+bool BreakpointCondition::Evaluate(const BreakpointContext& context) const {
+  for (const Clause& clause : clauses_) {
+    uint64_t lhs = Fetch(clause.lhs, context);
+    uint64_t rhs = Fetch(clause.rhs, context);
+    bool result;
+    switch (clause.op) {
+      case Op::kEq:
+        result = lhs == rhs;
+        break;
+      case Op::kNe:
+        result = lhs != rhs;
+        break;
+      case Op::kLt:
+        result = lhs < rhs;
+        break;
+      case Op::kLe:
+        result = lhs <= rhs;
+        break;
+      case Op::kGt:
+        result = lhs > rhs;
+        break;
+      case Op::kGe:
+        result = lhs >= rhs;
+        break;
+      case Op::kAnd:
+        result = (lhs & rhs) != 0;
+        break;
+    }
+    if (!result)
+      return false;
+  }
+  return true;
+}
+
+// static
+uint64_t BreakpointCondition::Fetch(const Operand& operand,
+                                    const BreakpointContext& context) {
+  switch (operand.source) {
+    case Source::kConstant:
+      return operand.value;
+    case Source::kA:
+      return context.a;
+    case Source::kX:
+      return context.x;
+    case Source::kY:
+      return context.y;
+    case Source::kPC:
+      return context.pc;
+    case Source::kSP:
+      return context.sp;
+    case Source::kD:
+      return context.d;
+    case Source::kCycle:
+      return context.cycle;
+    case Source::kHits:
+      return context.hits;
+    case Source::kByte:
+      return context.bus->PeekByte(operand.value);
+    case Source::kWord:
+      return context.bus->PeekByte(operand.value) |
+             context.bus->PeekByte(operand.value + 1) << 8;
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+
+class C256SystemBus;
+class SymbolTable;
+
+// The machine state a breakpoint condition is evaluated against.
+struct BreakpointContext {
+  uint32_t a;
+  uint32_t x;
+  uint32_t y;
+  uint32_t pc;
+  uint32_t sp;
+  uint32_t d;
+  uint64_t cycle;
+  uint64_t hits;
+  C256SystemBus* bus;
+};
+
+// A breakpoint condition compiled to a flat list of native comparisons, so
+// that it can be checked on every hit without entering Lua.
+//
+// Conditions are comparisons joined by '&&', e.g.
+//   a == 0x10 && [0x1234] != 0 && hits > 5
+// Operands are integers, registers (a, x, y, pc, sp, d, cycle), the hit count
+// ('hits'), symbol names, or memory: '[addr]' for a byte, '[addr].w' for a
+// word. Operators are ==, !=, <, <=, >, >= and '&' (any bits in common).
+class BreakpointCondition {
+ public:
+  // Returns nullopt and sets 'error' if 'expression' can't be compiled.
+  // 'symbols' may be null.
+  static std::optional<BreakpointCondition> Compile(
+      const std::string& expression, const SymbolTable* symbols,
+      std::string* error);
+
+  bool Evaluate(const BreakpointContext& context) const;
+
+  bool empty() const { return clauses_.empty(); }
+
+ private:
+  enum class Source { kConstant, kA, kX, kY, kPC, kSP, kD, kCycle, kHits,
+                      kByte, kWord };
+  enum class Op { kEq, kNe, kLt, kLe, kGt, kGe, kAnd };
+
+  struct Operand {
+    Source source;
+    uint32_t value;  // The constant, or the address for memory operands.
+  };
+
+  struct Clause {
+    Operand lhs;
+    Op op;
+    Operand rhs;
+  };
+
+  static uint64_t Fetch(const Operand& operand,
+                        const BreakpointContext& context);
+
+  std::vector<Clause> clauses_;
+};
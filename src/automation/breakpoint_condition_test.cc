@@ -0,0 +1,63 @@
+#include "automation/breakpoint_condition.h"
+
+#include <gtest/gtest.h>
+
+#include "automation/symbol_table.h"
+
+namespace {
+
+BreakpointContext Context() {
+  BreakpointContext context{};
+  context.a = 0x10;
+  context.x = 0x1234;
+  context.y = 3;
+  context.pc = 0x190020;
+  return context;
+}
+
+bool Check(const std::string& expression, const BreakpointContext& context,
+           const SymbolTable* symbols = nullptr) {
+  std::string error;
+  auto condition = BreakpointCondition::Compile(expression, symbols, &error);
+  EXPECT_TRUE(condition) << expression << ": " << error;
+  return condition && condition->Evaluate(context);
+}
+
+}  // namespace
+
+TEST(BreakpointConditionTest, RegisterComparisons) {
+  BreakpointContext context = Context();
+  EXPECT_TRUE(Check("a == 0x10", context));
+  EXPECT_TRUE(Check("x >= $1234 && y < 4", context));
+  EXPECT_FALSE(Check("x >= $1234 && y > 4", context));
+  EXPECT_TRUE(Check("a & 0x30", context));
+  EXPECT_FALSE(Check("a & 0x20", context));
+  EXPECT_TRUE(Check("pc != 0", context));
+}
+
+TEST(BreakpointConditionTest, HitCounts) {
+  BreakpointContext context = Context();
+  std::string error;
+  auto condition = BreakpointCondition::Compile("hits >= 2", nullptr, &error);
+  ASSERT_TRUE(condition);
+  context.hits = 1;
+  EXPECT_FALSE(condition->Evaluate(context));
+  context.hits = 2;
+  EXPECT_TRUE(condition->Evaluate(context));
+}
+
+TEST(BreakpointConditionTest, Symbols) {
+  SymbolTable symbols;
+  symbols.Add("limit", 0x1234);
+  EXPECT_TRUE(Check("x == limit", Context(), &symbols));
+}
+
+TEST(BreakpointConditionTest, RejectsBadExpressions) {
+  std::string error;
+  EXPECT_FALSE(BreakpointCondition::Compile("a ==", nullptr, &error));
+  EXPECT_FALSE(BreakpointCondition::Compile("a 3", nullptr, &error));
+  EXPECT_FALSE(BreakpointCondition::Compile("q == 1", nullptr, &error));
+  EXPECT_FALSE(BreakpointCondition::Compile("[1234 == 1", nullptr, &error));
+  EXPECT_FALSE(BreakpointCondition::Compile("a == 1 ||", nullptr, &error));
+  EXPECT_FALSE(error.empty());
+}
@@ -0,0 +1,218 @@
+#include "automation/input_injector.h"
+
+#include <GLFW/glfw3.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "automation/key_map.h"
+#include "bus/c256_system_bus.h"
+#include "bus/i8042_kbd_mouse.h"
+#include "bus/ps2_kbdmouse.h"
+#include "system.h"
+
+DECLARE_double(clock_rate);
+
+namespace {
+
+bool ParseAction(const std::string& action, int* glfw_action) {
+  if (action == "press")
+    *glfw_action = GLFW_PRESS;
+  else if (action == "release")
+    *glfw_action = GLFW_RELEASE;
+  else
+    return false;
+  return true;
+}
+
+void AddKey(std::vector<InputEvent>* events, uint64_t time_us, int key,
+            int action) {
+  InputEvent event{InputEvent::Type::kKey, time_us};
+  event.key = key;
+  event.action = action;
+  events->push_back(event);
+}
+
+// Appends the presses for 'text'; only the first event carries 'time_us'.
+bool AddText(std::vector<InputEvent>* events, uint64_t time_us,
+             const std::string& text) {
+  bool all_typed = true;
+  for (char c : text) {
+    int key;
+    bool shift;
+    if (!KeyForCharacter(c, &key, &shift)) {
+      LOG(WARNING) << "No key for character " << (int)c;
+      all_typed = false;
+      continue;
+    }
+    if (shift) {
+      AddKey(events, time_us, GLFW_KEY_LEFT_SHIFT, GLFW_PRESS);
+      time_us = 0;
+    }
+    AddKey(events, time_us, key, GLFW_PRESS);
+    AddKey(events, 0, key, GLFW_RELEASE);
+    if (shift)
+      AddKey(events, 0, GLFW_KEY_LEFT_SHIFT, GLFW_RELEASE);
+    time_us = 0;
+  }
+  return all_typed;
+}
+
+}  // namespace
+
+InputInjector::InputInjector(System* system) : system_(system) {
+  system_->system_bus()->keyboard()->set_drain_callback([this]() {
+    // Called from inside the guest's port read, so deliver afterwards.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() || pump_scheduled_)
+      return;
+    pump_scheduled_ = true;
+    system_->ScheduleEvent(0, [this]() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pump_scheduled_ = false;
+      }
+      Pump();
+    });
+  });
+}
+
+void InputInjector::Queue(const std::vector<InputEvent>& events) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const InputEvent& event : events)
+    pending_.push_back({event});
+  has_pending_ = !pending_.empty();
+}
+
+bool InputInjector::QueueText(const std::string& text) {
+  std::vector<InputEvent> events;
+  bool all_typed = AddText(&events, 0, text);
+  Queue(events);
+  return all_typed;
+}
+
+bool InputInjector::LoadFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Unable to open input events: " << path;
+    return false;
+  }
+
+  std::vector<InputEvent> events;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream fields(line);
+    uint64_t time_us;
+    std::string type;
+    if (!(fields >> time_us))
+      continue;  // Blank line.
+    if (!(fields >> type)) {
+      LOG(ERROR) << path << ":" << line_number << ": missing event type";
+      return false;
+    }
+
+    InputEvent event{InputEvent::Type::kKey, time_us};
+    std::string action;
+    bool valid;
+    if (type == "key" || type == "button") {
+      event.type = type == "key" ? InputEvent::Type::kKey
+                                 : InputEvent::Type::kMouseButton;
+      valid = (fields >> action >> event.key) &&
+              ParseAction(action, &event.action);
+    } else if (type == "move" || type == "scroll") {
+      event.type = type == "move" ? InputEvent::Type::kMouseMove
+                                  : InputEvent::Type::kMouseScroll;
+      valid = static_cast<bool>(fields >> event.x >> event.y);
+    } else if (type == "text") {
+      std::string text;
+      fields.get();  // The separating space.
+      std::getline(fields, text);
+      AddText(&events, time_us, text);
+      continue;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      LOG(ERROR) << path << ":" << line_number << ": bad event: " << line;
+      return false;
+    }
+    events.push_back(event);
+  }
+
+  LOG(INFO) << "Queued " << events.size() << " input events from " << path;
+  Queue(events);
+  return true;
+}
+
+void InputInjector::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.clear();
+  has_pending_ = false;
+}
+
+bool InputInjector::idle() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.empty();
+}
+
+void InputInjector::Pump() {
+  // Called every scanline; don't take the lock when there's nothing to do.
+  if (!has_pending_.load(std::memory_order_relaxed))
+    return;
+  uint64_t now = system_->cpu()->cpu_state.cycle;
+  I8042* controller = system_->system_bus()->keyboard();
+  for (;;) {
+    InputEvent event;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_.empty())
+        return;
+      // Batches queued since the last pump start their clocks now.
+      for (auto it = pending_.rbegin(); it != pending_.rend() && !it->scheduled;
+           ++it) {
+        it->due_cycle = now + it->event.time_us * FLAGS_clock_rate;
+        it->scheduled = true;
+      }
+
+      const Pending& next = pending_.front();
+      if (next.due_cycle > now)
+        return;
+      if (next.event.type == InputEvent::Type::kKey) {
+        PS2KbdState* kbd = controller->kbd();
+        if (!kbd->scan_enabled() || kbd->queue_count() != 0)
+          return;
+      } else if (controller->mouse()->queue_count() != 0) {
+        return;
+      }
+      event = next.event;
+      pending_.pop_front();
+      has_pending_ = !pending_.empty();
+    }
+    // Delivered outside the lock, as it raises the keyboard IRQ.
+    Deliver(event);
+  }
+}
+
+void InputInjector::Deliver(const InputEvent& event) {
+  switch (event.type) {
+    case InputEvent::Type::kKey:
+      system_->KeyEvent(event.key, 0, event.action, 0);
+      break;
+    case InputEvent::Type::kMouseMove:
+      system_->MouseMoveEvent(event.x, event.y);
+      break;
+    case InputEvent::Type::kMouseButton:
+      system_->MouseButtonEvent(event.key, event.action, 0);
+      break;
+    case InputEvent::Type::kMouseScroll:
+      system_->MouseScrollEvent(event.x, event.y);
+      break;
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class System;
+
+// A scripted keyboard or mouse event.
+struct InputEvent {
+  enum class Type { kKey, kMouseMove, kMouseButton, kMouseScroll };
+
+  Type type;
+  // Emulated microseconds after the event's batch was queued before it may
+  // be delivered. Events are never reordered, so 0 means "as soon as the
+  // guest has consumed the previous one".
+  uint64_t time_us = 0;
+  int key = 0;     // GLFW key or mouse button.
+  int action = 0;  // GLFW_PRESS or GLFW_RELEASE.
+  double x = 0;    // Mouse position or scroll offset.
+  double y = 0;
+};
+
+// Feeds scripted input into the PS/2 devices as fast as the guest consumes
+// it. An event is only delivered once its device's queue is empty, so the
+// PS/2 ring never overflows, and the next event is pumped as soon as the
+// guest's read drains the queue rather than after a fixed delay.
+//
+// Events may be queued from any thread; they are delivered on the CPU
+// thread.
+class InputInjector {
+ public:
+  explicit InputInjector(System* system);
+
+  void Queue(const std::vector<InputEvent>& events);
+
+  // Queues the key presses that type 'text' on a US layout. Characters with
+  // no key are skipped; returns false if there were any.
+  bool QueueText(const std::string& text);
+
+  // Loads and queues an event file. Each line is '<time_us> <event>', with
+  // events
+  //   key press|release <glfw key>
+  //   button press|release <button>
+  //   move <x> <y>
+  //   scroll <dx> <dy>
+  //   text <rest of line>
+  // Times are relative to when the file is loaded; '#' starts a comment.
+  bool LoadFile(const std::string& path);
+
+  // Discards everything not yet delivered.
+  void Clear();
+
+  // True when there is nothing left to deliver.
+  bool idle() const;
+
+  // Delivers whatever the guest is ready for. Runs on the CPU thread.
+  void Pump();
+
+ private:
+  struct Pending {
+    InputEvent event;
+    // Absolute cycle the event is due at, once the batch has been seen by
+    // Pump().
+    uint64_t due_cycle = 0;
+    bool scheduled = false;
+  };
+
+  void Deliver(const InputEvent& event);
+
+  System* system_;
+
+  mutable std::mutex mutex_;
+  std::deque<Pending> pending_;
+  // Whether pending_ is non-empty; written under mutex_.
+  std::atomic_bool has_pending_ = false;
+  // Set while a drain-triggered Pump() is scheduled.
+  bool pump_scheduled_ = false;
+};
@@ -0,0 +1,61 @@
+#include "automation/key_map.h"
+
+#include <GLFW/glfw3.h>
+
+namespace {
+
+struct CharacterKey {
+  char c;
+  int key;
+  bool shift;
+};
+
+constexpr CharacterKey kCharacterKeys[] = {
+    {' ', GLFW_KEY_SPACE, false},        {'\n', GLFW_KEY_ENTER, false},
+    {'\r', GLFW_KEY_ENTER, false},       {'\t', GLFW_KEY_TAB, false},
+    {'\b', GLFW_KEY_BACKSPACE, false},   {27, GLFW_KEY_ESCAPE, false},
+    {'-', GLFW_KEY_MINUS, false},        {'_', GLFW_KEY_MINUS, true},
+    {'=', GLFW_KEY_EQUAL, false},        {'+', GLFW_KEY_EQUAL, true},
+    {'[', GLFW_KEY_LEFT_BRACKET, false}, {'{', GLFW_KEY_LEFT_BRACKET, true},
+    {']', GLFW_KEY_RIGHT_BRACKET, false}, {'}', GLFW_KEY_RIGHT_BRACKET, true},
+    {'\\', GLFW_KEY_BACKSLASH, false},   {'|', GLFW_KEY_BACKSLASH, true},
+    {';', GLFW_KEY_SEMICOLON, false},    {':', GLFW_KEY_SEMICOLON, true},
+    {'\'', GLFW_KEY_APOSTROPHE, false},  {'"', GLFW_KEY_APOSTROPHE, true},
+    {',', GLFW_KEY_COMMA, false},        {'<', GLFW_KEY_COMMA, true},
+    {'.', GLFW_KEY_PERIOD, false},       {'>', GLFW_KEY_PERIOD, true},
+    {'/', GLFW_KEY_SLASH, false},        {'?', GLFW_KEY_SLASH, true},
+    {'`', GLFW_KEY_GRAVE_ACCENT, false}, {'~', GLFW_KEY_GRAVE_ACCENT, true},
+    {')', GLFW_KEY_0, true},             {'!', GLFW_KEY_1, true},
+    {'@', GLFW_KEY_2, true},             {'#', GLFW_KEY_3, true},
+    {'$', GLFW_KEY_4, true},             {'%', GLFW_KEY_5, true},
+    {'^', GLFW_KEY_6, true},             {'&', GLFW_KEY_7, true},
+    {'*', GLFW_KEY_8, true},             {'(', GLFW_KEY_9, true},
+};
+
+}  // namespace
+
+bool KeyForCharacter(char c, int* glfw_key, bool* shift) {
+  if (c >= 'a' && c <= 'z') {
+    *glfw_key = GLFW_KEY_A + (c - 'a');
+    *shift = false;
+    return true;
+  }
+  if (c >= 'A' && c <= 'Z') {
+    *glfw_key = GLFW_KEY_A + (c - 'A');
+    *shift = true;
+    return true;
+  }
+  if (c >= '0' && c <= '9') {
+    *glfw_key = GLFW_KEY_0 + (c - '0');
+    *shift = false;
+    return true;
+  }
+  for (const auto& entry : kCharacterKeys) {
+    if (entry.c == c) {
+      *glfw_key = entry.key;
+      *shift = entry.shift;
+      return true;
+    }
+  }
+  return false;
+}
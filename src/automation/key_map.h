@@ -0,0 +1,5 @@
+#pragma once
+
+// Maps a character to the GLFW key (and shift state) that types it on a US
+// keyboard layout. Returns false for characters with no key.
+bool KeyForCharacter(char c, int* glfw_key, bool* shift);
@@ -0,0 +1,182 @@
+#include "automation/lua_memory_view.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "bus/hash.h"
+
+namespace {
+
+constexpr const char kMemoryViewType[] = "c256emu.MemoryView";
+
+LuaMemoryView* CheckView(lua_State* L, int idx) {
+  return static_cast<LuaMemoryView*>(
+      luaL_checkudata(L, idx, kMemoryViewType));
+}
+
+// Accepts either a view or a Lua string as a block of bytes.
+const uint8_t* CheckBytes(lua_State* L, int idx, size_t* size) {
+  auto* view =
+      static_cast<LuaMemoryView*>(luaL_testudata(L, idx, kMemoryViewType));
+  if (view) {
+    *size = view->size;
+    return view->data;
+  }
+  return reinterpret_cast<const uint8_t*>(luaL_checklstring(L, idx, size));
+}
+
+// Resolves an (offset, length) pair at 'idx' against the view, clamping the
+// length to what's left.
+void CheckRange(lua_State* L, int idx, const LuaMemoryView& view,
+                size_t* offset, size_t* length) {
+  lua_Integer off = luaL_optinteger(L, idx, 0);
+  if (off < 0 || static_cast<size_t>(off) > view.size)
+    luaL_argerror(L, idx, "offset out of range");
+  *offset = off;
+  lua_Integer len = luaL_optinteger(L, idx + 1, view.size - *offset);
+  if (len < 0)
+    luaL_argerror(L, idx + 1, "negative length");
+  *length = std::min<size_t>(len, view.size - *offset);
+}
+
+int ViewIndex(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  if (lua_isinteger(L, 2)) {
+    lua_Integer offset = lua_tointeger(L, 2);
+    if (offset < 0 || static_cast<size_t>(offset) >= view->size)
+      lua_pushnil(L);
+    else
+      lua_pushinteger(L, view->data[offset]);
+    return 1;
+  }
+  // Anything else is a method lookup in the methods table upvalue.
+  lua_pushvalue(L, 2);
+  lua_rawget(L, lua_upvalueindex(1));
+  return 1;
+}
+
+int ViewNewIndex(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  lua_Integer offset = luaL_checkinteger(L, 2);
+  lua_Integer value = luaL_checkinteger(L, 3);
+  if (!view->writable)
+    return luaL_error(L, "c256emu: memory view is read only");
+  if (offset < 0 || static_cast<size_t>(offset) >= view->size)
+    return luaL_argerror(L, 2, "offset out of range");
+  view->data[offset] = value;
+  return 0;
+}
+
+int ViewLen(lua_State* L) {
+  lua_pushinteger(L, CheckView(L, 1)->size);
+  return 1;
+}
+
+int ViewToString(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  char description[64];
+  snprintf(description, sizeof(description), "MemoryView(%06x, %zu bytes)",
+           view->address, view->size);
+  lua_pushstring(L, description);
+  return 1;
+}
+
+int ViewAddress(lua_State* L) {
+  lua_pushinteger(L, CheckView(L, 1)->address);
+  return 1;
+}
+
+int ViewSub(lua_State* L) {
+  LuaMemoryView view = *CheckView(L, 1);
+  size_t offset, length;
+  CheckRange(L, 2, view, &offset, &length);
+  view.data += offset;
+  view.address += offset;
+  view.size = length;
+  LuaMemoryView::Push(L, view);
+  return 1;
+}
+
+int ViewString(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  size_t offset, length;
+  CheckRange(L, 2, *view, &offset, &length);
+  lua_pushlstring(L, reinterpret_cast<const char*>(view->data + offset),
+                  length);
+  return 1;
+}
+
+int ViewFind(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  size_t needle_size;
+  const uint8_t* needle = CheckBytes(L, 2, &needle_size);
+  lua_Integer start = luaL_optinteger(L, 3, 0);
+  if (start < 0 || static_cast<size_t>(start) > view->size)
+    return luaL_argerror(L, 3, "offset out of range");
+  void* found = memmem(view->data + start, view->size - start, needle,
+                       needle_size);
+  if (!found)
+    lua_pushnil(L);
+  else
+    lua_pushinteger(L, static_cast<uint8_t*>(found) - view->data);
+  return 1;
+}
+
+int ViewCompare(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  size_t other_size;
+  const uint8_t* other = CheckBytes(L, 2, &other_size);
+  size_t common = std::min(view->size, other_size);
+  if (memcmp(view->data, other, common) == 0) {
+    if (view->size == other_size)
+      lua_pushnil(L);
+    else
+      lua_pushinteger(L, common);
+    return 1;
+  }
+  auto mismatch = std::mismatch(view->data, view->data + common, other);
+  lua_pushinteger(L, mismatch.first - view->data);
+  return 1;
+}
+
+int ViewHash(lua_State* L) {
+  LuaMemoryView* view = CheckView(L, 1);
+  lua_pushinteger(L, static_cast<lua_Integer>(
+                         HashBytes(view->data, view->size)));
+  return 1;
+}
+
+const luaL_Reg kViewMethods[] = {{"address", ViewAddress},
+                                 {"sub", ViewSub},
+                                 {"string", ViewString},
+                                 {"find", ViewFind},
+                                 {"compare", ViewCompare},
+                                 {"hash", ViewHash},
+                                 {nullptr, nullptr}};
+
+}  // namespace
+
+// static
+void LuaMemoryView::Register(lua_State* L) {
+  luaL_newmetatable(L, kMemoryViewType);
+  luaL_newlib(L, kViewMethods);
+  lua_pushcclosure(L, ViewIndex, 1);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, ViewNewIndex);
+  lua_setfield(L, -2, "__newindex");
+  lua_pushcfunction(L, ViewLen);
+  lua_setfield(L, -2, "__len");
+  lua_pushcfunction(L, ViewToString);
+  lua_setfield(L, -2, "__tostring");
+  lua_pop(L, 1);
+}
+
+// static
+void LuaMemoryView::Push(lua_State* L, const LuaMemoryView& view) {
+  auto* userdata =
+      static_cast<LuaMemoryView*>(lua_newuserdata(L, sizeof(LuaMemoryView)));
+  *userdata = view;
+  luaL_setmetatable(L, kMemoryViewType);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <lua.hpp>
+
+#include "cpu.h"
+
+// A window onto emulator memory (RAM, VRAM, the frame buffer) exposed to Lua
+// as userdata. Views never copy: indexing, slicing, searching, comparing and
+// hashing all run directly against the underlying buffer.
+//
+// From Lua, offsets are 0-based relative to the start of the view:
+//   v[i], v[i] = b      byte access (writes only on writable views)
+//   #v                  size in bytes
+//   v:address()         bus address of the first byte
+//   v:sub(off, len)     a narrower view
+//   v:string(off, len)  copy bytes out as a Lua string
+//   v:find(needle, off) offset of a string/view, or nil
+//   v:compare(other)    nil if equal to a string/view, else first difference
+//   v:hash()            64-bit hash of the contents
+struct LuaMemoryView {
+  uint8_t* data;
+  size_t size;
+  cpuaddr_t address;
+  bool writable;
+
+  // Registers the view metatable; call once per lua_State.
+  static void Register(lua_State* L);
+
+  static void Push(lua_State* L, const LuaMemoryView& view);
+};
@@ -0,0 +1,303 @@
+#include "automation/symbol_table.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+constexpr cpuaddr_t kBankSize = 0x10000;
+
+bool EndsWith(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool ParseHex(const std::string& str, uint32_t* value) {
+  if (str.empty())
+    return false;
+  char* end;
+  unsigned long v = strtoul(str.c_str(), &end, 16);
+  if (*end != 0)
+    return false;
+  *value = v;
+  return true;
+}
+
+// Splits a .dbg line's 'key=value,key="value"' list into its fields.
+std::vector<std::pair<std::string, std::string>> ParseDbgFields(
+    const std::string& fields) {
+  std::vector<std::pair<std::string, std::string>> result;
+  size_t pos = 0;
+  while (pos < fields.size()) {
+    size_t eq = fields.find('=', pos);
+    if (eq == std::string::npos)
+      break;
+    std::string key = fields.substr(pos, eq - pos);
+    std::string value;
+    pos = eq + 1;
+    if (pos < fields.size() && fields[pos] == '"') {
+      size_t close = fields.find('"', pos + 1);
+      if (close == std::string::npos)
+        close = fields.size();
+      value = fields.substr(pos + 1, close - pos - 1);
+      pos = close + 1;
+    } else {
+      size_t comma = fields.find(',', pos);
+      if (comma == std::string::npos)
+        comma = fields.size();
+      value = fields.substr(pos, comma - pos);
+      pos = comma;
+    }
+    if (pos < fields.size() && fields[pos] == ',')
+      pos++;
+    result.emplace_back(std::move(key), std::move(value));
+  }
+  return result;
+}
+
+}  // namespace
+
+bool SymbolTable::LoadFile(const std::string& path) {
+  if (EndsWith(path, ".map"))
+    return LoadLd65Map(path);
+  if (EndsWith(path, ".dbg"))
+    return LoadLd65Dbg(path);
+  return LoadViceLabels(path);
+}
+
+bool SymbolTable::LoadLd65Map(const std::string& path) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    LOG(ERROR) << "Unable to open symbol map: " << path;
+    return false;
+  }
+
+  // Only the "Exports list by name" section is used; the "by value" list that
+  // follows holds the same entries. Each line holds up to two
+  // 'name value flags' triples.
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  std::string line;
+  bool in_exports = false;
+  size_t count = 0;
+  while (std::getline(in, line)) {
+    if (!in_exports) {
+      in_exports = line.find("Exports list by name:") == 0;
+      continue;
+    }
+    if (line.empty() || line[0] == '-')
+      continue;
+    if (line.find(':') != std::string::npos)
+      break;
+    std::istringstream fields(line);
+    std::string name, value, flags;
+    while (fields >> name >> value >> flags) {
+      uint32_t address;
+      if (!ParseHex(value, &address))
+        continue;
+      AddLocked(name, address, 0);
+      count++;
+    }
+  }
+  RebuildIndex();
+  LOG(INFO) << "Loaded " << count << " symbols from " << path;
+  return true;
+}
+
+bool SymbolTable::LoadLd65Dbg(const std::string& path) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    LOG(ERROR) << "Unable to open debug info: " << path;
+    return false;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  std::string line;
+  size_t count = 0;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 4, "sym\t") != 0)
+      continue;
+    std::string name;
+    std::string type;
+    uint32_t address = 0;
+    uint32_t size = 0;
+    bool has_value = false;
+    for (const auto& field : ParseDbgFields(line.substr(4))) {
+      if (field.first == "name") {
+        name = field.second;
+      } else if (field.first == "type") {
+        type = field.second;
+      } else if (field.first == "val") {
+        address = strtoul(field.second.c_str(), nullptr, 0);
+        has_value = true;
+      } else if (field.first == "size") {
+        size = strtoul(field.second.c_str(), nullptr, 0);
+      }
+    }
+    // Equates are constants, and imports carry no value of their own.
+    if (type != "lab" || !has_value || name.empty())
+      continue;
+    AddLocked(name, address, size);
+    count++;
+  }
+  RebuildIndex();
+  LOG(INFO) << "Loaded " << count << " symbols from " << path;
+  return true;
+}
+
+bool SymbolTable::LoadViceLabels(const std::string& path) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    LOG(ERROR) << "Unable to open label file: " << path;
+    return false;
+  }
+
+  // Lines look like 'al C:1234 .label' or 'al 001234 .label'.
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  std::string line;
+  size_t count = 0;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string command, value, name;
+    if (!(fields >> command >> value >> name) || command != "al")
+      continue;
+    if (value.size() > 2 && value[1] == ':')
+      value = value.substr(2);
+    if (name[0] == '.')
+      name = name.substr(1);
+    uint32_t address;
+    if (name.empty() || !ParseHex(value, &address))
+      continue;
+    AddLocked(name, address, 0);
+    count++;
+  }
+  RebuildIndex();
+  LOG(INFO) << "Loaded " << count << " labels from " << path;
+  return true;
+}
+
+void SymbolTable::Add(const std::string& name, cpuaddr_t address,
+                      uint32_t size) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  AddLocked(name, address, size);
+  RebuildIndex();
+}
+
+void SymbolTable::Add(const std::vector<Symbol>& symbols) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  for (const Symbol& symbol : symbols)
+    AddLocked(symbol.name, symbol.address, symbol.size);
+  RebuildIndex();
+}
+
+void SymbolTable::Clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  symbols_.clear();
+  by_name_.clear();
+  index_.clear();
+}
+
+std::optional<SymbolTable::Symbol> SymbolTable::Find(cpuaddr_t address) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  const Interval* interval = FindInterval(address);
+  if (!interval)
+    return std::nullopt;
+  return symbols_[interval->symbol];
+}
+
+std::optional<cpuaddr_t> SymbolTable::Lookup(const std::string& name) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto found = by_name_.find(name);
+  if (found == by_name_.end())
+    return std::nullopt;
+  return symbols_[found->second].address;
+}
+
+std::string SymbolTable::Describe(cpuaddr_t address) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  const Interval* interval = FindInterval(address);
+  if (!interval)
+    return "";
+  const Symbol& symbol = symbols_[interval->symbol];
+  if (symbol.address == address)
+    return symbol.name;
+  std::stringstream description;
+  description << symbol.name << "+" << std::hex
+              << (address - symbol.address);
+  return description.str();
+}
+
+size_t SymbolTable::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return symbols_.size();
+}
+
+void SymbolTable::AddLocked(const std::string& name, cpuaddr_t address,
+                            uint32_t size) {
+  auto found = by_name_.find(name);
+  if (found != by_name_.end()) {
+    // Reloading a file replaces the old definition.
+    symbols_[found->second].address = address;
+    symbols_[found->second].size = size;
+    return;
+  }
+  by_name_[name] = symbols_.size();
+  symbols_.push_back({name, address, size});
+}
+
+void SymbolTable::RebuildIndex() {
+  std::vector<uint32_t> order(symbols_.size());
+  for (uint32_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  // Sized symbols sort first at a given address so that they win over plain
+  // labels.
+  std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    if (symbols_[a].address != symbols_[b].address)
+      return symbols_[a].address < symbols_[b].address;
+    return symbols_[a].size > symbols_[b].size;
+  });
+
+  index_.clear();
+  index_.reserve(order.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    const Symbol& symbol = symbols_[order[i]];
+    if (!index_.empty() && index_.back().start == symbol.address)
+      continue;
+    cpuaddr_t end;
+    if (symbol.size) {
+      end = symbol.address + symbol.size;
+    } else {
+      // Unsized labels run to the next symbol, but never past their bank.
+      end = (symbol.address & ~(kBankSize - 1)) + kBankSize;
+      for (size_t j = i + 1; j < order.size(); j++) {
+        cpuaddr_t next = symbols_[order[j]].address;
+        if (next != symbol.address) {
+          end = std::min(end, next);
+          break;
+        }
+      }
+    }
+    // Clip the previous interval so that intervals never overlap.
+    if (!index_.empty() && index_.back().end > symbol.address)
+      index_.back().end = symbol.address;
+    index_.push_back({symbol.address, end, order[i]});
+  }
+}
+
+const SymbolTable::Interval* SymbolTable::FindInterval(
+    cpuaddr_t address) const {
+  auto it = std::upper_bound(
+      index_.begin(), index_.end(), address,
+      [](cpuaddr_t addr, const Interval& interval) {
+        return addr < interval.start;
+      });
+  if (it == index_.begin())
+    return nullptr;
+  --it;
+  if (address >= it->end)
+    return nullptr;
+  return &*it;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu.h"
+
+// Maps between guest addresses and symbol names loaded from assembler and
+// linker output. Address lookups go through a sorted interval index, name
+// lookups through a hash map, so both are cheap enough for trace paths.
+class SymbolTable {
+ public:
+  struct Symbol {
+    std::string name;
+    cpuaddr_t address;
+    uint32_t size;  // 0 if unknown; extends to the next symbol in the bank.
+  };
+
+  // Load a symbol file, choosing the format by extension: ld65 .map or .dbg,
+  // otherwise VICE label format.
+  bool LoadFile(const std::string& path);
+  bool LoadLd65Map(const std::string& path);
+  bool LoadLd65Dbg(const std::string& path);
+  bool LoadViceLabels(const std::string& path);
+
+  void Add(const std::string& name, cpuaddr_t address, uint32_t size = 0);
+  // Adds many at once, rebuilding the address index only once.
+  void Add(const std::vector<Symbol>& symbols);
+  void Clear();
+
+  // Returns the symbol whose interval covers 'address', if any.
+  std::optional<Symbol> Find(cpuaddr_t address) const;
+
+  // Returns the address for 'name', if known.
+  std::optional<cpuaddr_t> Lookup(const std::string& name) const;
+
+  // "name" or "name+offset" for 'address', or empty if nothing covers it.
+  std::string Describe(cpuaddr_t address) const;
+
+  size_t size() const;
+
+ private:
+  struct Interval {
+    cpuaddr_t start;
+    cpuaddr_t end;  // exclusive
+    uint32_t symbol;
+  };
+
+  void AddLocked(const std::string& name, cpuaddr_t address, uint32_t size);
+  void RebuildIndex();
+  const Interval* FindInterval(cpuaddr_t address) const;
+
+  mutable std::shared_mutex mutex_;
+  std::vector<Symbol> symbols_;
+  std::unordered_map<std::string, uint32_t> by_name_;
+  std::vector<Interval> index_;
+};
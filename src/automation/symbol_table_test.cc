@@ -0,0 +1,106 @@
+#include "automation/symbol_table.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+TEST(SymbolTableTest, FindCoversIntervals) {
+  SymbolTable symbols;
+  symbols.Add("reset", 0x1000);
+  symbols.Add("table", 0x1010, 4);
+  symbols.Add("irq", 0x1020);
+
+  EXPECT_EQ(symbols.Describe(0x1000), "reset");
+  EXPECT_EQ(symbols.Describe(0x100f), "reset+f");
+  EXPECT_EQ(symbols.Describe(0x1013), "table+3");
+  // Past the end of a sized symbol, with nothing else covering it.
+  EXPECT_EQ(symbols.Describe(0x1014), "");
+  EXPECT_EQ(symbols.Describe(0x0fff), "");
+  // Unsized labels stop at the end of their bank.
+  EXPECT_EQ(symbols.Describe(0x1ffff), "");
+  EXPECT_EQ(symbols.Describe(0xffff), "irq+efdf");
+}
+
+TEST(SymbolTableTest, LookupByName) {
+  SymbolTable symbols;
+  symbols.Add("main", 0x190000);
+  EXPECT_EQ(symbols.Lookup("main"), 0x190000u);
+  EXPECT_FALSE(symbols.Lookup("missing"));
+
+  // Redefinition moves the symbol.
+  symbols.Add("main", 0x190100);
+  EXPECT_EQ(symbols.Lookup("main"), 0x190100u);
+  EXPECT_EQ(symbols.Describe(0x190000), "");
+  EXPECT_EQ(symbols.size(), 1u);
+}
+
+TEST(SymbolTableTest, AddMany) {
+  SymbolTable symbols;
+  symbols.Add({{"start", 0x190000, 0}, {"data", 0x190100, 2}});
+  EXPECT_EQ(symbols.size(), 2u);
+  EXPECT_EQ(symbols.Describe(0x190010), "start+10");
+  EXPECT_EQ(symbols.Describe(0x190101), "data+1");
+  EXPECT_EQ(symbols.Lookup("data"), 0x190100u);
+}
+
+TEST(SymbolTableTest, LoadViceLabels) {
+  std::string path = testing::TempDir() + "symbols.lbl";
+  {
+    std::ofstream out(path);
+    out << "al C:1234 .start\n"
+        << "al 19ABCD .far_label\n"
+        << "break 1234\n";
+  }
+  SymbolTable symbols;
+  ASSERT_TRUE(symbols.LoadFile(path));
+  EXPECT_EQ(symbols.Lookup("start"), 0x1234u);
+  EXPECT_EQ(symbols.Lookup("far_label"), 0x19abcdu);
+  EXPECT_EQ(symbols.size(), 2u);
+  std::remove(path.c_str());
+}
+
+TEST(SymbolTableTest, LoadLd65Dbg) {
+  std::string path = testing::TempDir() + "symbols.dbg";
+  {
+    std::ofstream out(path);
+    out << "version\tmajor=2,minor=0\n"
+        << "sym\tid=0,name=\"putc\",addrsize=absolute,size=12,scope=0,"
+           "def=3,val=0x2000,seg=0,type=lab\n"
+        << "sym\tid=1,name=\"WIDTH\",addrsize=zeropage,scope=0,def=4,"
+           "val=0x50,type=equ\n"
+        << "sym\tid=2,name=\"extern\",addrsize=absolute,scope=0,def=5,"
+           "type=imp,exp=0\n";
+  }
+  SymbolTable symbols;
+  ASSERT_TRUE(symbols.LoadFile(path));
+  EXPECT_EQ(symbols.size(), 1u);
+  EXPECT_EQ(symbols.Describe(0x200b), "putc+b");
+  EXPECT_EQ(symbols.Describe(0x200c), "");
+  std::remove(path.c_str());
+}
+
+TEST(SymbolTableTest, LoadLd65Map) {
+  std::string path = testing::TempDir() + "symbols.map";
+  {
+    std::ofstream out(path);
+    out << "Modules list:\n"
+        << "-------------\n"
+        << "main.o:\n"
+        << "\n"
+        << "Exports list by name:\n"
+        << "---------------------\n"
+        << "main                      002000 RLA    putc                      "
+           "002010 RLA    \n"
+        << "\n"
+        << "Exports list by value:\n"
+        << "----------------------\n"
+        << "main                      002000 RLA    \n";
+  }
+  SymbolTable symbols;
+  ASSERT_TRUE(symbols.LoadFile(path));
+  EXPECT_EQ(symbols.Lookup("main"), 0x2000u);
+  EXPECT_EQ(symbols.Lookup("putc"), 0x2010u);
+  EXPECT_EQ(symbols.size(), 2u);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,88 @@
+#include "bus/byte_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+ByteRing::ByteRing(size_t capacity) {
+  size_t rounded = 1;
+  while (rounded < capacity)
+    rounded <<= 1;
+  data_.resize(rounded);
+  mask_ = rounded - 1;
+}
+
+bool ByteRing::Push(uint8_t v) {
+  if (!available())
+    return false;
+  data_[tail_++ & mask_] = v;
+  return true;
+}
+
+size_t ByteRing::Write(const uint8_t* data, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    size_t chunk = size - written;
+    uint8_t* dest = Reserve(&chunk);
+    if (!chunk)
+      break;
+    memcpy(dest, data + written, chunk);
+    Commit(chunk);
+    written += chunk;
+  }
+  return written;
+}
+
+uint8_t ByteRing::Pop() {
+  return data_[head_++ & mask_];
+}
+
+size_t ByteRing::Read(uint8_t* data, size_t size) {
+  size_t read = 0;
+  while (read < size && !empty()) {
+    size_t chunk;
+    const uint8_t* src = Peek(&chunk);
+    chunk = std::min(chunk, size - read);
+    memcpy(data + read, src, chunk);
+    head_ += chunk;
+    read += chunk;
+  }
+  return read;
+}
+
+size_t ByteRing::Discard(size_t size) {
+  size = std::min(size, this->size());
+  head_ += size;
+  return size;
+}
+
+size_t ByteRing::Transfer(ByteRing* from, size_t size) {
+  size_t moved = 0;
+  size = std::min(size, from->size());
+  while (moved < size) {
+    size_t chunk;
+    const uint8_t* src = from->Peek(&chunk);
+    chunk = Write(src, std::min(chunk, size - moved));
+    if (!chunk)
+      break;
+    from->head_ += chunk;
+    moved += chunk;
+  }
+  return moved;
+}
+
+uint8_t* ByteRing::Reserve(size_t* size) {
+  size_t offset = tail_ & mask_;
+  size_t contiguous = std::min(available(), capacity() - offset);
+  *size = std::min(*size, contiguous);
+  return data_.data() + offset;
+}
+
+void ByteRing::Commit(size_t size) {
+  tail_ += std::min(size, available());
+}
+
+const uint8_t* ByteRing::Peek(size_t* size) const {
+  size_t offset = head_ & mask_;
+  *size = std::min(this->size(), capacity() - offset);
+  return data_.data() + offset;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A fixed-capacity FIFO of bytes. Besides byte-at-a-time access, data can be
+// moved in and out in bulk, and producers can fill it in place (Reserve() then
+// Commit()) rather than going through a buffer of their own.
+class ByteRing {
+ public:
+  // 'capacity' is rounded up to a power of two.
+  explicit ByteRing(size_t capacity);
+
+  size_t size() const { return tail_ - head_; }
+  bool empty() const { return head_ == tail_; }
+  size_t capacity() const { return data_.size(); }
+  size_t available() const { return capacity() - size(); }
+
+  void Clear() { head_ = tail_ = 0; }
+
+  // Returns false, dropping 'v', if the ring is full.
+  bool Push(uint8_t v);
+  // Returns the number of bytes that fit.
+  size_t Write(const uint8_t* data, size_t size);
+  // The ring must not be empty.
+  uint8_t Pop();
+  // Returns the number of bytes read.
+  size_t Read(uint8_t* data, size_t size);
+  // Drops up to 'size' bytes from the front; returns how many were dropped.
+  size_t Discard(size_t size);
+  // Moves up to 'size' bytes from the front of 'from' onto the back of this
+  // ring, limited by what 'from' holds and what fits here.
+  size_t Transfer(ByteRing* from, size_t size);
+
+  // Returns the contiguous free space at the back of the ring, limiting
+  // '*size' to its length. Fill it, then Commit() what was written.
+  uint8_t* Reserve(size_t* size);
+  void Commit(size_t size);
+  // Returns the contiguous data at the front of the ring, setting '*size' to
+  // its length.
+  const uint8_t* Peek(size_t* size) const;
+
+ private:
+  std::vector<uint8_t> data_;
+  size_t mask_;
+  // Free-running positions; only the low bits index 'data_'.
+  size_t head_ = 0;
+  size_t tail_ = 0;
+};
@@ -0,0 +1,51 @@
+#include "bus/byte_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+TEST(ByteRingTest, WrapsAround) {
+  ByteRing ring(6);
+  EXPECT_EQ(ring.capacity(), 8u);
+
+  const uint8_t data[] = {1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(ring.Write(data, 6), 6u);
+  EXPECT_EQ(ring.Pop(), 1);
+  EXPECT_EQ(ring.Discard(3), 3u);
+  // Straddles the end of the storage.
+  EXPECT_EQ(ring.Write(data, 6), 6u);
+  EXPECT_EQ(ring.size(), 8u);
+  EXPECT_FALSE(ring.Push(7));
+
+  std::vector<uint8_t> out(10);
+  EXPECT_EQ(ring.Read(out.data(), out.size()), 8u);
+  EXPECT_EQ(out, std::vector<uint8_t>({5, 6, 1, 2, 3, 4, 5, 6, 0, 0}));
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(ByteRingTest, FillsInPlaceAndTransfers) {
+  ByteRing source(8);
+  ByteRing dest(8);
+  source.Discard(source.Write(std::vector<uint8_t>(5).data(), 5));
+
+  // Only the space up to the end of the storage is contiguous.
+  size_t size = 8;
+  uint8_t* fill = source.Reserve(&size);
+  ASSERT_EQ(size, 3u);
+  fill[0] = 10;
+  fill[1] = 11;
+  fill[2] = 12;
+  source.Commit(3);
+  size = 8;
+  fill = source.Reserve(&size);
+  ASSERT_EQ(size, 5u);
+  fill[0] = 13;
+  source.Commit(1);
+
+  dest.Push(9);
+  EXPECT_EQ(dest.Transfer(&source, 10), 4u);
+  EXPECT_TRUE(source.empty());
+  std::vector<uint8_t> out(5);
+  EXPECT_EQ(dest.Read(out.data(), out.size()), 5u);
+  EXPECT_EQ(out, std::vector<uint8_t>({9, 10, 11, 12, 13}));
+}
@@ -1,30 +1,108 @@
 #include "bus/c256_system_bus.h"
 
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+
 #include "bus/ch376_sd.h"
+#include "bus/fat_image.h"
 #include "bus/i8042_kbd_mouse.h"
+#include "bus/input_journal.h"
 #include "bus/int_controller.h"
 #include "bus/math_copro.h"
 #include "bus/rtc.h"
+#include "bus/sdma.h"
+#include "bus/timer.h"
 #include "bus/vdma.h"
 #include "bus/vicky.h"
+#include "system.h"
+
+DECLARE_double(clock_rate);
+
+DEFINE_string(sd_root, ".", "Host directory to serve as the SD card");
+DEFINE_string(sd_image, "",
+              "FAT16/FAT32 disk image to serve as the SD card, instead of "
+              "-sd_root. It is served read only and never modified");
+
+namespace {
+
+constexpr uint32_t kPageBits = 12;
+constexpr uint32_t kPageSize = 1 << kPageBits;
+constexpr uint32_t kAddressMask = 0xFFFFFF;
+
+// Set while watchpoint handlers or debugger reads are running on this thread,
+// so that they don't trip watchpoints themselves (or touch the input
+// journal).
+thread_local bool suppress_watchpoints = false;
+
+std::unique_ptr<SdBackend> MakeSdBackend() {
+  if (!FLAGS_sd_image.empty()) {
+    auto image = std::make_unique<FatImageBackend>();
+    if (image->Mount(FLAGS_sd_image))
+      return image;
+    LOG(ERROR) << "Falling back to serving the SD card from " << FLAGS_sd_root;
+  }
+  return std::make_unique<HostDirectoryBackend>(FLAGS_sd_root);
+}
+
+}  // namespace
 
-C256SystemBus::C256SystemBus(System* sys) {
+C256SystemBus::C256SystemBus(System* sys) : sys_(sys) {
   math_co_ = std::make_unique<MathCoprocessor>();
-  int_controller_ = std::make_unique<InterruptController>(sys);
-  // TODO: Timers 0x160 - 0x17f
-  // TODO: SDMA: 0x180-0x19f
+  InterruptController::Host int_host{[sys](bool level) {
+    if (level)
+      sys->RaiseIRQ();
+    else
+      sys->ClearIRQ();
+  }};
+  int_controller_ = std::make_unique<InterruptController>(std::move(int_host));
+  for (int i = 0; i < 3; i++) {
+    Timer::Host timer_host{
+        [sys](uint64_t delay_cycles, std::function<void()> event) {
+          sys->ScheduleEvent(delay_cycles, std::move(event));
+        },
+        [this, i]() { int_controller_->SetTimer(i, true); },
+        [sys]() { return sys->cpu()->cpu_state.cycle; }};
+    timers_[i] = std::make_unique<Timer>(std::move(timer_host), i);
+  }
   keyboard_ = std::make_unique<I8042>(int_controller_.get());
   vicky_ = std::make_unique<Vicky>(sys, int_controller_.get());
-  vdma_ = std::make_unique<VDMA>(vicky_->vram(), int_controller_.get());
+  VDMA::Host vdma_host{
+      {[sys](uint64_t delay_cycles, std::function<void()> event) {
+         sys->ScheduleEvent(delay_cycles, std::move(event));
+       },
+       [this]() { int_controller_->SetVDMATransfer(true); }},
+      FLAGS_clock_rate};
+  vdma_ = std::make_unique<VDMA>(std::move(vdma_host), vicky_->vram());
+  SDMA::Host sdma_host{
+      {[sys](uint64_t delay_cycles, std::function<void()> event) {
+         sys->ScheduleEvent(delay_cycles, std::move(event));
+       },
+       [this]() { int_controller_->SetSDMATransfer(true); }},
+      [this](uint32_t addr, uint8_t* data, size_t size) {
+        ReadBlock(addr, data, size);
+      },
+      [this](uint32_t addr, const uint8_t* data, size_t size) {
+        WriteBlock(addr, data, size);
+      }};
+  sdma_ = std::make_unique<SDMA>(std::move(sdma_host));
   rtc_ = std::make_unique<Rtc>();
-  sd_ = std::make_unique<CH376SD>(int_controller_.get(), ".");
+  CH376SD::Host sd_host{
+      [sys](uint64_t delay_us, std::function<void()> event) {
+        sys->ScheduleEvent(delay_us * FLAGS_clock_rate, std::move(event));
+      },
+      [this](bool state) { int_controller_->SetCH376(state); }};
+  sd_ = std::make_unique<CH376SD>(std::move(sd_host), MakeSdBackend());
   InitBus();
 }
 
 C256SystemBus::~C256SystemBus() {}
 
 bool C256SystemBus::IsIoDeviceAddress(void* context, cpuaddr_t addr) {
-  return ((addr & 0xFF0000) == 0xAF0000) || (addr >= 0x100 && addr <= 0x1FF);
+  C256SystemBus* self = (C256SystemBus*)context;
+  return ((addr & 0xFF0000) == 0xAF0000) || (addr >= 0x100 && addr <= 0x1FF) ||
+         self->page_watched_[(addr & kAddressMask) >> kPageBits];
 }
 
 void C256SystemBus::IoRead(void* context,
@@ -32,24 +110,11 @@ void C256SystemBus::IoRead(void* context,
                            uint8_t* data,
                            uint32_t size) {
   C256SystemBus* self = (C256SystemBus*)context;
-  if ((addr & 0xFF0000) == 0xAF0000) {
-    addr &= 0xFFFF;
-    if (addr >= 0xE808 && addr <= 0xE810)
-      *data = self->sd_->ReadByte(addr);
-    else if (addr == 0x1060 || addr == 0x1064)
-      *data = self->keyboard_->ReadByte(addr);
-    else if (addr >= 0x800 && addr <= 0x80F)
-      *data = self->rtc_->ReadByte(addr);
-    else if (addr >= 0x400 && addr <= 0x04ff)
-      *data = self->vdma_->ReadByte(addr);
-    else
-      *data = self->vicky_->ReadByte(addr);
-  } else if (addr >= 0x100 && addr < 0x1A0) {
-    if (addr < 0x130)
-      *data = self->math_co_->ReadByte(addr);
-    else if (addr >= 0x140 && addr <= 0x14F)
-      *data = self->int_controller_->ReadByte(addr);
+  if (self->page_watched_[(addr & kAddressMask) >> kPageBits]) {
+    self->WatchedRead(addr, data);
+    return;
   }
+  self->ReadDevice(addr, data);
 }
 
 void C256SystemBus::IoWrite(void* context,
@@ -57,28 +122,282 @@ void C256SystemBus::IoWrite(void* context,
                             const uint8_t* data,
                             uint32_t size) {
   C256SystemBus* self = (C256SystemBus*)context;
+  if (self->page_watched_[(addr & kAddressMask) >> kPageBits]) {
+    self->WatchedWrite(addr, *data);
+    return;
+  }
+  self->WriteDevice(addr, data);
+}
+
+void C256SystemBus::ReadDevice(cpuaddr_t addr, uint8_t* data) {
+  if ((addr & 0xFF0000) == 0xAF0000) {
+    addr &= 0xFFFF;
+    if (addr >= 0xE808 && addr <= 0xE810) {
+      if (!ReplayHostRead(addr, data)) {
+        *data = sd_->ReadByte(addr);
+        RecordHostRead(addr, *data);
+      }
+    } else if (addr == 0x1060 || addr == 0x1064) {
+      *data = keyboard_->ReadByte(addr);
+    } else if (addr >= 0x800 && addr <= 0x80F) {
+      if (!ReplayHostRead(addr, data)) {
+        *data = rtc_->ReadByte(addr);
+        RecordHostRead(addr, *data);
+      }
+    } else if (addr >= 0x400 && addr <= 0x04ff) {
+      *data = vdma_->ReadByte(addr);
+    } else {
+      *data = vicky_->ReadByte(addr);
+    }
+  } else if (addr >= 0x100 && addr < 0x1A0) {
+    if (addr < 0x130)
+      *data = math_co_->ReadByte(addr);
+    else if (addr >= 0x140 && addr <= 0x14F)
+      *data = int_controller_->ReadByte(addr);
+    else if (addr >= 0x160 && addr < 0x178)
+      *data = timers_[(addr - 0x160) / Timer::kRegisterCount]->ReadByte(
+          (addr - 0x160) % Timer::kRegisterCount);
+    else if (addr >= 0x180)
+      *data = sdma_->ReadByte(addr);
+  }
+}
+
+bool C256SystemBus::ReplayHostRead(cpuaddr_t addr, uint8_t* data) {
+  if (!journal_ || !journal_->replaying() || suppress_watchpoints)
+    return false;
+  // Once the journal runs out the real device takes over.
+  return journal_->ReplayDeviceRead(addr, data);
+}
+
+void C256SystemBus::RecordHostRead(cpuaddr_t addr, uint8_t value) {
+  if (journal_ && journal_->recording() && !suppress_watchpoints)
+    journal_->RecordDeviceRead(addr, value);
+}
+
+void C256SystemBus::WriteDevice(cpuaddr_t addr, const uint8_t* data) {
   if ((addr & 0xFF0000) == 0xAF0000) {
     addr &= 0xFFFF;
     if (addr >= 0xE808 && addr <= 0xE810)
-      self->sd_->StoreByte(addr, *data);
+      sd_->StoreByte(addr, *data);
     else if (addr == 0x1060 || addr == 0x1064)
-      self->keyboard_->StoreByte(addr, *data);
+      keyboard_->StoreByte(addr, *data);
     else if (addr >= 0x800 && addr <= 0x80F)
-      self->rtc_->StoreByte(addr, *data);
+      rtc_->StoreByte(addr, *data);
     else if (addr >= 0x400 && addr <= 0x04ff)
-      self->vdma_->StoreByte(addr, *data);
+      vdma_->StoreByte(addr, *data);
     else
-      self->vicky_->StoreByte(addr, *data);
+      vicky_->StoreByte(addr, *data);
   } else if (addr >= 0x100 && addr < 0x1A0) {
     if (addr < 0x130)
-      self->math_co_->StoreByte(addr, *data);
+      math_co_->StoreByte(addr, *data);
     else if (addr >= 0x140 && addr <= 0x14F)
-      self->int_controller_->StoreByte(addr, *data);
+      int_controller_->StoreByte(addr, *data);
+    else if (addr >= 0x160 && addr < 0x178)
+      timers_[(addr - 0x160) / Timer::kRegisterCount]->StoreByte(
+          (addr - 0x160) % Timer::kRegisterCount, *data);
+    else if (addr >= 0x180)
+      sdma_->StoreByte(addr, *data);
+  }
+}
+
+int C256SystemBus::AddWatchpoint(cpuaddr_t start, uint32_t size,
+                                 uint8_t kinds) {
+  int id;
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    start &= kAddressMask;
+    size = std::min<uint32_t>(size, kAddressMask + 1 - start);
+    id = next_watchpoint_id_++;
+    watchpoints_.push_back({id, start, size, kinds});
+  }
+  sys_->RunOnCpuThread([this]() { UpdateWatchedPages(); });
+  return id;
+}
+
+void C256SystemBus::RemoveWatchpoint(int id) {
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    watchpoints_.erase(
+        std::remove_if(watchpoints_.begin(), watchpoints_.end(),
+                       [id](const Watchpoint& watchpoint) {
+                         return watchpoint.id == id;
+                       }),
+        watchpoints_.end());
+  }
+  sys_->RunOnCpuThread([this]() { UpdateWatchedPages(); });
+}
+
+std::vector<C256SystemBus::Watchpoint> C256SystemBus::watchpoints() {
+  std::lock_guard<std::mutex> lock(watch_mutex_);
+  return watchpoints_;
+}
+
+void C256SystemBus::UpdateWatchedPages() {
+  std::vector<bool> wanted(4096);
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    for (const Watchpoint& watchpoint : watchpoints_) {
+      if (!watchpoint.size)
+        continue;
+      uint32_t last = watchpoint.start + watchpoint.size - 1;
+      for (uint32_t page = watchpoint.start >> kPageBits;
+           page <= last >> kPageBits; page++) {
+        wanted[page] = true;
+      }
+    }
+  }
+
+  for (uint32_t page = 0; page < 4096; page++) {
+    if (wanted[page] == page_watched_[page])
+      continue;
+    Page& entry = pages[page];
+    if (wanted[page]) {
+      watched_pages_[page] = entry;
+      page_watched_[page] = true;
+      // A zero mask sends every access on the page to the I/O path.
+      entry.io_mask = 0;
+      entry.io_eq = 0;
+    } else {
+      const Page& original = watched_pages_[page];
+      entry.io_eq = original.io_eq;
+      entry.io_mask = original.io_mask;
+      page_watched_[page] = false;
+      watched_pages_.erase(page);
+    }
+  }
+}
+
+void C256SystemBus::WatchedRead(cpuaddr_t addr, uint8_t* data) {
+  addr &= kAddressMask;
+  const Page& original = watched_pages_.at(addr >> kPageBits);
+
+  if ((addr & original.io_mask) == original.io_eq)
+    ReadDevice(addr, data);
+  else if (original.ptr)
+    *data = original.ptr[addr & (kPageSize - 1)];
+
+  std::vector<WatchpointHit> hits;
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    MatchWatchpoints(addr, kWatchRead, *data, *data, &hits);
+  }
+  DispatchWatchpointHits(hits);
+}
+
+void C256SystemBus::WatchedWrite(cpuaddr_t addr, uint8_t value) {
+  addr &= kAddressMask;
+  const Page& original = watched_pages_.at(addr >> kPageBits);
+
+  uint8_t access = kWatchWrite;
+  uint8_t old_value = value;
+  if ((addr & original.io_mask) == original.io_eq) {
+    WriteDevice(addr, &value);
+  } else if (original.ptr) {
+    uint8_t* cell = original.ptr + (addr & (kPageSize - 1));
+    old_value = *cell;
+    if (!(original.flags & Page::kReadOnly))
+      *cell = value;
+    if (*cell != old_value)
+      access |= kWatchChange;
+  }
+
+  std::vector<WatchpointHit> hits;
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    MatchWatchpoints(addr, access, old_value, value, &hits);
+  }
+  DispatchWatchpointHits(hits);
+}
+
+void C256SystemBus::MatchWatchpoints(cpuaddr_t addr, uint8_t access,
+                                     uint8_t old_value, uint8_t new_value,
+                                     std::vector<WatchpointHit>* hits) {
+  for (const Watchpoint& watchpoint : watchpoints_) {
+    if (addr - watchpoint.start >= watchpoint.size)
+      continue;
+    uint8_t matched = watchpoint.kinds & access;
+    if (!matched)
+      continue;
+    // Report the most specific kind the watchpoint asked for.
+    WatchKind kind = (matched & kWatchChange)  ? kWatchChange
+                     : (matched & kWatchWrite) ? kWatchWrite
+                                               : kWatchRead;
+    hits->push_back({watchpoint.id, addr, kind, old_value, new_value});
+  }
+}
+
+void C256SystemBus::DispatchWatchpointHits(
+    const std::vector<WatchpointHit>& hits) {
+  if (hits.empty() || !watchpoint_handler_ || suppress_watchpoints)
+    return;
+  suppress_watchpoints = true;
+  for (const WatchpointHit& hit : hits)
+    watchpoint_handler_(hit);
+  suppress_watchpoints = false;
+}
+
+uint8_t C256SystemBus::PeekByte(cpuaddr_t addr) {
+  bool suppressed = suppress_watchpoints;
+  suppress_watchpoints = true;
+  uint8_t value = ReadByte(addr);
+  suppress_watchpoints = suppressed;
+  return value;
+}
+
+void C256SystemBus::PeekBlock(cpuaddr_t addr, uint8_t* data, size_t size) {
+  bool suppressed = suppress_watchpoints;
+  suppress_watchpoints = true;
+  ReadBlock(addr, data, size);
+  suppress_watchpoints = suppressed;
+}
+
+bool C256SystemBus::IsDirectPage(const Page& page, bool write) const {
+  if (!page.ptr || (write && (page.flags & Page::kReadOnly)))
+    return false;
+  // io_mask 0 with a non-zero io_eq can never match, so the page has no I/O.
+  return page.io_mask == 0 && page.io_eq != 0;
+}
+
+void C256SystemBus::WriteBlock(cpuaddr_t addr,
+                               const uint8_t* data,
+                               size_t size) {
+  while (size) {
+    addr &= kAddressMask;
+    uint32_t page_offset = addr & (kPageSize - 1);
+    size_t chunk = std::min<size_t>(size, kPageSize - page_offset);
+    const Page& page = pages[addr >> kPageBits];
+    if (IsDirectPage(page, true)) {
+      memcpy(page.ptr + page_offset, data, chunk);
+    } else {
+      for (size_t i = 0; i < chunk; i++)
+        WriteByte(addr + i, data[i]);
+    }
+    addr += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+void C256SystemBus::ReadBlock(cpuaddr_t addr, uint8_t* data, size_t size) {
+  while (size) {
+    addr &= kAddressMask;
+    uint32_t page_offset = addr & (kPageSize - 1);
+    size_t chunk = std::min<size_t>(size, kPageSize - page_offset);
+    const Page& page = pages[addr >> kPageBits];
+    if (IsDirectPage(page, false)) {
+      memcpy(data, page.ptr + page_offset, chunk);
+    } else {
+      for (size_t i = 0; i < chunk; i++)
+        data[i] = ReadByte(addr + i);
+    }
+    addr += chunk;
+    data += chunk;
+    size -= chunk;
   }
 }
 
 void C256SystemBus::InitBus() {
-  Init(12, 24, pages);
+  Init(kPageBits, 24, pages);
 
   constexpr uint32_t kPagesPer64k = 16;
   // Init memory map
@@ -106,7 +425,7 @@ void C256SystemBus::InitBus() {
   }
 
   // Map the various regions
-  Map(0, ram_, 0x200000);
+  Map(0, ram_, kRamSize);
   Map(0xB00000, vicky_->vram(), 0x400000);
   // Map(sysflash.get(), 0xF00000);
   // Map(userflash.get(), 0xF80000);
@@ -1,14 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "cpu/65816/cpu_65c816.h"
 
 class MathCoprocessor;
 class Vicky;
 class I8042;
+class InputJournal;
 class Rtc;
 class CH376SD;
 class InterruptController;
+class SDMA;
 class System;
+class Timer;
 class VDMA;
 
 class C256SystemBus : public SystemBus {
@@ -19,8 +28,61 @@ class C256SystemBus : public SystemBus {
   InterruptController* int_controller() const { return int_controller_.get(); }
   Vicky* vicky() const { return vicky_.get(); }
   VDMA* vdma() const { return vdma_.get(); }
+  SDMA* sdma() const { return sdma_.get(); }
+  Timer* timer(int index) const { return timers_[index].get(); }
   I8042* keyboard() const { return keyboard_.get(); }
 
+  // Bulk copy to/from the bus. Plain memory pages are copied directly through
+  // the page table; pages with I/O mapped on them fall back to per-byte access.
+  void WriteBlock(cpuaddr_t addr, const uint8_t* data, size_t size);
+  void ReadBlock(cpuaddr_t addr, uint8_t* data, size_t size);
+
+  // Memory watchpoints. Pages overlapping a watched range are switched to
+  // the I/O path, so only accesses to those pages pay for the range check.
+  // The page table is only changed on the CPU thread, so from other threads
+  // a watchpoint takes effect from the next scanline.
+  enum WatchKind : uint8_t {
+    kWatchRead = 1 << 0,
+    kWatchWrite = 1 << 1,
+    // A write that changes the stored value. Only applies to memory, not
+    // device registers.
+    kWatchChange = 1 << 2,
+  };
+  struct Watchpoint {
+    int id;
+    cpuaddr_t start;
+    uint32_t size;
+    uint8_t kinds;
+  };
+  struct WatchpointHit {
+    int id;
+    cpuaddr_t addr;
+    WatchKind kind;
+    uint8_t old_value;
+    uint8_t new_value;
+  };
+  // Called on the CPU thread, after the access has completed.
+  using WatchpointHandler = std::function<void(const WatchpointHit&)>;
+
+  int AddWatchpoint(cpuaddr_t start, uint32_t size, uint8_t kinds);
+  void RemoveWatchpoint(int id);
+  std::vector<Watchpoint> watchpoints();
+
+  // Reads on behalf of the debugger, which never trigger watchpoints.
+  uint8_t PeekByte(cpuaddr_t addr);
+  void PeekBlock(cpuaddr_t addr, uint8_t* data, size_t size);
+
+  // System RAM, mapped at 00:0000.
+  static constexpr uint32_t kRamSize = 0x200000;
+  uint8_t* ram() { return ram_; }
+  void set_watchpoint_handler(WatchpointHandler handler) {
+    watchpoint_handler_ = std::move(handler);
+  }
+
+  // Guest reads of devices backed by the host (the RTC and the SD card) are
+  // recorded to, or replayed from, 'journal'.
+  void set_input_journal(InputJournal* journal) { journal_ = journal; }
+
  private:
   void InitBus();
   static bool IsIoDeviceAddress(void* context, cpuaddr_t addr);
@@ -33,13 +95,40 @@ class C256SystemBus : public SystemBus {
                       const uint8_t* data,
                       uint32_t size);
 
+  bool IsDirectPage(const Page& page, bool write) const;
+
+  void ReadDevice(cpuaddr_t addr, uint8_t* data);
+  void WriteDevice(cpuaddr_t addr, const uint8_t* data);
+  bool ReplayHostRead(cpuaddr_t addr, uint8_t* data);
+  void RecordHostRead(cpuaddr_t addr, uint8_t value);
+  void WatchedRead(cpuaddr_t addr, uint8_t* data);
+  void WatchedWrite(cpuaddr_t addr, uint8_t value);
+  void MatchWatchpoints(cpuaddr_t addr, uint8_t access, uint8_t old_value,
+                        uint8_t new_value, std::vector<WatchpointHit>* hits);
+  void DispatchWatchpointHits(const std::vector<WatchpointHit>& hits);
+  void UpdateWatchedPages();
+
+  System* sys_;
   std::unique_ptr<MathCoprocessor> math_co_;
   std::unique_ptr<InterruptController> int_controller_;
   std::unique_ptr<Vicky> vicky_;
   std::unique_ptr<VDMA> vdma_;
+  std::unique_ptr<SDMA> sdma_;
+  std::unique_ptr<Timer> timers_[3];
   std::unique_ptr<I8042> keyboard_;
   std::unique_ptr<Rtc> rtc_;
   std::unique_ptr<CH376SD> sd_;
   Page pages[4096];
   uint8_t ram_[0x400000];
+
+  // Guards watchpoints_ and next_watchpoint_id_.
+  std::mutex watch_mutex_;
+  int next_watchpoint_id_ = 1;
+  std::vector<Watchpoint> watchpoints_;
+  // The page table entries that watched pages replaced, by page number.
+  // Like the page table, only used on the CPU thread.
+  std::unordered_map<uint32_t, Page> watched_pages_;
+  bool page_watched_[4096] = {};
+  WatchpointHandler watchpoint_handler_;
+  InputJournal* journal_ = nullptr;
 };
@@ -1,10 +1,19 @@
 #include "bus/ch376_sd.h"
 
+#include <gflags/gflags.h>
+
 #include <cstring>
-#include <fstream>
 
-#include "bus/int_controller.h"
-#include "ch376_sd.h"
+
+DEFINE_int32(sd_latency_us, 100,
+             "Emulated time a CH376 command that touches the SD card takes "
+             "before raising its interrupt");
+DEFINE_bool(sd_wait_for_host, false,
+            "Complete SD card commands exactly -sd_latency_us after they're "
+            "issued, stalling emulation if the host is slower. Otherwise a "
+            "command the host hasn't finished completes later, which keeps "
+            "emulation running but depends on host timing");
+DECLARE_int32(sd_flush_interval_ms);
 
 namespace {
 constexpr uint32_t SDCARD_DATA =
@@ -72,109 +81,216 @@ enum InterruptState {
   USB_INT_DISK_ERR = 0x1f,
 };
 
-void Push32(uint32_t v, std::deque<uint8_t>* out) {
+constexpr size_t kChunkSize = 255;
+
+void Push32(uint32_t v, ByteRing* out) {
   uint8_t highest_byte = v >> 24;
   uint8_t next_byte = (v & 0x00ff0000) >> 16;
   uint8_t nextest_byte = (v & 0x0000ff00) >> 8;
   uint8_t lowest_byte = (v & 0x000000ff);
-  out->push_back(highest_byte);
-  out->push_back(next_byte);
-  out->push_back(nextest_byte);
-  out->push_back(lowest_byte);
+  out->Push(highest_byte);
+  out->Push(next_byte);
+  out->Push(nextest_byte);
+  out->Push(lowest_byte);
 }
 }  // namespace
 
 CH376SD::CH376_FileInfo::~CH376_FileInfo() {}
 
-CH376SD::~CH376SD() {}
+CH376SD::CH376SD(Host host, std::unique_ptr<SdBackend> backend)
+    : host_(std::move(host)), backend_(std::move(backend)) {
+  io_thread_ = std::thread(&CH376SD::IoThread, this);
+}
+
+CH376SD::~CH376SD() {
+  {
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    io_exit_ = true;
+  }
+  io_cv_.notify_all();
+  io_thread_.join();
+}
+
+void CH376SD::IoThread() {
+  std::unique_lock<std::mutex> lock(io_mutex_);
+  while (true) {
+    io_cv_.wait(lock, [this] { return !io_queue_.empty() || io_exit_; });
+    // Finish what was queued even when exiting, so writes aren't lost.
+    if (io_queue_.empty())
+      return;
+    std::function<void()> work = std::move(io_queue_.front());
+    io_queue_.pop_front();
+    lock.unlock();
+    work();
+    lock.lock();
+    io_busy_ = !io_queue_.empty();
+    io_cv_.notify_all();
+  }
+}
+
+void CH376SD::QueueIo(std::function<void()> work) {
+  {
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    io_queue_.push_back(std::move(work));
+    io_busy_ = true;
+  }
+  io_cv_.notify_all();
+}
+
+void CH376SD::RunIo(std::function<void(IoResult*)> work) {
+  auto result = std::make_shared<IoResult>();
+  QueueIo([this, work, result]() {
+    work(result.get());
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    result->done = true;
+  });
+  host_.schedule(FLAGS_sd_latency_us,
+                 [this, result]() { CompleteIo(result); });
+}
+
+void CH376SD::CompleteIo(std::shared_ptr<IoResult> result) {
+  {
+    std::unique_lock<std::mutex> lock(io_mutex_);
+    if (!result->done && !FLAGS_sd_wait_for_host) {
+      // The host is slower than modelled. Look again later, rather than
+      // stall the emulation; the guest sees a slower card meanwhile.
+      lock.unlock();
+      host_.schedule(FLAGS_sd_latency_us,
+                     [this, result]() { CompleteIo(result); });
+      return;
+    }
+    // With -sd_wait_for_host the completion time depends only on emulated
+    // time, so runs stay deterministic however long the host takes.
+    io_cv_.wait(lock, [&result] { return result->done; });
+  }
+  int_status_ = result->status;
+  if (result->interrupt)
+    host_.set_interrupt(true);
+}
+
+void CH376SD::ScheduleFlush() {
+  if (flush_scheduled_)
+    return;
+  flush_scheduled_ = true;
+  host_.schedule(uint64_t(FLAGS_sd_flush_interval_ms) * 1000, [this]() {
+    flush_scheduled_ = false;
+    QueueIo([this]() {
+      if (current_file_.file)
+        current_file_.file->Flush();
+    });
+  });
+}
+
+void CH376SD::WaitForIo() {
+  std::unique_lock<std::mutex> lock(io_mutex_);
+  io_cv_.wait(lock, [this] { return !io_busy_; });
+}
 
 void CH376SD::StoreByte(uint32_t addr, uint8_t v) {
+  // These only use state kept on the CPU thread, so they answer at once
+  // even while the host is busy; until a command completes, its status
+  // reads as 0.
   if (addr == SDCARD_CMD) {
-    current_cmd_ = 0;
     switch (v) {
       case CHECK_EXIST:
-        out_data_.push_back(CMD_RET_SUCCESS);
-        return;
-      case SET_USB_MODE:
-        current_cmd_ = v;
+        current_cmd_ = 0;
+        out_data_.Push(CMD_RET_SUCCESS);
         return;
       case GET_STATUS:
-        int_controller_->SetCH376(false);
-        out_data_.push_back(int_status_);
+        current_cmd_ = 0;
+        host_.set_interrupt(false);
+        out_data_.Push(int_status_);
         int_status_ = 0;
         return;
+    }
+  }
+
+  // Everything else may touch the file state, which belongs to the I/O
+  // thread while it has work.
+  WaitForIo();
+  if (addr == SDCARD_CMD) {
+    current_cmd_ = 0;
+    switch (v) {
+      case SET_USB_MODE:
+        current_cmd_ = v;
+        return;
       case DISK_MOUNT:
         mounted_ = true;
         int_status_ = USB_INT_SUCCESS;
-        int_controller_->SetCH376(true);
+        host_.set_interrupt(true);
         return;
       case SET_FILE_NAME:
         current_file_.Clear();
-        current_file_.path = root_directory_.string();
+        readahead_.Clear();
+        current_file_.path.clear();
         current_cmd_ = SET_FILE_NAME;
         return;
-      case FILE_OPEN: {
-        if (!fs::exists(current_file_.entry)) {
-          int_status_ = 0x42;  // ERR_MISS_FILE
-          current_file_.open = false;
-        } else if (fs::is_directory(current_file_.entry)) {
-          int_status_ = 0x1d;  // docs say ERR_OPEN_DIR but kernel expects
-          // USB_INT_DISK_READ
-          current_file_.directory_iterator =
-              fs::directory_iterator(current_file_.entry);
-          auto end = fs::directory_iterator();
-          if (current_file_.directory_iterator == end) {
-            int_status_ = 0x42;  // ERR_MISS_FILE
+      case FILE_OPEN:
+        RunIo([this](IoResult* result) {
+          const std::string& name = current_file_.name;
+          if (backend_->IsDirectory(name)) {
+            result->status = 0x1d;  // docs say ERR_OPEN_DIR but kernel expects
+            // USB_INT_DISK_READ
+            current_file_.is_directory = true;
+            current_file_.listing_index = 0;
+            current_file_.listing = ListDirectory(name);
+            if (!current_file_.listing || !current_file_.listing->size()) {
+              result->status = 0x42;  // ERR_MISS_FILE
+              current_file_.open = false;
+            } else
+              current_file_.open = true;
+          } else if (!(current_file_.file = backend_->Open(name))) {
+            result->status = 0x42;  // ERR_MISS_FILE
             current_file_.open = false;
-          } else
+          } else {
             current_file_.open = true;
-        } else {
-          current_file_.open = true;
-          current_file_.f =
-              fopen(current_file_.entry.path().string().c_str(), "r");
-          if (!current_file_.f) {
-            int_status_ = 0x42;  // ERR_MISS_FILE
-            current_file_.open = false;
+            current_file_.position = 0;
+            readahead_.Clear();
+            FillReadahead();
+            result->interrupt = false;
             return;
           }
-          int_status_ = USB_INT_SUCCESS;
-          return;
-        }
-        current_file_.byte_seek_request.reset();
-        int_controller_->SetCH376(true);
+          current_file_.byte_seek_request.reset();
+        });
+        return;
+      case FILE_CREATE:
+        RunIo([this](IoResult* result) {
+          readahead_.Clear();
+          // Cached listings may not notice the new file (or its size) in
+          // time, so start again.
+          directories_.clear();
+          current_file_.file = backend_->Create(current_file_.name);
+          current_file_.open = current_file_.file != nullptr;
+          current_file_.position = 0;
+          result->status =
+              current_file_.open ? USB_INT_SUCCESS : USB_INT_DISK_ERR;
+        });
         return;
-      }
       case FILE_CLOSE: {
+        // Dropping the file writes back anything still buffered.
         current_file_.open = false;
         current_cmd_ = FILE_CLOSE;
-        if (fs::is_regular_file(current_file_.entry)) {
-          CHECK(fclose(current_file_.f) == 0);
-        }
+        readahead_.Clear();
+        QueueIo([this]() { current_file_.file.reset(); });
         return;
       }
-      case FILE_ENUM_GO: {
-      repeat:
-        auto end = fs::directory_iterator();
-
-        if (current_file_.directory_iterator != end) {
-          auto path = current_file_.directory_iterator->path();
-          if (path.string()[0] == '.') {
-            current_file_.directory_iterator++;
-            goto repeat;
-          }
-        }
+      case FILE_ENUM_GO:
         int_status_ =
-            current_file_.directory_iterator == end ? 0x42 : USB_INT_DISK_READ;
-        int_controller_->SetCH376(true);
-      } break;
+            !current_file_.listing ||
+                    current_file_.listing_index >=
+                        current_file_.listing->size()
+                ? 0x42
+                : USB_INT_DISK_READ;
+        host_.set_interrupt(true);
+        break;
       case RD_USB_DATA0:
         if (current_file_.open) {
-          if (current_file_.enumerate_mode_ &&
-              fs::is_directory(current_file_.entry) &&
-              current_file_.directory_iterator != fs::directory_iterator()) {
+          if (current_file_.enumerate_mode_ && current_file_.is_directory &&
+              current_file_.listing &&
+              current_file_.listing_index < current_file_.listing->size()) {
             PushDirectoryListing();
             return;
-          } else {
+          } else if (current_file_.file) {
             StreamFileContents();
             return;
           }
@@ -188,18 +304,48 @@ void CH376SD::StoreByte(uint32_t addr, uint8_t v) {
         current_file_.byte_read_request = std::make_unique<LongBuffer>(2);
         break;
       case BYTE_RD_GO:
-        if (ftell(current_file_.f) < current_file_.statbuf.st_size) {
-          int_status_ = USB_INT_DISK_READ;
-        } else {
-          int_status_ = USB_INT_SUCCESS;  // done reading
-        }
-        int_controller_->SetCH376(true);
+        RunIo([this](IoResult* result) {
+          if (current_file_.file &&
+              current_file_.position < current_file_.file->size()) {
+            FillReadahead();
+            result->status = USB_INT_DISK_READ;
+          } else {
+            result->status = USB_INT_SUCCESS;  // done reading
+          }
+        });
         break;
       case BYTE_LOCATE:
         // Seek.
         current_cmd_ = BYTE_LOCATE;
         current_file_.byte_seek_request = std::make_unique<LongBuffer>(4);
         break;
+      case BYTE_WRITE:
+        current_cmd_ = BYTE_WRITE;
+        current_file_.byte_write_request = std::make_unique<LongBuffer>(2);
+        current_file_.write_error = false;
+        break;
+      case WR_REQ_DATA: {
+        // Say how much of the BYTE_WRITE we'll take next; the guest then
+        // sends that many bytes.
+        size_t chunk =
+            std::min<size_t>(current_file_.write_remaining, kChunkSize);
+        out_data_.Push(chunk);
+        current_file_.write_chunk.clear();
+        current_file_.write_chunk_size = chunk;
+        if (chunk)
+          current_cmd_ = WR_REQ_DATA;
+        break;
+      }
+      case BYTE_WR_GO:
+        RunIo([this](IoResult* result) {
+          if (current_file_.write_error)
+            result->status = USB_INT_DISK_ERR;
+          else if (current_file_.write_remaining)
+            result->status = USB_INT_DISK_WRITE;
+          else
+            result->status = USB_INT_SUCCESS;  // done writing
+        });
+        break;
       default:
         LOG(ERROR) << "UNHANDLED CH376 COMMAND: " << std::hex << (int)v;
         break;
@@ -210,13 +356,12 @@ void CH376SD::StoreByte(uint32_t addr, uint8_t v) {
     switch (current_cmd_) {
       case SET_USB_MODE:
         CHECK_EQ(v, 0x03) << "SET_USB_MODE for invalid mode (" << v << ")";
-        out_data_.push_back(CMD_RET_SUCCESS);
-        out_data_.push_back(0);  // byte 2;
+        out_data_.Push(CMD_RET_SUCCESS);
+        out_data_.Push(0);  // byte 2;
         return;
       case SET_FILE_NAME:
         if (v == 0) {
-          current_file_.entry =
-              fs::directory_entry(fs::path(current_file_.path));
+          current_file_.name = current_file_.path;
           current_file_.path.clear();
           current_cmd_ = 0;
           return;
@@ -228,23 +373,27 @@ void CH376SD::StoreByte(uint32_t addr, uint8_t v) {
         current_file_.path.push_back(v);
         break;
       case FILE_CLOSE:
-        // v? "Update or not" ?
-        int_status_ = USB_INT_SUCCESS;
-        int_controller_->SetCH376(true);
+        // v? "Update or not" ? The file was already dropped by the command;
+        // this only reports that it's done.
+        RunIo([](IoResult* result) {});
         break;
       case GET_FILE_SIZE:
-        Push32(current_file_.statbuf.st_size, &out_data_);
+        Push32(current_file_.file ? current_file_.file->size() : 0,
+               &out_data_);
         break;
       case BYTE_READ:
         current_file_.byte_read_request->Write(v);
         if (current_file_.byte_read_request->HasValue()) {
           uint32_t bytes = current_file_.byte_read_request->value();
-          if (ftell(current_file_.f) + bytes > current_file_.statbuf.st_size) {
-            int_status_ = USB_INT_SUCCESS;  // done reading
-          } else {
-            int_status_ = USB_INT_DISK_READ;
-          }
-          int_controller_->SetCH376(true);
+          RunIo([this, bytes](IoResult* result) {
+            if (!current_file_.file ||
+                current_file_.position + bytes > current_file_.file->size()) {
+              result->status = USB_INT_SUCCESS;  // done reading
+            } else {
+              FillReadahead();
+              result->status = USB_INT_DISK_READ;
+            }
+          });
         }
         break;
       case BYTE_LOCATE:
@@ -252,14 +401,45 @@ void CH376SD::StoreByte(uint32_t addr, uint8_t v) {
         if (current_file_.byte_seek_request->HasValue()) {
           uint32_t seek_val = current_file_.byte_seek_request->value();
           // Seek end of file?
-          if (seek_val == 0xffffffff ||
-              seek_val >= current_file_.statbuf.st_size) {
-            seek_val = current_file_.statbuf.st_size;
+          uint32_t size = current_file_.file ? current_file_.file->size() : 0;
+          if (seek_val == 0xffffffff || seek_val >= size) {
+            seek_val = size;
           }
-          fseek(current_file_.f, seek_val, SEEK_SET);
+          // Keep what was read ahead if the seek lands inside it.
+          if (seek_val >= current_file_.position &&
+              seek_val - current_file_.position <= readahead_.size()) {
+            readahead_.Discard(seek_val - current_file_.position);
+          } else {
+            readahead_.Clear();
+          }
+          current_file_.position = seek_val;
           int_status_ = USB_INT_SUCCESS;
-          int_controller_->SetCH376(true);
+          host_.set_interrupt(true);
         }
+        break;
+      case BYTE_WRITE:
+        current_file_.byte_write_request->Write(v);
+        if (current_file_.byte_write_request->HasValue()) {
+          uint32_t bytes = current_file_.byte_write_request->value();
+          if (!current_file_.file) {
+            current_file_.write_remaining = 0;
+            int_status_ = USB_INT_DISK_ERR;
+          } else {
+            current_file_.write_remaining = bytes;
+            int_status_ = bytes ? USB_INT_DISK_WRITE : USB_INT_SUCCESS;
+          }
+          host_.set_interrupt(true);
+        }
+        break;
+      case WR_REQ_DATA:
+        current_file_.write_chunk.push_back(v);
+        if (current_file_.write_chunk.size() ==
+            current_file_.write_chunk_size) {
+          QueueIo([this]() { WriteChunk(); });
+          current_cmd_ = 0;
+          ScheduleFlush();
+        }
+        break;
     }
   }
 }
@@ -267,9 +447,7 @@ void CH376SD::StoreByte(uint32_t addr, uint8_t v) {
 uint8_t CH376SD::ReadByte(uint32_t addr) {
   if (addr == SDCARD_DATA) {
     CHECK(!out_data_.empty());
-    uint8_t data = out_data_.front();
-    out_data_.pop_front();
-    return data;
+    return out_data_.Pop();
   }
   if (addr == SDCARD_CMD) {
     return int_status_;
@@ -277,58 +455,54 @@ uint8_t CH376SD::ReadByte(uint32_t addr) {
   return 0;
 }
 
-void CH376SD::PushDirectoryListing() {
-  auto entry = current_file_.entry;
+std::shared_ptr<const CH376SD::DirectoryListing> CH376SD::ListDirectory(
+    const std::string& path) {
+  uint64_t version = 0;
+  bool versioned = backend_->DirectoryVersion(path, &version);
+  auto found = directories_.find(path);
+  if (versioned && found != directories_.end() &&
+      found->second->version == version) {
+    return found->second;
+  }
 
-  // Expect 32 bytes.
-  out_data_.push_back(0x20);
-
-  // 8.3 filename, only support the first 11 characters, first dot
-  // breaks to extension.
-  size_t c_num = 0;
-  auto working_file = *current_file_.directory_iterator;
-  auto name = working_file.path().filename().string();
-  size_t d_namelen = name.size();
-  for (int i = 0; i < 8; i++) {
-    char c = name[c_num++];
-    if (c == '.' || c_num > d_namelen) {
-      while (i++ < 8)
-        out_data_.push_back(0);
-      continue;
-    }
-    out_data_.push_back(c);
+  std::vector<SdDirectoryEntry> entries;
+  if (!backend_->ListDirectory(path, &entries)) {
+    directories_.erase(path);
+    return nullptr;
   }
-  for (int i = 0; i < 3; i++) {
-    char c = name[c_num++];
-    if (c == 0 || c_num > d_namelen) {
-      while (i++ < 3)
-        out_data_.push_back(0);
-    } else
-      out_data_.push_back(c);
+  auto listing = std::make_shared<DirectoryListing>();
+  listing->version = version;
+  listing->records.resize(entries.size() * DirectoryListing::kRecordSize);
+  uint8_t* record = listing->records.data();
+  for (const SdDirectoryEntry& entry : entries) {
+    // 8.3 filename, padded out to 11 characters.
+    memcpy(record, entry.name, 11);
+    record[11] = entry.directory ? 0x10 : 0;
+    // 10 bytes reserved, then create/modify times/dates (TODO) and the
+    // cluster number (not supported), all left zero.
+    // File size in bytes, 32 bits.
+    record[28] = entry.size >> 24;
+    record[29] = entry.size >> 16;
+    record[30] = entry.size >> 8;
+    record[31] = entry.size;
+    record += DirectoryListing::kRecordSize;
   }
+  if (versioned)
+    directories_[path] = listing;
+  return listing;
+}
 
-  if (fs::is_directory(entry))
-    out_data_.push_back(0x10);
-  else
-    out_data_.push_back(0);
-  // 10 bytes reserved.
-  for (int i = 0; i < 10; i++)
-    out_data_.push_back(0);
-  // TODO create/modify times/dates
-  for (int i = 0; i < 4; i++)
-    out_data_.push_back(0);
-  // Cluster number not supported
-  for (int i = 0; i < 2; i++)
-    out_data_.push_back(0);
-  // File size in bytes, 32 bits.
-  size_t flen = fs::is_directory(working_file.path())
-                    ? 0
-                    : fs::file_size(working_file.path());
-  Push32(flen, &out_data_);
+void CH376SD::PushDirectoryListing() {
+  const std::vector<uint8_t>& records = current_file_.listing->records;
+  size_t offset =
+      current_file_.listing_index++ * DirectoryListing::kRecordSize;
+
+  // Expect 32 bytes.
+  out_data_.Push(DirectoryListing::kRecordSize);
+  out_data_.Write(records.data() + offset, DirectoryListing::kRecordSize);
 
   // No more data after this.
-  out_data_.push_back(0);
-  current_file_.directory_iterator++;
+  out_data_.Push(0);
 }
 
 void CH376SD::StreamFileContents() {
@@ -338,24 +512,69 @@ void CH376SD::StreamFileContents() {
   // more, since they're only reading 255 bytes right now at a time anyways
   // despite asking for 64k.
   uint32_t amount_to_retrieve =
-      std::min<uint32_t>(current_file_.byte_read_request->value(), 255);
+      std::min<uint32_t>(current_file_.byte_read_request->value(), kChunkSize);
 
+  bool eof;
   do {
-    // We do blocks of no more than 255 bytes;
-    char byte_buffer[255];
-    size_t read_bytes = fread(byte_buffer, 1, 255, current_file_.f);
-    out_data_.push_back(read_bytes);
+    // We do blocks of no more than 255 bytes, straight out of the readahead.
+    FillReadahead();
+    size_t read_bytes = std::min(readahead_.size(), kChunkSize);
+    eof = read_bytes < kChunkSize;
+    // The length byte, the data and any closing 0 go out together or not at
+    // all, or the guest would lose its place in the stream. If the guest
+    // hasn't read enough of what was sent, it gets this chunk next time.
+    size_t needed = read_bytes ? 1 + read_bytes + eof : 1;
+    if (out_data_.available() < needed)
+      return;
+    out_data_.Push(read_bytes);
     if (!read_bytes) {
       return;
     }
 
-    std::copy(byte_buffer, byte_buffer + read_bytes,
-              std::back_inserter(out_data_));
-    total_read += read_bytes;
-  } while (!feof(current_file_.f) && total_read < amount_to_retrieve);
+    size_t sent = out_data_.Transfer(&readahead_, read_bytes);
+    current_file_.position += sent;
+    total_read += sent;
+  } while (!eof && total_read < amount_to_retrieve);
   // If done, put 0.
-  if (feof(current_file_.f))
-    out_data_.push_back(0);
+  if (eof)
+    out_data_.Push(0);
+}
+
+void CH376SD::FillReadahead() {
+  if (readahead_.size() >= kChunkSize)
+    return;
+  SdFile* file = current_file_.file.get();
+  uint32_t end = current_file_.position + readahead_.size();
+  // Read directly into the ring; this takes two reads when it wraps.
+  while (end < file->size()) {
+    size_t wanted = file->size() - end;
+    uint8_t* dest = readahead_.Reserve(&wanted);
+    if (!wanted)
+      break;
+    size_t read = file->Read(end, dest, wanted);
+    readahead_.Commit(read);
+    end += read;
+    if (read < wanted)
+      break;
+  }
+}
+
+void CH376SD::WriteChunk() {
+  const std::vector<uint8_t>& chunk = current_file_.write_chunk;
+  size_t written = current_file_.file
+                       ? current_file_.file->Write(current_file_.position,
+                                                   chunk.data(), chunk.size())
+                       : 0;
+  if (written < chunk.size()) {
+    LOG(ERROR) << "SD card write failed (read-only card or file?)";
+    current_file_.write_error = true;
+  }
+  // What was read ahead, and the file's size in any cached listing, may now
+  // be stale.
+  readahead_.Clear();
+  directories_.clear();
+  current_file_.position += written;
+  current_file_.write_remaining -= chunk.size();
 }
 
 void LongBuffer::Write(uint8_t v) {
@@ -379,9 +598,16 @@ uint32_t LongBuffer::value() const {
 void CH376SD::CH376_FileInfo::Clear() {
   open = false;
   enumerate_mode_ = false;
-  directory_iterator = fs::directory_iterator();
-  statbuf = {};
-  f = nullptr;
+  is_directory = false;
+  listing.reset();
+  listing_index = 0;
+  file.reset();
+  position = 0;
   byte_read_request.reset();
   byte_seek_request.reset();
+  byte_write_request.reset();
+  write_remaining = 0;
+  write_chunk_size = 0;
+  write_chunk.clear();
+  write_error = false;
 }
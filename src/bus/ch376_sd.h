@@ -3,16 +3,19 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 
-#include <cstdio>
+#include <condition_variable>
 #include <cstdlib>
 #include <deque>
-#include <experimental/filesystem>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
-namespace fs = std::experimental::filesystem;
-
-class InterruptController;
+#include "bus/byte_ring.h"
+#include "bus/sd_backend.h"
 
 struct LongBuffer {
   explicit LongBuffer(size_t num_bytes_needed)
@@ -25,13 +28,28 @@ struct LongBuffer {
   const size_t num_bytes_needed_;
 };
 
-// Emulate the CH376 SD/USB storage controller.
+// Emulate the CH376 SD/USB storage controller, serving files from an
+// SdBackend (a host directory or a FAT disk image).
+//
+// Commands that touch the backend run on an I/O thread, and complete (set
+// the status and raise the interrupt) -sd_latency_us of emulated time later,
+// or when the host finishes if that's later still (see -sd_wait_for_host).
+// GET_STATUS and CHECK_EXIST answer straight away; anything that needs the
+// file state again waits for outstanding I/O first.
 // Incomplete.
 class CH376SD {
  public:
-  CH376SD(InterruptController* int_controller,
-          const std::string& root_directory)
-      : int_controller_(int_controller), root_directory_(root_directory) {}
+  // How the controller reaches the rest of the machine.
+  struct Host {
+    // Runs 'event' on the CPU thread 'delay_us' of emulated time from now.
+    // Only called on the CPU thread.
+    std::function<void(uint64_t delay_us, std::function<void()> event)>
+        schedule;
+    // Raises or clears the CH376 interrupt.
+    std::function<void(bool)> set_interrupt;
+  };
+
+  CH376SD(Host host, std::unique_ptr<SdBackend> backend);
 
   ~CH376SD();
 
@@ -40,30 +58,89 @@ class CH376SD {
   uint8_t ReadByte(uint32_t addr);
 
  private:
+  // A directory as the guest sees it: one prepared 32 byte record per entry,
+  // ready to be sent as is.
+  struct DirectoryListing {
+    static constexpr size_t kRecordSize = 32;
+    uint64_t version;
+    std::vector<uint8_t> records;
+    size_t size() const { return records.size() / kRecordSize; }
+  };
+
+  // Returns the listing of 'path', from the cache if the backend says the
+  // directory hasn't changed since it was built. Null if it isn't a
+  // directory.
+  std::shared_ptr<const DirectoryListing> ListDirectory(
+      const std::string& path);
   void PushDirectoryListing();
   void StreamFileContents();
-
-  InterruptController* int_controller_;
+  // Tops up 'readahead_' from the open file.
+  void FillReadahead();
+  // Writes out the chunk collected after a WR_REQ_DATA.
+  void WriteChunk();
+  // Has the open file written back -sd_flush_interval_ms from now, unless
+  // that is already arranged.
+  void ScheduleFlush();
+
+  struct IoResult {
+    uint8_t status = 0x14;  // USB_INT_SUCCESS
+    bool interrupt = true;
+    bool done = false;  // Guarded by io_mutex_.
+  };
+  // Runs 'work' on the I/O thread, and reports its result to the guest after
+  // the modelled latency, or once the work is done if that takes longer.
+  void RunIo(std::function<void(IoResult*)> work);
+  // Reports 'result' to the guest, if it's ready; on the CPU thread.
+  void CompleteIo(std::shared_ptr<IoResult> result);
+  // Runs 'work' on the I/O thread without reporting anything.
+  void QueueIo(std::function<void()> work);
+  // Blocks until the I/O thread has nothing left to do.
+  void WaitForIo();
+  void IoThread();
+
+  Host host_;
+
+  std::thread io_thread_;
+  std::mutex io_mutex_;
+  std::condition_variable io_cv_;
+  std::deque<std::function<void()>> io_queue_;
+  bool io_busy_ = false;  // Queued or running work; guarded by io_mutex_.
+  bool io_exit_ = false;
+  bool flush_scheduled_ = false;  // CPU thread only.
 
   uint8_t current_cmd_ = 0;  // If command takes parameter.
-  std::deque<uint8_t> out_data_;
+  ByteRing out_data_{4096};
+  // File contents from the current position onwards, read from the backend
+  // in large blocks and handed out in the 255 byte chunks the guest asks for.
+  ByteRing readahead_{64 * 1024};
 
-  uint8_t int_status_;
+  uint8_t int_status_ = 0;
 
   bool mounted_ = false;
-  fs::path root_directory_;
+  std::unique_ptr<SdBackend> backend_;
+  // Only used from the I/O thread.
+  std::unordered_map<std::string, std::shared_ptr<const DirectoryListing>>
+      directories_;
 
   struct CH376_FileInfo {
     ~CH376_FileInfo();
     bool open = false;
-    std::string path;
-    fs::directory_entry entry;
+    std::string path;  // As sent by the guest, while it is being sent.
+    std::string name;  // The complete name given to the last SET_FILE_NAME.
     bool enumerate_mode_ = false;
-    fs::directory_iterator directory_iterator;
-    struct stat statbuf;
-    FILE* f = nullptr;
+    bool is_directory = false;
+    std::shared_ptr<const DirectoryListing> listing;
+    size_t listing_index = 0;
+    std::unique_ptr<SdFile> file;
+    uint32_t position = 0;
     std::unique_ptr<LongBuffer> byte_read_request;
     std::unique_ptr<LongBuffer> byte_seek_request;
+    std::unique_ptr<LongBuffer> byte_write_request;
+    // Bytes left of the current BYTE_WRITE, and the chunk of it being sent.
+    uint32_t write_remaining = 0;
+    size_t write_chunk_size = 0;
+    std::vector<uint8_t> write_chunk;
+    bool write_error = false;
 
     void Clear();
   };
@@ -0,0 +1,249 @@
+#include "bus/ch376_sd.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kData = 0xE808;
+constexpr uint32_t kCommand = 0xE809;
+
+constexpr uint8_t kGetStatus = 0x22;
+constexpr uint8_t kReadData = 0x27;
+constexpr uint8_t kWriteRequest = 0x2d;
+constexpr uint8_t kSetFileName = 0x2f;
+constexpr uint8_t kFileOpen = 0x32;
+constexpr uint8_t kFileCreate = 0x34;
+constexpr uint8_t kFileClose = 0x36;
+constexpr uint8_t kByteRead = 0x3a;
+constexpr uint8_t kByteWrite = 0x3c;
+constexpr uint8_t kByteWriteGo = 0x3d;
+
+constexpr uint8_t kSuccess = 0x14;
+constexpr uint8_t kDiskWrite = 0x1e;
+
+// Files held in memory, shared with the test.
+class MemoryBackend : public SdBackend {
+ public:
+  class File : public SdFile {
+   public:
+    File(std::vector<uint8_t>* data, int* flushes)
+        : data_(data), flushes_(flushes) {}
+    uint32_t size() const override { return data_->size(); }
+    size_t Read(uint32_t offset, uint8_t* data, size_t size) override {
+      if (offset >= data_->size())
+        return 0;
+      size = std::min<size_t>(size, data_->size() - offset);
+      std::copy_n(data_->begin() + offset, size, data);
+      return size;
+    }
+    size_t Write(uint32_t offset, const uint8_t* data, size_t size) override {
+      if (data_->size() < offset + size)
+        data_->resize(offset + size);
+      std::copy_n(data, size, data_->begin() + offset);
+      return size;
+    }
+    bool Flush() override {
+      ++*flushes_;
+      return true;
+    }
+
+   private:
+    std::vector<uint8_t>* data_;
+    int* flushes_;
+  };
+
+  MemoryBackend(std::map<std::string, std::vector<uint8_t>>* files,
+                int* flushes)
+      : files_(files), flushes_(flushes) {}
+
+  std::unique_ptr<SdFile> Open(const std::string& path) override {
+    if (on_open)
+      on_open();
+    auto found = files_->find(path);
+    if (found == files_->end())
+      return nullptr;
+    return std::make_unique<File>(&found->second, flushes_);
+  }
+  std::unique_ptr<SdFile> Create(const std::string& path) override {
+    std::vector<uint8_t>& data = (*files_)[path];
+    data.clear();
+    return std::make_unique<File>(&data, flushes_);
+  }
+  bool IsDirectory(const std::string& path) override { return path == "/"; }
+  bool ListDirectory(const std::string& path,
+                     std::vector<SdDirectoryEntry>* entries) override {
+    return false;
+  }
+
+  // Called on the I/O thread by Open, e.g. to play a slow disk.
+  std::function<void()> on_open;
+
+ private:
+  std::map<std::string, std::vector<uint8_t>>* files_;
+  int* flushes_;
+};
+
+class CH376SDTest : public testing::Test {
+ protected:
+  CH376SDTest()
+      : sd_(CH376SD::Host{[this](uint64_t delay_us,
+                                 std::function<void()> event) {
+                            delays_.push_back(delay_us);
+                            events_.push_back(std::move(event));
+                          },
+                          [this](bool state) { interrupt_ = state; }},
+            MakeBackend()) {}
+
+  std::unique_ptr<MemoryBackend> MakeBackend() {
+    auto backend = std::make_unique<MemoryBackend>(&files_, &flushes_);
+    backend_ = backend.get();
+    return backend;
+  }
+
+  void Command(uint8_t command) { sd_.StoreByte(kCommand, command); }
+  void Data(uint8_t value) { sd_.StoreByte(kData, value); }
+  uint8_t Read() { return sd_.ReadByte(kData); }
+  uint8_t Status() {
+    Command(kGetStatus);
+    return Read();
+  }
+
+  // Completes outstanding commands, as if their latency had passed.
+  void RunEvents() {
+    while (!events_.empty())
+      RunEventsOnce();
+  }
+
+  // Runs the events scheduled so far, but not any they schedule.
+  void RunEventsOnce() {
+    std::vector<std::function<void()>> events = std::move(events_);
+    events_.clear();
+    for (auto& event : events)
+      event();
+  }
+
+  void SetFileName(const std::string& name) {
+    Command(kSetFileName);
+    for (char c : name)
+      Data(c);
+    Data(0);
+  }
+
+  std::map<std::string, std::vector<uint8_t>> files_;
+  MemoryBackend* backend_;
+  std::vector<std::function<void()>> events_;
+  std::vector<uint64_t> delays_;  // Of every event scheduled.
+  bool interrupt_ = false;
+  int flushes_ = 0;
+  CH376SD sd_;
+};
+
+}  // namespace
+
+TEST_F(CH376SDTest, ReadsStayFramedWhenTheGuestFallsBehind) {
+  std::vector<uint8_t>& contents = files_["/DATA.BIN"];
+  for (int i = 0; i < 10000; i++)
+    contents.push_back(i * 7);
+
+  SetFileName("/DATA.BIN");
+  Command(kFileOpen);
+  RunEvents();
+  Command(kByteRead);
+  Data(0x00);
+  Data(0x20);
+  RunEvents();
+
+  // Ask for far more than the 4K output buffer holds before reading any.
+  for (int i = 0; i < 20; i++)
+    Command(kReadData);
+
+  // Whole chunks, each with its length, and no more.
+  std::vector<uint8_t> received;
+  for (int chunk = 0; chunk < 16; chunk++) {
+    ASSERT_EQ(Read(), 255);
+    for (int i = 0; i < 255; i++)
+      received.push_back(Read());
+  }
+  // And the stream carries on where it stopped.
+  Command(kReadData);
+  ASSERT_EQ(Read(), 255);
+  for (int i = 0; i < 255; i++)
+    received.push_back(Read());
+  EXPECT_EQ(received, std::vector<uint8_t>(contents.begin(),
+                                           contents.begin() + 17 * 255));
+}
+
+TEST_F(CH376SDTest, WritesAFileInChunks) {
+  std::vector<uint8_t> contents;
+  for (int i = 0; i < 300; i++)
+    contents.push_back(i * 3);
+
+  SetFileName("/OUT.DAT");
+  Command(kFileCreate);
+  RunEvents();
+  EXPECT_TRUE(interrupt_);
+  EXPECT_EQ(Status(), kSuccess);
+  EXPECT_FALSE(interrupt_);
+
+  Command(kByteWrite);
+  Data(300 & 0xFF);
+  Data(300 >> 8);
+  EXPECT_EQ(Status(), kDiskWrite);
+
+  size_t sent = 0;
+  while (true) {
+    Command(kWriteRequest);
+    uint8_t chunk = Read();
+    ASSERT_EQ(chunk, std::min<size_t>(contents.size() - sent, 255));
+    for (int i = 0; i < chunk; i++)
+      Data(contents[sent++]);
+    Command(kByteWriteGo);
+    RunEvents();
+    uint8_t status = Status();
+    if (sent == contents.size()) {
+      EXPECT_EQ(status, kSuccess);
+      break;
+    }
+    ASSERT_EQ(status, kDiskWrite);
+  }
+  EXPECT_EQ(files_["/OUT.DAT"], contents);
+  // Writes are flushed after -sd_flush_interval_ms of emulated time.
+  EXPECT_NE(std::find(delays_.begin(), delays_.end(), 1000 * 1000),
+            delays_.end());
+  EXPECT_GE(flushes_, 1);
+
+  Command(kFileClose);
+  Data(0);
+  RunEvents();
+  EXPECT_EQ(Status(), kSuccess);
+}
+
+TEST_F(CH376SDTest, StatusAnswersWhileTheHostIsSlow) {
+  files_["/SLOW.BIN"] = std::vector<uint8_t>(100, 1);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  backend_->on_open = [released]() { released.wait(); };
+
+  SetFileName("/SLOW.BIN");
+  Command(kFileOpen);
+  // The latency passes, but the host isn't done: the command stays busy,
+  // and polling doesn't wait for it.
+  RunEventsOnce();
+  EXPECT_FALSE(interrupt_);
+  EXPECT_EQ(Status(), 0);
+  Command(0x06);  // CHECK_EXIST
+  EXPECT_EQ(Read(), 0x51);
+  RunEventsOnce();
+  EXPECT_EQ(Status(), 0);
+
+  release.set_value();
+  RunEvents();
+  EXPECT_EQ(Status(), kSuccess);
+}
@@ -0,0 +1,109 @@
+#include "bus/dma_engine.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+#include <utility>
+
+#include "bus/hash.h"
+
+namespace {
+
+// Offsets from the control register.
+constexpr uint32_t kControlReg = 0x0;
+constexpr uint32_t kByte2Write =
+    0x1;  // same address as below; one for read, one for write
+constexpr uint32_t kStatusReg = 0x1;
+constexpr uint32_t kSrcAddy = 0x2;
+constexpr uint32_t kDstAddr = 0x5;
+constexpr uint32_t kTransferSize = 0x8;
+constexpr uint32_t kSrcStride = 0xc;
+constexpr uint32_t kDstStride = 0xe;
+
+}  // namespace
+
+DmaEngine::DmaEngine(std::string name, uint32_t base, Host host)
+    : name_(std::move(name)),
+      base_(base),
+      host_(std::move(host)),
+      registers_({
+          {base + kControlReg, &ctrl_reg_.v, 1},
+          {base + kSrcAddy, &src_addr_, 3},
+          {base + kDstAddr, &dst_addr_, 3},
+          {base + kTransferSize, &size_, 4},
+          {base + kSrcStride, &src_stride_, 2},
+          {base + kDstStride, &dst_stride_, 2},
+      }) {
+  memset(&ctrl_reg_, 0, sizeof(ctrl_reg_));
+  memset(&status_reg_, 0, sizeof(status_reg_));
+  memset(&write_byte_, 0, sizeof(write_byte_));
+  memset(&src_addr_, 0, sizeof(src_addr_));
+  memset(&dst_addr_, 0, sizeof(dst_addr_));
+  memset(&size_, 0, sizeof(size_));
+  memset(&dst_stride_, 0, sizeof(dst_stride_));
+  memset(&src_stride_, 0, sizeof(src_stride_));
+}
+
+void DmaEngine::StartTransfer() {
+  if (status_reg_.reg.ips) {
+    LOG(ERROR) << name_ << " started while a transfer is in progress";
+    return;
+  }
+  status_reg_.v = 0;
+
+  uint32_t bytes = ctrl_reg_.reg.linear_block
+                       ? uint32_t(size_.block.x_size) * size_.block.y_size
+                       : size_.linear.size;
+  status_reg_.reg.size_err = bytes == 0;
+  CheckTransfer(bytes);
+  if (status_reg_.v)
+    return;
+
+  // The data moves now; the guest sees the transfer in progress until the
+  // time it would have taken has passed.
+  Transfer();
+  status_reg_.reg.ips = true;
+  host_.schedule(TransferCycles(bytes), [this]() { CompleteTransfer(); });
+}
+
+void DmaEngine::CompleteTransfer() {
+  status_reg_.reg.ips = false;
+  if (ctrl_reg_.reg.int_enable)
+    host_.interrupt();
+}
+
+void DmaEngine::StoreByte(uint32_t addr, uint8_t v) {
+  bool was_started = ctrl_reg_.reg.start_trf;
+  if (StoreRegister(addr, v, registers_)) {
+    if (addr == base_ + kControlReg && ctrl_reg_.reg.enable &&
+        ctrl_reg_.reg.start_trf && !was_started) {
+      StartTransfer();
+    }
+    return;
+  }
+
+  // Write-only register shares same 'address' as the read-only status reg.
+  if (addr == base_ + kByte2Write) {
+    write_byte_ = v;
+    return;
+  }
+  LOG(ERROR) << "Unknown " << name_ << " register write: " << std::hex << addr
+             << " := " << std::hex << (int)v;
+}
+
+uint8_t DmaEngine::ReadByte(uint32_t addr) {
+  uint8_t v;
+  if (ReadRegister(addr, registers_, &v)) {
+    return v;
+  }
+  if (addr == base_ + kStatusReg) {
+    return status_reg_.v;
+  }
+  LOG(ERROR) << "Unknown " << name_ << " register read: " << std::hex << addr;
+  return 0;
+}
+
+uint64_t DmaEngine::HashState(uint64_t seed) const {
+  seed = HashRegisters(registers_, seed);
+  return HashBytes(&status_reg_.v, sizeof(status_reg_.v), seed);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bus/register_utils.h"
+
+// The register block and transfer sequencing shared by the video (VDMA) and
+// system (SDMA) DMA engines. Both have the same registers from their control
+// register on, and setting start_trf begins a transfer: the data is moved
+// straight away, but the in progress status bit stays set, and the
+// interrupt is raised, only once the transfer's time has passed. The
+// engines differ in what they can reach and how fast they go.
+class DmaEngine {
+ public:
+  // How the engine reaches the rest of the machine. Each engine extends it.
+  struct Host {
+    // Runs 'event' on the CPU thread 'delay_cycles' CPU cycles from now.
+    std::function<void(uint64_t delay_cycles, std::function<void()> event)>
+        schedule;
+    // Raises the engine's interrupt.
+    std::function<void()> interrupt;
+  };
+
+  virtual ~DmaEngine() = default;
+
+  void StoreByte(uint32_t addr, uint8_t v);
+  uint8_t ReadByte(uint32_t addr);
+
+  uint64_t HashState(uint64_t seed) const;
+
+ protected:
+  // 'name' is for logs; 'base' is the address of the control register.
+  DmaEngine(std::string name, uint32_t base, Host host);
+
+  // Sets error bits in status_reg_ for a transfer of 'bytes' the engine
+  // can't do, beyond an empty one.
+  virtual void CheckTransfer(uint32_t bytes) = 0;
+  // Moves the data.
+  virtual void Transfer() = 0;
+  // The CPU cycles moving 'bytes' takes.
+  virtual uint64_t TransferCycles(uint32_t bytes) const = 0;
+
+  union {
+    uint8_t v;
+    struct {
+      bool enable : 1;
+      bool linear_block : 1;  // 0 for linear (1D), 1 for block (2D)
+      bool trf_fill : 1;      // transfer or fill
+      bool int_enable : 1;    // generate interrupt on completion
+      bool sysram_src : 1;    // source is system RAM
+      bool sysram_dst : 1;    // destination is system RAM
+      uint8_t unused : 1;
+      bool start_trf : 1;     // begin; clear before starting another
+    } reg;
+  } ctrl_reg_;
+
+  uint8_t write_byte_;  // write only
+
+  union {
+    uint8_t v;
+    struct {
+      bool size_err : 1;     // if 1 size is invalid
+      bool dst_add_err : 1;  // if 1, dest addr invalid
+      bool src_add_err : 1;  // if 1 src addr invalid
+      bool timeout_err : 1;  // SDMA only
+      uint8_t unused : 3;
+      bool ips : 1;          // 1 while a transfer is in progress
+    } reg;
+  } status_reg_;
+
+  uint32_t src_addr_;
+  uint32_t dst_addr_;
+
+  union {
+    struct {
+      uint32_t size : 24;
+      uint8_t ignored : 8;
+    } linear;
+    struct {
+      uint16_t x_size;
+      uint16_t y_size;
+    } block;
+  } size_;
+
+  uint16_t src_stride_;
+  uint16_t dst_stride_;
+
+ private:
+  // Validates the registers and schedules the transfer's completion.
+  void StartTransfer();
+  void CompleteTransfer();
+
+  const std::string name_;
+  const uint32_t base_;
+  Host host_;
+  std::vector<Reg> registers_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "bus/dma_engine.h"
+
+// A fixture for the DMA engines: drives the registers of 'engine_', which
+// the test sets up with MakeHost(), and records what it schedules and
+// raises.
+class DmaEngineTest : public testing::Test {
+ protected:
+  // Offsets from the control register.
+  static constexpr uint32_t kControl = 0x0;
+  static constexpr uint32_t kStatus = 0x1;
+  static constexpr uint32_t kFillByte = 0x1;
+  static constexpr uint32_t kSrcAddr = 0x2;
+  static constexpr uint32_t kDstAddr = 0x5;
+  static constexpr uint32_t kSize = 0x8;
+  static constexpr uint32_t kSrcStride = 0xc;
+  static constexpr uint32_t kDstStride = 0xe;
+
+  static constexpr uint8_t kEnable = 0x01;
+  static constexpr uint8_t kBlock = 0x02;
+  static constexpr uint8_t kFill = 0x04;
+  static constexpr uint8_t kIntEnable = 0x08;
+  static constexpr uint8_t kStart = 0x80;
+
+  static constexpr uint8_t kSizeError = 0x01;
+  static constexpr uint8_t kInProgress = 0x80;
+
+  explicit DmaEngineTest(uint32_t base) : base_(base) {}
+
+  DmaEngine::Host MakeHost() {
+    return {[this](uint64_t delay_cycles, std::function<void()> event) {
+              delays_.push_back(delay_cycles);
+              events_.push_back(std::move(event));
+            },
+            [this]() { interrupts_++; }};
+  }
+
+  void Store(uint32_t reg, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+      engine_->StoreByte(base_ + reg + i, value >> (i * 8));
+  }
+
+  uint8_t Read(uint32_t reg) { return engine_->ReadByte(base_ + reg); }
+
+  // Starts a transfer with 'control', after clearing start_trf.
+  void Start(uint8_t control) {
+    Store(kControl, 0, 1);
+    Store(kControl, control | kEnable | kStart, 1);
+  }
+
+  void RunEvents() {
+    for (auto& event : events_)
+      event();
+    events_.clear();
+  }
+
+  DmaEngine* engine_ = nullptr;
+  std::vector<std::function<void()>> events_;
+  std::vector<uint64_t> delays_;
+  int interrupts_ = 0;
+
+ private:
+  const uint32_t base_;
+};
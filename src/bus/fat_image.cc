@@ -0,0 +1,305 @@
+#include "bus/fat_image.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kSectorSize = 512;
+constexpr size_t kDirEntrySize = 32;
+
+constexpr uint8_t kAttrVolumeId = 0x08;
+constexpr uint8_t kAttrDirectory = 0x10;
+constexpr uint8_t kAttrLongName = 0x0F;
+
+uint16_t Get16(const uint8_t* p) { return p[0] | p[1] << 8; }
+
+uint32_t Get32(const uint8_t* p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+// Converts one path component to a space padded 8.3 name for comparison.
+bool ToFatName(const std::string& component, char name[11]) {
+  memset(name, ' ', 11);
+  size_t dot = component.find('.');
+  std::string base = component.substr(0, dot);
+  std::string extension =
+      dot == std::string::npos ? "" : component.substr(dot + 1);
+  if (base.empty() || base.size() > 8 || extension.size() > 3)
+    return false;
+  for (size_t i = 0; i < base.size(); i++)
+    name[i] = toupper(base[i]);
+  for (size_t i = 0; i < extension.size(); i++)
+    name[8 + i] = toupper(extension[i]);
+  return true;
+}
+
+}  // namespace
+
+class FatImageBackend::File : public SdFile {
+ public:
+  File(FatImageBackend* backend, const std::vector<uint32_t>* chain,
+       uint32_t size)
+      : backend_(backend), chain_(chain), size_(size) {}
+
+  uint32_t size() const override { return size_; }
+
+  size_t Read(uint32_t offset, uint8_t* data, size_t size) override {
+    if (offset >= size_)
+      return 0;
+    size = std::min<size_t>(size, size_ - offset);
+    uint32_t cluster_size = backend_->cluster_size_;
+    size_t done = 0;
+    while (done < size) {
+      size_t index = (offset + done) / cluster_size;
+      if (index >= chain_->size())
+        break;  // The chain is shorter than the size claims.
+      size_t within = (offset + done) % cluster_size;
+      size_t count = std::min<size_t>(size - done, cluster_size - within);
+      memcpy(data + done, backend_->Cluster((*chain_)[index]) + within,
+             count);
+      done += count;
+    }
+    return done;
+  }
+
+ private:
+  FatImageBackend* backend_;
+  const std::vector<uint32_t>* chain_;
+  uint32_t size_;
+};
+
+bool FatImageBackend::Mount(const std::string& path) {
+  if (!image_.Open(path)) {
+    LOG(ERROR) << "Unable to open SD card image: " << path;
+    return false;
+  }
+  chains_.clear();
+  directories_.clear();
+
+  const uint8_t* sector = image_.data();
+  if (image_.size() < kSectorSize || sector[510] != 0x55 ||
+      sector[511] != 0xAA) {
+    LOG(ERROR) << "Not a FAT disk image: " << path;
+    return false;
+  }
+  // A volume boot sector starts with a jump; anything else is taken to be
+  // an MBR, and the first partition is used.
+  size_t volume_offset = 0;
+  if (sector[0] != 0xEB && sector[0] != 0xE9)
+    volume_offset = Get32(sector + 0x1BE + 8) * kSectorSize;
+  if (!ParseBootSector(volume_offset)) {
+    LOG(ERROR) << "Unsupported FAT volume in " << path;
+    return false;
+  }
+  LOG(INFO) << "Mounted " << (fat32_ ? "FAT32" : "FAT16") << " image "
+            << path << " (" << cluster_count_ << " clusters of "
+            << cluster_size_ << " bytes)";
+  return true;
+}
+
+bool FatImageBackend::ParseBootSector(size_t volume_offset) {
+  if (volume_offset + kSectorSize > image_.size())
+    return false;
+  volume_ = image_.data() + volume_offset;
+  volume_size_ = image_.size() - volume_offset;
+
+  const uint8_t* bpb = volume_;
+  uint32_t bytes_per_sector = Get16(bpb + 0x0B);
+  uint32_t sectors_per_cluster = bpb[0x0D];
+  uint32_t reserved_sectors = Get16(bpb + 0x0E);
+  uint32_t num_fats = bpb[0x10];
+  root_entries_ = Get16(bpb + 0x11);
+  uint32_t total_sectors = Get16(bpb + 0x13);
+  if (total_sectors == 0)
+    total_sectors = Get32(bpb + 0x20);
+  uint32_t fat_sectors = Get16(bpb + 0x16);
+  if (fat_sectors == 0)
+    fat_sectors = Get32(bpb + 0x24);
+
+  if (bytes_per_sector < 512 || bytes_per_sector > 4096 ||
+      (bytes_per_sector & (bytes_per_sector - 1)) ||
+      sectors_per_cluster == 0 ||
+      (sectors_per_cluster & (sectors_per_cluster - 1)) || num_fats == 0 ||
+      fat_sectors == 0) {
+    return false;
+  }
+
+  uint32_t root_sectors =
+      (root_entries_ * kDirEntrySize + bytes_per_sector - 1) /
+      bytes_per_sector;
+  uint32_t meta_sectors =
+      reserved_sectors + num_fats * fat_sectors + root_sectors;
+  if (total_sectors <= meta_sectors)
+    return false;
+  cluster_count_ = (total_sectors - meta_sectors) / sectors_per_cluster;
+  // FAT12 is decided purely by cluster count, and isn't supported.
+  if (cluster_count_ < 4085)
+    return false;
+  fat32_ = cluster_count_ >= 65525;
+
+  cluster_size_ = bytes_per_sector * sectors_per_cluster;
+  fat_offset_ = static_cast<size_t>(reserved_sectors) * bytes_per_sector;
+  root_offset_ = fat_offset_ +
+                 static_cast<size_t>(num_fats) * fat_sectors * bytes_per_sector;
+  data_offset_ = root_offset_ + root_sectors * bytes_per_sector;
+  root_cluster_ = fat32_ ? Get32(bpb + 0x2C) : 0;
+
+  // Clamp to what the image actually holds, so a truncated image can't
+  // send reads out of bounds.
+  if (data_offset_ >= volume_size_)
+    return false;
+  cluster_count_ = std::min<uint64_t>(
+      cluster_count_, (volume_size_ - data_offset_) / cluster_size_);
+  size_t fat_entries = (volume_size_ - fat_offset_) / (fat32_ ? 4 : 2);
+  cluster_count_ =
+      std::min<uint64_t>(cluster_count_, fat_entries > 2 ? fat_entries - 2 : 0);
+  return true;
+}
+
+const uint8_t* FatImageBackend::Cluster(uint32_t cluster) const {
+  return volume_ + data_offset_ +
+         static_cast<size_t>(cluster - 2) * cluster_size_;
+}
+
+const std::vector<uint32_t>& FatImageBackend::Chain(uint32_t first_cluster) {
+  auto found = chains_.find(first_cluster);
+  if (found != chains_.end())
+    return found->second;
+
+  std::vector<uint32_t>& chain = chains_[first_cluster];
+  uint32_t cluster = first_cluster;
+  // A chain can't be longer than the volume; stop there if the FAT loops.
+  while (cluster >= 2 && cluster < cluster_count_ + 2 &&
+         chain.size() < cluster_count_) {
+    chain.push_back(cluster);
+    if (fat32_)
+      cluster = Get32(volume_ + fat_offset_ + cluster * 4) & 0x0FFFFFFF;
+    else
+      cluster = Get16(volume_ + fat_offset_ + cluster * 2);
+  }
+  return chain;
+}
+
+const std::vector<FatImageBackend::DirEntry>& FatImageBackend::Directory(
+    uint32_t first_cluster) {
+  auto found = directories_.find(first_cluster);
+  if (found != directories_.end())
+    return found->second;
+
+  std::vector<DirEntry>& directory = directories_[first_cluster];
+  auto parse = [&directory](const uint8_t* data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      const uint8_t* raw = data + i * kDirEntrySize;
+      if (raw[0] == 0)
+        return false;  // End of directory.
+      uint8_t attributes = raw[11];
+      if (raw[0] == 0xE5 || attributes == kAttrLongName ||
+          (attributes & kAttrVolumeId)) {
+        continue;
+      }
+      DirEntry entry;
+      memcpy(entry.name, raw, sizeof(entry.name));
+      if (entry.name[0] == 0x05)
+        entry.name[0] = static_cast<char>(0xE5);
+      entry.attributes = attributes;
+      entry.first_cluster = Get16(raw + 26) | Get16(raw + 20) << 16;
+      entry.size = Get32(raw + 28);
+      directory.push_back(entry);
+    }
+    return true;
+  };
+
+  if (first_cluster == 0 && !fat32_) {
+    size_t count = std::min<size_t>(
+        root_entries_, (volume_size_ - root_offset_) / kDirEntrySize);
+    parse(volume_ + root_offset_, count);
+    return directory;
+  }
+  uint32_t start = first_cluster == 0 ? root_cluster_ : first_cluster;
+  for (uint32_t cluster : Chain(start)) {
+    if (!parse(Cluster(cluster), cluster_size_ / kDirEntrySize))
+      break;
+  }
+  return directory;
+}
+
+bool FatImageBackend::Lookup(const std::string& path, DirEntry* entry,
+                             bool* is_root) {
+  *is_root = true;
+  uint32_t directory = 0;
+  size_t pos = 0;
+  while (pos < path.size()) {
+    size_t end = path.find('/', pos);
+    if (end == std::string::npos)
+      end = path.size();
+    std::string component = path.substr(pos, end - pos);
+    pos = end + 1;
+    if (component.empty() || component == ".")
+      continue;
+
+    // Only directories can have children.
+    if (!*is_root && !(entry->attributes & kAttrDirectory))
+      return false;
+    char name[11];
+    if (!ToFatName(component, name))
+      return false;
+    const std::vector<DirEntry>& entries = Directory(directory);
+    auto found = std::find_if(
+        entries.begin(), entries.end(), [&name](const DirEntry& candidate) {
+          return memcmp(candidate.name, name, sizeof(name)) == 0;
+        });
+    if (found == entries.end())
+      return false;
+    *entry = *found;
+    *is_root = false;
+    directory = found->first_cluster;
+  }
+  return true;
+}
+
+std::unique_ptr<SdFile> FatImageBackend::Open(const std::string& path) {
+  DirEntry entry;
+  bool is_root;
+  if (!volume_ || !Lookup(path, &entry, &is_root) || is_root ||
+      (entry.attributes & kAttrDirectory)) {
+    return nullptr;
+  }
+  return std::make_unique<File>(this, &Chain(entry.first_cluster),
+                                entry.size);
+}
+
+bool FatImageBackend::IsDirectory(const std::string& path) {
+  DirEntry entry;
+  bool is_root;
+  return volume_ && Lookup(path, &entry, &is_root) &&
+         (is_root || (entry.attributes & kAttrDirectory));
+}
+
+bool FatImageBackend::ListDirectory(const std::string& path,
+                                    std::vector<SdDirectoryEntry>* entries) {
+  DirEntry entry;
+  bool is_root;
+  if (!volume_ || !Lookup(path, &entry, &is_root))
+    return false;
+  if (!is_root && !(entry.attributes & kAttrDirectory))
+    return false;
+
+  entries->clear();
+  for (const DirEntry& child :
+       Directory(is_root ? 0 : entry.first_cluster)) {
+    if (child.name[0] == '.')
+      continue;
+    SdDirectoryEntry listed;
+    // Match the host backend: NUL rather than space padding.
+    for (int i = 0; i < 11; i++)
+      listed.name[i] = child.name[i] == ' ' ? 0 : child.name[i];
+    listed.directory = child.attributes & kAttrDirectory;
+    listed.size = listed.directory ? 0 : child.size;
+    entries->push_back(listed);
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bus/mapped_file.h"
+#include "bus/sd_backend.h"
+
+// Serves the CH376 from a FAT16 or FAT32 disk image (a bare volume, or one
+// behind an MBR partition table). The backend is read-only: the image is
+// mapped read-only, and Create() fails, so the file on the host is never
+// modified.
+//
+// Cluster chains and directories are decoded once and cached, so opening and
+// reading files costs no syscalls after the image is mapped.
+class FatImageBackend : public SdBackend {
+ public:
+  bool Mount(const std::string& path);
+
+  std::unique_ptr<SdFile> Open(const std::string& path) override;
+  bool IsDirectory(const std::string& path) override;
+  bool ListDirectory(const std::string& path,
+                     std::vector<SdDirectoryEntry>* entries) override;
+  // The image never changes, so neither do its listings.
+  bool DirectoryVersion(const std::string& path, uint64_t* version) override {
+    *version = 0;
+    return true;
+  }
+
+ private:
+  class File;
+
+  struct DirEntry {
+    char name[11];
+    uint8_t attributes;
+    uint32_t first_cluster;
+    uint32_t size;
+  };
+
+  bool ParseBootSector(size_t volume_offset);
+  // Resolves 'path' to its directory entry. The root has no entry of its
+  // own, so it is reported through 'is_root'.
+  bool Lookup(const std::string& path, DirEntry* entry, bool* is_root);
+  // The entries of the directory starting at 'first_cluster' (0 for the
+  // root), decoded on first use.
+  const std::vector<DirEntry>& Directory(uint32_t first_cluster);
+  const std::vector<uint32_t>& Chain(uint32_t first_cluster);
+  const uint8_t* Cluster(uint32_t cluster) const;
+
+  MappedFile image_;
+  const uint8_t* volume_ = nullptr;
+  size_t volume_size_ = 0;
+
+  bool fat32_ = false;
+  uint32_t cluster_size_ = 0;
+  uint32_t cluster_count_ = 0;
+  size_t fat_offset_ = 0;
+  size_t root_offset_ = 0;  // FAT16's fixed root directory.
+  uint32_t root_entries_ = 0;
+  uint32_t root_cluster_ = 0;  // FAT32's root directory chain.
+  size_t data_offset_ = 0;
+
+  std::unordered_map<uint32_t, std::vector<uint32_t>> chains_;
+  std::unordered_map<uint32_t, std::vector<DirEntry>> directories_;
+};
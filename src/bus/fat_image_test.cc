@@ -0,0 +1,133 @@
+#include "bus/fat_image.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kSectorSize = 512;
+constexpr size_t kSectors = 8192;
+constexpr size_t kFatSectors = 32;
+constexpr size_t kRootEntries = 512;
+constexpr size_t kFatOffset = kSectorSize;
+constexpr size_t kRootOffset = kFatOffset + 2 * kFatSectors * kSectorSize;
+constexpr size_t kDataOffset = kRootOffset + kRootEntries * 32;
+
+void Put16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+void Put32(uint8_t* p, uint32_t v) {
+  Put16(p, v);
+  Put16(p + 2, v >> 16);
+}
+
+void PutEntry(uint8_t* p, const char name[12], uint8_t attributes,
+              uint16_t cluster, uint32_t size) {
+  memcpy(p, name, 11);
+  p[11] = attributes;
+  Put16(p + 26, cluster);
+  Put32(p + 28, size);
+}
+
+uint8_t* Cluster(std::vector<uint8_t>* image, uint16_t cluster) {
+  return image->data() + kDataOffset + (cluster - 2) * kSectorSize;
+}
+
+// A FAT16 volume with one sector per cluster, holding HELLO.TXT (spread over
+// clusters 3 and 7) and GAMES/PONG.BIN.
+std::vector<uint8_t> MakeImage() {
+  std::vector<uint8_t> image(kSectors * kSectorSize);
+  uint8_t* bpb = image.data();
+  bpb[0] = 0xEB;
+  Put16(bpb + 0x0B, kSectorSize);
+  bpb[0x0D] = 1;  // Sectors per cluster.
+  Put16(bpb + 0x0E, 1);  // Reserved sectors.
+  bpb[0x10] = 2;  // FATs.
+  Put16(bpb + 0x11, kRootEntries);
+  Put16(bpb + 0x13, kSectors);
+  Put16(bpb + 0x16, kFatSectors);
+  bpb[510] = 0x55;
+  bpb[511] = 0xAA;
+
+  uint8_t* fat = image.data() + kFatOffset;
+  Put16(fat + 3 * 2, 7);
+  Put16(fat + 7 * 2, 0xFFFF);
+  Put16(fat + 5 * 2, 0xFFFF);
+  Put16(fat + 6 * 2, 0xFFFF);
+
+  uint8_t* root = image.data() + kRootOffset;
+  PutEntry(root, "VOLUME     ", 0x08, 0, 0);
+  PutEntry(root + 32, "HELLO   TXT", 0x20, 3, 700);
+  root[64] = 0xE5;  // Deleted.
+  PutEntry(root + 96, "GAMES      ", 0x10, 5, 0);
+
+  uint8_t* games = Cluster(&image, 5);
+  PutEntry(games, ".          ", 0x10, 5, 0);
+  PutEntry(games + 32, "PONG    BIN", 0x20, 6, 10);
+  memcpy(Cluster(&image, 6), "0123456789", 10);
+
+  for (int i = 0; i < 700; i++) {
+    uint8_t* data = Cluster(&image, i < 512 ? 3 : 7);
+    data[i % 512] = i & 0xFF;
+  }
+  return image;
+}
+
+class FatImageTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::string path = testing::TempDir() + "fat_image_test.img";
+    std::vector<uint8_t> image = MakeImage();
+    FILE* f = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(f);
+    fwrite(image.data(), 1, image.size(), f);
+    fclose(f);
+    ASSERT_TRUE(backend_.Mount(path));
+  }
+
+  FatImageBackend backend_;
+};
+
+TEST_F(FatImageTest, ListsDirectories) {
+  std::vector<SdDirectoryEntry> entries;
+  ASSERT_TRUE(backend_.ListDirectory("/", &entries));
+  ASSERT_EQ(entries.size(), 2u);
+  EXPECT_EQ(std::string(entries[0].name, 11),
+            std::string("HELLO\0\0\0TXT", 11));
+  EXPECT_FALSE(entries[0].directory);
+  EXPECT_EQ(entries[0].size, 700u);
+  EXPECT_TRUE(entries[1].directory);
+
+  EXPECT_TRUE(backend_.IsDirectory("/games"));
+  EXPECT_FALSE(backend_.IsDirectory("/hello.txt"));
+  ASSERT_TRUE(backend_.ListDirectory("/GAMES", &entries));
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].size, 10u);
+}
+
+TEST_F(FatImageTest, ReadsAcrossClusters) {
+  EXPECT_FALSE(backend_.Open("/MISSING.TXT"));
+  EXPECT_FALSE(backend_.Open("/GAMES"));
+
+  std::unique_ptr<SdFile> file = backend_.Open("/hello.txt");
+  ASSERT_TRUE(file);
+  EXPECT_EQ(file->size(), 700u);
+  uint8_t data[300];
+  ASSERT_EQ(file->Read(400, data, sizeof(data)), 300u);
+  for (int i = 0; i < 300; i++)
+    EXPECT_EQ(data[i], (400 + i) & 0xFF) << i;
+  EXPECT_EQ(file->Read(600, data, sizeof(data)), 100u);
+
+  file = backend_.Open("/GAMES/PONG.BIN");
+  ASSERT_TRUE(file);
+  ASSERT_EQ(file->Read(0, data, sizeof(data)), 10u);
+  EXPECT_EQ(std::string(reinterpret_cast<char*>(data), 10), "0123456789");
+}
+
+}  // namespace
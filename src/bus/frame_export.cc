@@ -0,0 +1,181 @@
+#include "bus/frame_export.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+
+// shm_open wants names of the form "/name".
+std::string SegmentName(const std::string& name) {
+  return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+}  // namespace
+
+FrameExport::~FrameExport() { Close(); }
+
+bool FrameExport::Open(const std::string& name) {
+  Close();
+  std::string segment = SegmentName(name);
+  int fd = shm_open(segment.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    PLOG(ERROR) << "Unable to create shared memory: " << segment;
+    return false;
+  }
+  if (ftruncate(fd, sizeof(FrameExportHeader)) != 0) {
+    PLOG(ERROR) << "Unable to size shared memory: " << segment;
+    close(fd);
+    shm_unlink(segment.c_str());
+    return false;
+  }
+  void* addr = mmap(nullptr, sizeof(FrameExportHeader),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    PLOG(ERROR) << "Unable to map shared memory: " << segment;
+    shm_unlink(segment.c_str());
+    return false;
+  }
+
+  // Fresh from ftruncate, so zeroed; the rest is left for the first frames.
+  header_ = new (addr) FrameExportHeader;
+  header_->slot_count = kFrameExportSlots;
+  header_->slot_size = sizeof(FrameExportSlot);
+  header_->version = kFrameExportVersion;
+  header_->published.store(0, std::memory_order_relaxed);
+  for (FrameExportSlot& slot : header_->slots)
+    slot.sequence.store(0, std::memory_order_relaxed);
+  // Readers check the magic last.
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = kFrameExportMagic;
+  name_ = segment;
+  LOG(INFO) << "Exporting frames to shared memory " << segment;
+  return true;
+}
+
+void FrameExport::Close() {
+  if (!header_)
+    return;
+  munmap(header_, sizeof(FrameExportHeader));
+  shm_unlink(name_.c_str());
+  header_ = nullptr;
+  name_.clear();
+}
+
+void FrameExport::Publish(uint64_t frame, const uint32_t* pixels, int width,
+                          int height) {
+  if (width > kFrameExportMaxWidth || height > kFrameExportMaxHeight) {
+    LOG(ERROR) << "Frame too large to export: " << width << "x" << height;
+    return;
+  }
+  uint64_t published = header_->published.load(std::memory_order_relaxed);
+  FrameExportSlot& slot = header_->slots[published % kFrameExportSlots];
+  const FrameExportSlot* previous =
+      published ? &header_->slots[(published - 1) % kFrameExportSlots]
+                : nullptr;
+  bool compare = previous && previous->width == uint32_t(width) &&
+                 previous->height == uint32_t(height);
+
+  uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.width = width;
+  slot.height = height;
+  slot.frame = frame;
+  memset(slot.dirty_rows, 0, sizeof(slot.dirty_rows));
+  size_t row_bytes = width * sizeof(uint32_t);
+  for (int y = 0; y < height; y++) {
+    const uint32_t* row = pixels + y * width;
+    if (!compare || memcmp(previous->pixels + y * width, row, row_bytes) != 0)
+      slot.dirty_rows[y / 64] |= uint64_t(1) << (y % 64);
+    // The slot holds an older frame, so every row is copied regardless.
+    memcpy(slot.pixels + y * width, row, row_bytes);
+  }
+
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  header_->published.store(published + 1, std::memory_order_release);
+}
+
+FrameExportReader::~FrameExportReader() { Close(); }
+
+bool FrameExportReader::Open(const std::string& name) {
+  Close();
+  std::string segment = SegmentName(name);
+  int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    PLOG(ERROR) << "Unable to open shared memory: " << segment;
+    return false;
+  }
+  struct stat info {};
+  if (fstat(fd, &info) != 0 ||
+      size_t(info.st_size) < sizeof(FrameExportHeader)) {
+    LOG(ERROR) << "Not a frame export segment: " << segment;
+    close(fd);
+    return false;
+  }
+  void* addr =
+      mmap(nullptr, sizeof(FrameExportHeader), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    PLOG(ERROR) << "Unable to map shared memory: " << segment;
+    return false;
+  }
+  header_ = static_cast<const FrameExportHeader*>(addr);
+  if (header_->magic != kFrameExportMagic) {
+    LOG(ERROR) << "Not a frame export segment: " << segment;
+    Close();
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header_->version != kFrameExportVersion ||
+      header_->slot_count != kFrameExportSlots ||
+      header_->slot_size != sizeof(FrameExportSlot)) {
+    LOG(ERROR) << "Unsupported frame export version " << header_->version
+               << ": " << segment;
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void FrameExportReader::Close() {
+  if (!header_)
+    return;
+  munmap(const_cast<FrameExportHeader*>(header_), sizeof(FrameExportHeader));
+  header_ = nullptr;
+}
+
+bool FrameExportReader::ReadLatest(Frame* frame) const {
+  while (true) {
+    uint64_t published = header_->published.load(std::memory_order_acquire);
+    if (published == 0)
+      return false;
+    const FrameExportSlot& slot =
+        header_->slots[(published - 1) % kFrameExportSlots];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+      continue;
+
+    // A torn read can see any size; keep it in bounds until it's checked.
+    frame->width = std::min<uint32_t>(slot.width, kFrameExportMaxWidth);
+    frame->height = std::min<uint32_t>(slot.height, kFrameExportMaxHeight);
+    frame->frame = slot.frame;
+    frame->dirty_rows.assign(slot.dirty_rows,
+                             slot.dirty_rows + kFrameExportRowWords);
+    frame->pixels.assign(slot.pixels,
+                         slot.pixels + frame->width * frame->height);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+      return true;
+  }
+}
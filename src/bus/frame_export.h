@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Completed frames published to a POSIX shared memory segment, for viewers
+// in other processes.
+//
+// The segment is one FrameExportHeader: a ring of slots, each holding a
+// frame, written in turn. Each slot is guarded by a seqlock. To read the
+// newest frame, a viewer takes slot (published - 1) % slot_count, loads its
+// sequence (acquire), skips it if odd, reads what it needs straight from
+// the mapping, then issues an acquire fence and checks the sequence is
+// unchanged; otherwise the slot was rewritten meanwhile, and it retries.
+// The writer never waits for readers.
+//
+// dirty_rows has a bit per row that differs from the frame published
+// before it, so a viewer that saw that frame only has to look at those
+// rows. Any other viewer should treat every row as dirty.
+
+constexpr uint32_t kFrameExportMagic = 0x36353243;  // "C256"
+constexpr uint32_t kFrameExportVersion = 1;
+constexpr int kFrameExportSlots = 4;
+constexpr int kFrameExportMaxWidth = 800;
+constexpr int kFrameExportMaxHeight = 600;
+constexpr int kFrameExportRowWords = (kFrameExportMaxHeight + 63) / 64;
+
+struct FrameExportSlot {
+  std::atomic<uint32_t> sequence;
+  uint32_t width;
+  uint32_t height;
+  uint64_t frame;
+  uint64_t dirty_rows[kFrameExportRowWords];
+  // BGRA, 'width' pixels to a row, rows packed.
+  alignas(64) uint32_t pixels[kFrameExportMaxWidth * kFrameExportMaxHeight];
+};
+
+struct FrameExportHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  // sizeof(FrameExportSlot), so readers can check the layout matches.
+  uint32_t slot_size;
+  // Frames published so far.
+  std::atomic<uint64_t> published;
+  alignas(64) FrameExportSlot slots[kFrameExportSlots];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory atomics must be lock free");
+
+// The writing side: creates the segment and publishes frames to it.
+class FrameExport {
+ public:
+  FrameExport() = default;
+  ~FrameExport();
+
+  FrameExport(const FrameExport&) = delete;
+  FrameExport& operator=(const FrameExport&) = delete;
+
+  // Create (or replace) the segment 'name', e.g. "/c256emu".
+  bool Open(const std::string& name);
+  // Unmaps and unlinks the segment.
+  void Close();
+
+  bool is_open() const { return header_ != nullptr; }
+
+  void Publish(uint64_t frame, const uint32_t* pixels, int width,
+               int height);
+
+ private:
+  std::string name_;
+  FrameExportHeader* header_ = nullptr;
+};
+
+// The reading side, for tools (and tests) happy to take a copy of each
+// frame.
+class FrameExportReader {
+ public:
+  struct Frame {
+    uint64_t frame = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<uint64_t> dirty_rows;
+    std::vector<uint32_t> pixels;
+  };
+
+  FrameExportReader() = default;
+  ~FrameExportReader();
+
+  FrameExportReader(const FrameExportReader&) = delete;
+  FrameExportReader& operator=(const FrameExportReader&) = delete;
+
+  bool Open(const std::string& name);
+  void Close();
+
+  const FrameExportHeader* header() const { return header_; }
+
+  // Copies the newest frame. False if none has been published yet.
+  bool ReadLatest(Frame* frame) const;
+
+ private:
+  const FrameExportHeader* header_ = nullptr;
+};
@@ -0,0 +1,50 @@
+#include "bus/frame_export.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <vector>
+
+TEST(FrameExportTest, PublishesFramesWithDirtyRows) {
+  std::string name = "/c256emu_test_" + std::to_string(getpid());
+  FrameExport frame_export;
+  ASSERT_TRUE(frame_export.Open(name));
+  FrameExportReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  FrameExportReader::Frame frame;
+  EXPECT_FALSE(reader.ReadLatest(&frame));
+
+  // The first frame, and one of a new size, are dirty throughout.
+  std::vector<uint32_t> pixels(4 * 3, 0xFF000000);
+  frame_export.Publish(1, pixels.data(), 4, 3);
+  ASSERT_TRUE(reader.ReadLatest(&frame));
+  EXPECT_EQ(frame.frame, 1u);
+  EXPECT_EQ(frame.width, 4);
+  EXPECT_EQ(frame.height, 3);
+  EXPECT_EQ(frame.dirty_rows[0], 0b111u);
+  EXPECT_EQ(frame.pixels, pixels);
+
+  pixels[2 * 4 + 1] = 0xFFFFFFFF;
+  frame_export.Publish(2, pixels.data(), 4, 3);
+  ASSERT_TRUE(reader.ReadLatest(&frame));
+  EXPECT_EQ(frame.frame, 2u);
+  EXPECT_EQ(frame.dirty_rows[0], 0b100u);
+  EXPECT_EQ(frame.pixels, pixels);
+
+  // Around the ring, each frame is still compared with the one before.
+  for (uint64_t i = 3; i < 3 + kFrameExportSlots; i++)
+    frame_export.Publish(i, pixels.data(), 4, 3);
+  ASSERT_TRUE(reader.ReadLatest(&frame));
+  EXPECT_EQ(frame.frame, 2u + kFrameExportSlots);
+  EXPECT_EQ(frame.dirty_rows[0], 0u);
+
+  frame_export.Publish(10, pixels.data(), 2, 6);
+  ASSERT_TRUE(reader.ReadLatest(&frame));
+  EXPECT_EQ(frame.dirty_rows[0], 0b111111u);
+  EXPECT_EQ(reader.header()->published.load(), 7u);
+
+  frame_export.Close();
+  FrameExportReader gone;
+  EXPECT_FALSE(gone.Open(name));
+}
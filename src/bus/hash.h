@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic hash of a block of memory (XXH64). Used to compare
+// screens, memory regions and machine state cheaply.
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
@@ -0,0 +1,21 @@
+#include "bus/hash.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+TEST(HashTest, KnownValues) {
+  EXPECT_EQ(HashBytes("", 0), 0xEF46DB3751D8E999ULL);
+  EXPECT_EQ(HashBytes("a", 1), 0xD24EC4F1A98C6E5BULL);
+  EXPECT_EQ(HashBytes("abc", 3), 0x44BC2CF5AD770999ULL);
+}
+
+TEST(HashTest, LongInputsDiffer) {
+  std::vector<uint8_t> block(4096, 0x55);
+  uint64_t before = HashBytes(block.data(), block.size());
+  block[4000] ^= 1;
+  EXPECT_NE(before, HashBytes(block.data(), block.size()));
+  EXPECT_NE(HashBytes(block.data(), block.size()),
+            HashBytes(block.data(), block.size(), 1));
+}
@@ -296,11 +296,17 @@ void I8042::kbd_write_data(cpuaddr_t addr, uint8_t val) {
 
 uint8_t I8042::kbd_read_data(cpuaddr_t addr) {
   uint32_t val;
+  PS2State *device;
 
   if (pending_ == KBD_PENDING_AUX)
-    val = mouse_->ps2_read_data();
+    device = mouse_.get();
   else
-    val = kbd_->ps2_read_data();
+    device = kbd_.get();
+  bool had_data = device->queue_count() != 0;
+  val = device->ps2_read_data();
+
+  if (drain_callback_ && had_data && device->queue_count() == 0)
+    drain_callback_();
 
   return val;
 }
@@ -3,6 +3,8 @@
 #include "cpu.h"
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 
 class InterruptController;
 class PS2KbdState;
@@ -19,6 +21,12 @@ public:
   PS2MouseState* mouse() const { return mouse_.get(); }
   PS2KbdState *kbd() const { return kbd_.get(); }
 
+  // Called when a data port read leaves the device it came from with nothing
+  // more to send, i.e. the guest has consumed all pending input.
+  void set_drain_callback(std::function<void()> callback) {
+    drain_callback_ = std::move(callback);
+  }
+
 private:
   void kbd_update_irq();
   void kbd_update_kbd_irq(int level);
@@ -46,4 +54,6 @@ private:
   /* Bitmask of devices with data available.  */
   uint8_t pending_ = 0;
 
+  std::function<void()> drain_callback_;
+
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "bus/input_journal.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+
+namespace {
+
+// File layout: the magic, then records of a one byte tag followed by
+// - for input events: cycle (u64), code, scancode, action, mods (i32), x, y
+//   (f64)
+// - for device reads: address (u32), value (u8)
+// Fields are in host byte order.
+constexpr char kMagic[8] = {'C', '2', '5', '6', 'J', 'N', 'L', '1'};
+constexpr uint8_t kDeviceReadTag = 0x80;
+
+template <typename T>
+void Put(FILE* file, const T& value) {
+  fwrite(&value, sizeof(value), 1, file);
+}
+
+template <typename T>
+bool Get(FILE* file, T* value) {
+  return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+}  // namespace
+
+InputJournal::~InputJournal() { Stop(); }
+
+bool InputJournal::StartRecording(const std::string& path) {
+  Stop();
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    LOG(ERROR) << "Unable to create input journal: " << path;
+    return false;
+  }
+  fwrite(kMagic, sizeof(kMagic), 1, file_);
+  mode_ = Mode::kRecording;
+  LOG(INFO) << "Recording input to " << path;
+  return true;
+}
+
+bool InputJournal::StartReplay(const std::string& path) {
+  Stop();
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    LOG(ERROR) << "Unable to open input journal: " << path;
+    return false;
+  }
+  char magic[sizeof(kMagic)];
+  if (fread(magic, sizeof(magic), 1, file) != 1 ||
+      memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    LOG(ERROR) << "Not an input journal: " << path;
+    fclose(file);
+    return false;
+  }
+
+  uint8_t tag;
+  bool truncated = false;
+  while (Get(file, &tag)) {
+    if (tag == kDeviceReadTag) {
+      DeviceRead read;
+      uint32_t addr;
+      if (!Get(file, &addr) || !Get(file, &read.value)) {
+        truncated = true;
+        break;
+      }
+      read.addr = addr;
+      device_reads_.push_back(read);
+      continue;
+    }
+    Event event;
+    event.type = static_cast<Event::Type>(tag);
+    if (!Get(file, &event.cycle) || !Get(file, &event.code) ||
+        !Get(file, &event.scancode) || !Get(file, &event.action) ||
+        !Get(file, &event.mods) || !Get(file, &event.x) ||
+        !Get(file, &event.y)) {
+      truncated = true;
+      break;
+    }
+    inputs_.push_back(event);
+  }
+  fclose(file);
+  // A journal cut short by a crash is still worth replaying up to that point.
+  if (truncated)
+    LOG(WARNING) << "Input journal is truncated: " << path;
+
+  LOG(INFO) << "Replaying " << inputs_.size() << " input events and "
+            << device_reads_.size() << " device reads from " << path;
+  mode_ = Mode::kReplaying;
+  diverged_ = false;
+  return true;
+}
+
+void InputJournal::Stop() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+  inputs_.clear();
+  device_reads_.clear();
+  mode_ = Mode::kOff;
+}
+
+void InputJournal::RecordInput(const Event& event) {
+  if (!file_)
+    return;
+  Put(file_, static_cast<uint8_t>(event.type));
+  Put(file_, event.cycle);
+  Put(file_, event.code);
+  Put(file_, event.scancode);
+  Put(file_, event.action);
+  Put(file_, event.mods);
+  Put(file_, event.x);
+  Put(file_, event.y);
+}
+
+void InputJournal::RecordDeviceRead(cpuaddr_t addr, uint8_t value) {
+  if (!file_)
+    return;
+  Put(file_, kDeviceReadTag);
+  Put(file_, static_cast<uint32_t>(addr));
+  Put(file_, value);
+}
+
+std::optional<uint64_t> InputJournal::next_input_cycle() const {
+  if (inputs_.empty())
+    return std::nullopt;
+  return inputs_.front().cycle;
+}
+
+bool InputJournal::NextInput(uint64_t cycle, Event* event) {
+  if (inputs_.empty() || inputs_.front().cycle > cycle)
+    return false;
+  *event = inputs_.front();
+  inputs_.pop_front();
+  return true;
+}
+
+bool InputJournal::ReplayDeviceRead(cpuaddr_t addr, uint8_t* value) {
+  if (device_reads_.empty())
+    return false;
+  const DeviceRead& read = device_reads_.front();
+  if (read.addr != addr && !diverged_) {
+    LOG(WARNING) << "Replay diverged: journal read " << std::hex << read.addr
+                 << " but the guest read " << addr;
+    diverged_ = true;
+  }
+  *value = read.value;
+  device_reads_.pop_front();
+  return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <optional>
+#include <string>
+
+#include "cpu.h"
+
+// Records everything non-deterministic that reaches the guest -- host
+// keyboard and mouse events, and values read from devices backed by the host
+// (the RTC and the CH376 SD card) -- so a run can be replayed exactly.
+//
+// Input events carry the CPU cycle they were delivered at and are replayed
+// at the same cycle. Device reads are replayed in order, in place of reading
+// the device.
+class InputJournal {
+ public:
+  enum class Mode { kOff, kRecording, kReplaying };
+
+  struct Event {
+    enum class Type : uint8_t {
+      kKey = 1,
+      kMouseMove,
+      kMouseButton,
+      kMouseScroll,
+    };
+    uint64_t cycle;
+    Type type;
+    int32_t code = 0;  // GLFW key or mouse button.
+    int32_t scancode = 0;
+    int32_t action = 0;
+    int32_t mods = 0;
+    double x = 0;  // Mouse position or scroll offset.
+    double y = 0;
+  };
+
+  ~InputJournal();
+
+  bool StartRecording(const std::string& path);
+  // Loads the whole journal at 'path'.
+  bool StartReplay(const std::string& path);
+  // Stops recording (flushing the file) or replaying.
+  void Stop();
+
+  Mode mode() const { return mode_; }
+  bool recording() const { return mode_ == Mode::kRecording; }
+  bool replaying() const { return mode_ == Mode::kReplaying; }
+
+  void RecordInput(const Event& event);
+  void RecordDeviceRead(cpuaddr_t addr, uint8_t value);
+
+  // The cycle the next input event is due at, if there is one.
+  std::optional<uint64_t> next_input_cycle() const;
+  // Pops the next input event if it is due at or before 'cycle'.
+  bool NextInput(uint64_t cycle, Event* event);
+  // Returns false if the journal has no more device reads. Logs if the
+  // recorded read was from a different address, which means the replay has
+  // diverged.
+  bool ReplayDeviceRead(cpuaddr_t addr, uint8_t* value);
+
+ private:
+  struct DeviceRead {
+    cpuaddr_t addr;
+    uint8_t value;
+  };
+
+  Mode mode_ = Mode::kOff;
+  FILE* file_ = nullptr;
+  std::deque<Event> inputs_;
+  std::deque<DeviceRead> device_reads_;
+  bool diverged_ = false;
+};
@@ -0,0 +1,63 @@
+#include "bus/input_journal.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+TEST(InputJournalTest, ReplaysWhatWasRecorded) {
+  std::string path = testing::TempDir() + "input_journal_test.jnl";
+
+  InputJournal recorder;
+  ASSERT_TRUE(recorder.StartRecording(path));
+  InputJournal::Event key{1000, InputJournal::Event::Type::kKey};
+  key.code = 65;
+  key.action = 1;
+  recorder.RecordInput(key);
+  recorder.RecordDeviceRead(0xAFE808, 0x51);
+  InputJournal::Event move{2500, InputJournal::Event::Type::kMouseMove};
+  move.x = 12.5;
+  move.y = 40;
+  recorder.RecordInput(move);
+  recorder.RecordDeviceRead(0xAF0800, 0x42);
+  recorder.Stop();
+
+  InputJournal journal;
+  ASSERT_TRUE(journal.StartReplay(path));
+  EXPECT_TRUE(journal.replaying());
+  EXPECT_EQ(journal.next_input_cycle(), 1000u);
+
+  InputJournal::Event event;
+  EXPECT_FALSE(journal.NextInput(999, &event));
+  ASSERT_TRUE(journal.NextInput(1000, &event));
+  EXPECT_EQ(event.type, InputJournal::Event::Type::kKey);
+  EXPECT_EQ(event.code, 65);
+  EXPECT_EQ(event.action, 1);
+  ASSERT_TRUE(journal.NextInput(3000, &event));
+  EXPECT_EQ(event.type, InputJournal::Event::Type::kMouseMove);
+  EXPECT_EQ(event.cycle, 2500u);
+  EXPECT_EQ(event.x, 12.5);
+  EXPECT_FALSE(journal.next_input_cycle());
+
+  uint8_t value;
+  ASSERT_TRUE(journal.ReplayDeviceRead(0xAFE808, &value));
+  EXPECT_EQ(value, 0x51);
+  ASSERT_TRUE(journal.ReplayDeviceRead(0xAF0800, &value));
+  EXPECT_EQ(value, 0x42);
+  EXPECT_FALSE(journal.ReplayDeviceRead(0xAF0800, &value));
+
+  remove(path.c_str());
+}
+
+TEST(InputJournalTest, RejectsOtherFiles) {
+  std::string path = testing::TempDir() + "input_journal_bad.jnl";
+  FILE* file = fopen(path.c_str(), "wb");
+  ASSERT_TRUE(file);
+  fputs("not a journal", file);
+  fclose(file);
+
+  InputJournal journal;
+  EXPECT_FALSE(journal.StartReplay(path));
+  EXPECT_EQ(journal.mode(), InputJournal::Mode::kOff);
+  remove(path.c_str());
+}
@@ -1,151 +1,142 @@
 #include "bus/int_controller.h"
 
-#include "int_controller.h"
-#include "system.h"
+#include <utility>
 
 namespace {
 
 constexpr uint32_t kIntPendingReg0 = 0x0140;
-constexpr uint32_t kIntPendingReg1 = 0x0141;
 constexpr uint32_t kIntPendingReg2 = 0x0142;
 
 constexpr uint32_t kIntPolReg0 = 0x0144;
-constexpr uint32_t kIntPolReg1 = 0x0145;
 constexpr uint32_t kIntPolReg2 = 0x0146;
 
 constexpr uint32_t kIntEdgeReg0 = 0x0147;
-constexpr uint32_t kIntEdgeReg1 = 0x0148;
 constexpr uint32_t kIntEdgeReg2 = 0x0149;
 
 constexpr uint32_t kIntMaskReg0 = 0x014C;
-constexpr uint32_t kIntMaskReg1 = 0x014D;
 constexpr uint32_t kIntMaskReg2 = 0x014E;
 
-} // namespace
-
-InterruptController::InterruptController(System *sys) : sys_(sys) {
-  pending_reg0_.val = 0;
-  pending_reg1_.val = 0;
-  pending_reg2_.val = 0;
-  polarity_reg0_.val = 0;
-  polarity_reg1_.val = 0;
-  polarity_reg2_.val = 0;
-  edge_reg0_.val = 0;
-  edge_reg1_.val = 0;
-  edge_reg2_.val = 0;
-  mask_reg0_.val = 0;
-  mask_reg1_.val = 0;
-  mask_reg2_.val = 0;
-
-  pending_reg2_.ints.UNUSED0 = false;
-  pending_reg2_.ints.UNUSED1 = false;
-  polarity_reg2_.ints.UNUSED0 = false;
-  polarity_reg2_.ints.UNUSED1 = false;
-  edge_reg2_.ints.UNUSED0 = false;
-  edge_reg2_.ints.UNUSED1 = false;
-  mask_reg2_.ints.UNUSED0 = false;
-  mask_reg2_.ints.UNUSED1 = false;
+// Group 0.
+constexpr uint8_t kVicky0 = 1 << 0;  // Start of frame
+constexpr uint8_t kVicky1 = 1 << 1;  // Line compare
+constexpr uint8_t kTimer0 = 1 << 2;
+constexpr uint8_t kMouse = 1 << 7;
+
+// Group 1.
+constexpr uint8_t kKeyboard = 1 << 0;
+constexpr uint8_t kVicky2 = 1 << 1;  // Sprite collision
+constexpr uint8_t kVicky3 = 1 << 2;  // Tile collision
+constexpr uint8_t kCH376 = 1 << 7;  // sd card
+
+// Group 2.
+constexpr uint8_t kGavinDma = 1 << 3;
+
+}  // namespace
+
+InterruptController::InterruptController(Host host) : host_(std::move(host)) {}
+
+void InterruptController::SetInput(int group, uint8_t bit, bool level) {
+  uint8_t before = inputs_[group] ^ polarity_[group];
+  if (level)
+    inputs_[group] |= bit;
+  else
+    inputs_[group] &= ~bit;
+  uint8_t after = inputs_[group] ^ polarity_[group];
+  pending_[group] |= after & ~before & edge_[group];
+  Update();
 }
 
-bool InterruptController::AnyPending() const {
-  return pending_reg1_.ints.Pending() || pending_reg2_.ints.Pending() ||
-         pending_reg0_.ints.Pending();
+void InterruptController::Pulse(int group, uint8_t bit) {
+  SetInput(group, bit, true);
+  SetInput(group, bit, false);
+}
+
+void InterruptController::Update() {
+  bool line = false;
+  for (int group = 0; group < kGroups; group++) {
+    pending_[group] |= (inputs_[group] ^ polarity_[group]) & ~edge_[group];
+    line |= (pending_[group] & ~mask_[group]) != 0;
+  }
+  if (line == irq_line_)
+    return;
+  irq_line_ = line;
+  host_.set_irq(line);
 }
 
 void InterruptController::SetFrameStart(bool level) {
-  bool old_pending = AnyPending();
-  pending_reg0_.ints.vicky0 = level;
-  if (level && !old_pending) sys_->RaiseIRQ();
-  else if (!AnyPending() && old_pending) sys_->ClearIRQ();
+  SetInput(0, kVicky0, level);
 }
 
 void InterruptController::SetKeyboard(bool level) {
-  bool old_pending = AnyPending();
-  pending_reg1_.ints.kbd = level;
-  if (level && !old_pending) sys_->RaiseIRQ();
-  else if (!AnyPending() && old_pending) sys_->ClearIRQ();
+  SetInput(1, kKeyboard, level);
 }
 
 void InterruptController::SetMouse(bool level) {
-  bool old_pending = AnyPending();
-  pending_reg0_.ints.mouse = level;
-  if (level && !old_pending) sys_->RaiseIRQ();
-  else if (!AnyPending() && old_pending) sys_->ClearIRQ();
+  SetInput(0, kMouse, level);
 }
 
-
 void InterruptController::SetCH376(bool level) {
-  // TODO: fix the fact that the CH376 emulation never seems to drop the irq
-//  bool old_pending = AnyPending();
-  pending_reg1_.ints.ch376 = level;
-//  if (level && !old_pending) sys_->RaiseIRQ();
-//  else if (!AnyPending() && old_pending) sys_->ClearIRQ();
+  SetInput(1, kCH376, level);
+}
+
+void InterruptController::SetTimer(int timer, bool level) {
+  if (level)
+    Pulse(0, kTimer0 << timer);
+}
+
+void InterruptController::SetLineInterrupt(bool level) {
+  if (level)
+    Pulse(0, kVicky1);
+}
+
+void InterruptController::SetSpriteCollision(bool level) {
+  if (level)
+    Pulse(1, kVicky2);
+}
+
+void InterruptController::SetTileCollision(bool level) {
+  if (level)
+    Pulse(1, kVicky3);
 }
 
 void InterruptController::SetVDMATransfer(bool level) {
-  bool old_pending = AnyPending();
-  pending_reg2_.ints.gavin_dma = level;
-  if (level && !old_pending) sys_->RaiseIRQ();
-  else if (!AnyPending() && old_pending) sys_->ClearIRQ();
+  if (level)
+    Pulse(2, kGavinDma);
+}
+
+void InterruptController::SetSDMATransfer(bool level) {
+  SetVDMATransfer(level);
 }
 
 void InterruptController::StoreByte(uint32_t addr, uint8_t v) {
-  bool old_pending = AnyPending();
-  if (addr == kIntPendingReg0) {
-    pending_reg0_.val &= ~v;
-  } else if (addr == kIntPendingReg1) {
-    pending_reg1_.val &= ~v;
-  } else if (addr == kIntPendingReg2) {
-    pending_reg2_.val &= ~v;
-  } else if (addr == kIntPolReg0) {
-    polarity_reg0_.val &= ~v;
-  } else if (addr == kIntPolReg1) {
-    polarity_reg1_.val &= ~v;
-  } else if (addr == kIntPolReg2) {
-    polarity_reg2_.val &= ~v;
-  } else if (addr == kIntEdgeReg0) {
-    edge_reg0_.val &= ~v;
-  } else if (addr == kIntEdgeReg1) {
-    edge_reg1_.val &= ~v;
-  } else if (addr == kIntEdgeReg2) {
-    edge_reg2_.val &= ~v;
-  } else if (addr == kIntMaskReg0) {
-    mask_reg0_.val &= ~v;
-  } else if (addr == kIntMaskReg1) {
-    mask_reg1_.val &= ~v;
-  } else if (addr == kIntMaskReg2) {
-    mask_reg2_.val &= ~v;
-  }
-  if (old_pending && !AnyPending()) {
-    sys_->ClearIRQ();
+  if (addr >= kIntPendingReg0 && addr <= kIntPendingReg2) {
+    // Write 1 to clear.
+    pending_[addr - kIntPendingReg0] &= ~v;
+  } else if (addr >= kIntPolReg0 && addr <= kIntPolReg2) {
+    // Flipping the polarity of a held input is an edge too.
+    int group = addr - kIntPolReg0;
+    uint8_t before = inputs_[group] ^ polarity_[group];
+    polarity_[group] = v;
+    uint8_t after = inputs_[group] ^ polarity_[group];
+    pending_[group] |= after & ~before & edge_[group];
+  } else if (addr >= kIntEdgeReg0 && addr <= kIntEdgeReg2) {
+    edge_[addr - kIntEdgeReg0] = v;
+  } else if (addr >= kIntMaskReg0 && addr <= kIntMaskReg2) {
+    mask_[addr - kIntMaskReg0] = v;
+  } else {
+    return;
   }
+  Update();
 }
 
 uint8_t InterruptController::ReadByte(uint32_t addr) {
-  if (addr == kIntPendingReg0) {
-    return pending_reg0_.val;
-  } else if (addr == kIntPendingReg1) {
-    return pending_reg1_.val;
-  } else if (addr == kIntPendingReg2) {
-    return pending_reg2_.val;
-  } else if (addr == kIntPolReg0) {
-    return polarity_reg0_.val;
-  } else if (addr == kIntPolReg1) {
-    return polarity_reg1_.val;
-  } else if (addr == kIntPolReg2) {
-    return polarity_reg2_.val;
-  } else if (addr == kIntEdgeReg0) {
-    return edge_reg0_.val;
-  } else if (addr == kIntEdgeReg1) {
-    return edge_reg1_.val;
-  } else if (addr == kIntEdgeReg2) {
-    return edge_reg2_.val;
-  } else if (addr == kIntMaskReg0) {
-    return mask_reg0_.val;
-  } else if (addr == kIntMaskReg1) {
-    return mask_reg1_.val;
-  } else if (addr == kIntMaskReg2) {
-    return mask_reg2_.val;
-  }
+  if (addr >= kIntPendingReg0 && addr <= kIntPendingReg2)
+    return pending_[addr - kIntPendingReg0];
+  if (addr >= kIntPolReg0 && addr <= kIntPolReg2)
+    return polarity_[addr - kIntPolReg0];
+  if (addr >= kIntEdgeReg0 && addr <= kIntEdgeReg2)
+    return edge_[addr - kIntEdgeReg0];
+  if (addr >= kIntMaskReg0 && addr <= kIntMaskReg2)
+    return mask_[addr - kIntMaskReg0];
   return 0;
 }
@@ -2,99 +2,61 @@
 
 #include <stdint.h>
 
-class System;
-
-// TODO: polarity/edge/mask
+#include <functional>
+
+// The interrupt controller: three groups of eight sources, each with a
+// pending, polarity, edge and mask register.
+//
+// A source's input level, inverted where its polarity bit is set, latches
+// its pending bit: on a rising edge if its edge bit is set, otherwise for as
+// long as the input stays high (so clearing it while still asserted has no
+// effect). The IRQ line is the OR of pending & ~mask, recomputed with a few
+// bitwise operations; the host is only told about transitions.
 class InterruptController {
  public:
-  explicit InterruptController(System* sys);
+  // How the controller reaches the CPU.
+  struct Host {
+    // Raises or lowers the CPU's IRQ line.
+    std::function<void(bool level)> set_irq;
+  };
 
-  // Manage various specific interrupts.
+  explicit InterruptController(Host host);
+
+  // Manage various specific interrupts. These are levels, held until the
+  // source lowers them.
   void SetFrameStart(bool level);
   void SetKeyboard(bool level);
   void SetMouse(bool level);
   void SetCH376(bool level);
+
+  // These are events: 'level' true latches the interrupt, and the input
+  // then drops again by itself.
+  void SetTimer(int timer, bool level);
+  void SetLineInterrupt(bool level);
+  void SetSpriteCollision(bool level);
+  void SetTileCollision(bool level);
   void SetVDMATransfer(bool level);
+  // Both DMA engines report through Gavin's DMA interrupt.
+  void SetSDMATransfer(bool level);
 
   // SystemBusDevice implementation.
   void StoreByte(uint32_t addr, uint8_t v);
   uint8_t ReadByte(uint32_t addr);
 
  private:
-  bool AnyPending() const;
+  static constexpr int kGroups = 3;
 
-  union InterruptSet1 {
-    struct {
-      bool vicky0 : 1;  // Start of frame
-      bool vicky1 : 1;  // Line Interrupt
-      bool timer_0 : 1;
-      bool timer_1 : 1;
-      bool timer_2 : 1;
-      bool rtc : 1;
-      bool fdc : 1;
-      bool mouse : 1;
+  void SetInput(int group, uint8_t bit, bool level);
+  void Pulse(int group, uint8_t bit);
+  // Latches level-triggered inputs that are asserted, and updates the line.
+  void Update();
 
-      bool Pending() const {
-        return vicky0 || vicky1 || timer_0 || timer_1 || timer_2 || rtc || fdc;
-      }
-    } ints;
-    uint8_t val;
-  };
-
-  union InterruptSet2 {
-    struct {
-      ;
-      bool kbd : 1;
-      bool vicky2 : 1;  // Sprite collision
-      bool vicky3 : 1;  // tile collision
-      bool lpc_com2 : 1;
-      bool lpc_com1 : 1;
-      bool lpc_midi : 1;  // mpu-401
-      bool lpc_lpt : 1;
-      bool ch376 : 1;  // sd card
-
-      bool Pending() const {
-        return kbd || vicky2 || vicky3 || lpc_com2 || lpc_com1 || lpc_midi ||
-               lpc_lpt || ch376;
-      }
-    } ints;
-    uint8_t val;
-  };
-  union InterruptSet3 {
-    struct {
-      bool opl2_left_channel : 1;
-      bool opl2_right_channel : 1;
-      bool beatrix : 1;
-      bool gavin_dma : 1;
-      bool UNUSED0 : 1;  // Always 1
-      bool dac_hot_plug : 1;
-      bool expansion : 1;
-      bool UNUSED1 : 1;  // Always 1
+  Host host_;
 
-      bool Pending() const {
-        return opl2_left_channel || opl2_right_channel || beatrix ||
-               gavin_dma || dac_hot_plug || expansion;
-      }
-    } ints;
-    uint8_t val;
-  };
-
-  System* sys_;
-
-  InterruptSet1 pending_reg0_;
-  InterruptSet2 pending_reg1_;
-  InterruptSet3 pending_reg2_;
-
-  InterruptSet1 polarity_reg0_;
-  InterruptSet2 polarity_reg1_;
-  InterruptSet3 polarity_reg2_;
-
-  InterruptSet1 edge_reg0_;
-  InterruptSet2 edge_reg1_;
-  InterruptSet3 edge_reg2_;
-
-  InterruptSet1 mask_reg0_;
-  InterruptSet2 mask_reg1_;
-  InterruptSet3 mask_reg2_;
+  uint8_t inputs_[kGroups] = {};
+  uint8_t pending_[kGroups] = {};
+  uint8_t polarity_[kGroups] = {};
+  uint8_t edge_[kGroups] = {};
+  uint8_t mask_[kGroups] = {};
+  bool irq_line_ = false;
 };
-
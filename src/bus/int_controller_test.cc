@@ -0,0 +1,125 @@
+#include "bus/int_controller.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kPending0 = 0x140;
+constexpr uint32_t kPending1 = 0x141;
+constexpr uint32_t kPolarity0 = 0x144;
+constexpr uint32_t kEdge0 = 0x147;
+constexpr uint32_t kMask0 = 0x14C;
+constexpr uint32_t kMask1 = 0x14D;
+
+// Group 0.
+constexpr uint8_t kFrameStart = 1 << 0;
+constexpr uint8_t kTimer1 = 1 << 3;
+// Group 1.
+constexpr uint8_t kKeyboard = 1 << 0;
+constexpr uint8_t kCH376 = 1 << 7;
+
+class InterruptControllerTest : public testing::Test {
+ protected:
+  InterruptControllerTest()
+      : controller_(InterruptController::Host{
+            [this](bool level) { transitions_.push_back(level); }}) {}
+
+  std::vector<bool> transitions_;
+  InterruptController controller_;
+};
+
+TEST_F(InterruptControllerTest, LevelLatchesWhileAsserted) {
+  controller_.SetFrameStart(true);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+  EXPECT_EQ(std::vector<bool>{true}, transitions_);
+
+  // Clearing does nothing while the input is still high.
+  controller_.StoreByte(kPending0, kFrameStart);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+  EXPECT_EQ(std::vector<bool>{true}, transitions_);
+
+  controller_.SetFrameStart(false);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+  controller_.StoreByte(kPending0, kFrameStart);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+  EXPECT_EQ((std::vector<bool>{true, false}), transitions_);
+}
+
+TEST_F(InterruptControllerTest, EdgeLatchesOnRisingEdge) {
+  controller_.StoreByte(kEdge0, kFrameStart);
+  controller_.SetFrameStart(true);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+
+  // Cleared while held, it stays clear until the next rising edge.
+  controller_.StoreByte(kPending0, kFrameStart);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+  controller_.SetFrameStart(true);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+  controller_.SetFrameStart(false);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+  controller_.SetFrameStart(true);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+  EXPECT_EQ((std::vector<bool>{true, false, true}), transitions_);
+}
+
+TEST_F(InterruptControllerTest, EventsLatchOnce) {
+  controller_.SetTimer(1, true);
+  EXPECT_EQ(kTimer1, controller_.ReadByte(kPending0));
+  controller_.StoreByte(kPending0, kTimer1);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+  EXPECT_EQ((std::vector<bool>{true, false}), transitions_);
+}
+
+TEST_F(InterruptControllerTest, PolarityFlipOfAHeldInput) {
+  // Inverted, a low level input is asserted.
+  controller_.StoreByte(kPolarity0, kFrameStart);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+  controller_.StoreByte(kPolarity0, 0);
+  controller_.StoreByte(kPending0, kFrameStart);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+
+  // For an edge triggered input, the flip is the edge.
+  controller_.StoreByte(kEdge0, kFrameStart);
+  controller_.StoreByte(kPolarity0, kFrameStart);
+  EXPECT_EQ(kFrameStart, controller_.ReadByte(kPending0));
+  controller_.StoreByte(kPending0, kFrameStart);
+  controller_.StoreByte(kPolarity0, 0);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+  // Now raising the input is a falling edge after inversion.
+  controller_.StoreByte(kPolarity0, kFrameStart);
+  controller_.StoreByte(kPending0, kFrameStart);
+  controller_.SetFrameStart(true);
+  EXPECT_EQ(0, controller_.ReadByte(kPending0));
+}
+
+TEST_F(InterruptControllerTest, MaskDrivesTheLine) {
+  controller_.StoreByte(kMask1, 0xFF);
+  controller_.SetKeyboard(true);
+  EXPECT_EQ(kKeyboard, controller_.ReadByte(kPending1));
+  EXPECT_TRUE(transitions_.empty());
+
+  controller_.StoreByte(kMask1, static_cast<uint8_t>(~kKeyboard));
+  EXPECT_EQ(std::vector<bool>{true}, transitions_);
+  controller_.StoreByte(kMask1, 0xFF);
+  EXPECT_EQ((std::vector<bool>{true, false}), transitions_);
+
+  // Only unmasked sources count.
+  controller_.StoreByte(kMask0, static_cast<uint8_t>(~kFrameStart));
+  controller_.SetTimer(1, true);
+  EXPECT_EQ((std::vector<bool>{true, false}), transitions_);
+  controller_.SetFrameStart(true);
+  EXPECT_EQ((std::vector<bool>{true, false, true}), transitions_);
+}
+
+TEST_F(InterruptControllerTest, CH376DrivesTheLineUnmasked) {
+  controller_.SetCH376(true);
+  EXPECT_EQ(kCH376, controller_.ReadByte(kPending1));
+  EXPECT_EQ(std::vector<bool>{true}, transitions_);
+  controller_.SetCH376(false);
+  controller_.StoreByte(kPending1, kCH376);
+  EXPECT_EQ((std::vector<bool>{true, false}), transitions_);
+}
+
+}  // namespace
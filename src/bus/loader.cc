@@ -1,191 +1,315 @@
 #include "loader.h"
 
+#include <gflags/gflags.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstring>
 #include <experimental/filesystem>
 #include <fstream>
 #include <iomanip>
 #include <sstream>
 
+#include "bus/c256_system_bus.h"
+#include "bus/hash.h"
+#include "bus/mapped_file.h"
+
 namespace fs = std::experimental::filesystem;
 
+DEFINE_string(loader_cache_dir, "",
+              "Directory to cache parsed .hex/.s28 images in (off if empty)");
+
 namespace {
 
-uint8_t hstouc(std::string const &in) {
-  static const std::string v{"0123456789ABCDEF"};
+// Hex digit values indexed by character, -1 for non hex digits.
+constexpr std::array<int8_t, 256> kHexDigits = [] {
+  std::array<int8_t, 256> digits{};
+  for (auto &d : digits)
+    d = -1;
+  for (int c = 0; c < 10; c++)
+    digits['0' + c] = c;
+  for (int c = 0; c < 6; c++) {
+    digits['A' + c] = 10 + c;
+    digits['a' + c] = 10 + c;
+  }
+  return digits;
+}();
+
+// Largest record: a 255 byte payload plus count, address, type and checksum.
+constexpr size_t kMaxRecordSize = 255 + 5;
 
-  return (uint8_t)v.find(toupper(in[0])) * 16 + v.find(toupper(in[1]));
+bool DecodeHex(const char *in, size_t num_bytes, uint8_t *out) {
+  for (size_t i = 0; i < num_bytes; i++) {
+    int hi = kHexDigits[static_cast<uint8_t>(in[i * 2])];
+    int lo = kHexDigits[static_cast<uint8_t>(in[i * 2 + 1])];
+    if ((hi | lo) < 0)
+      return false;
+    out[i] = (hi << 4) | lo;
+  }
+  return true;
 }
 
-bool ReadHex(std::istream &line_stream, uint8_t *h) {
-  line_stream.width(2);
-  std::string byte_count_str;
-  line_stream >> std::setw(2) >> byte_count_str;
-  if (byte_count_str.size() != 2)
+// Split off the next line from [*pos, end), without its line terminator.
+bool NextLine(const char **pos, const char *end, const char **line,
+              size_t *len) {
+  if (*pos >= end)
     return false;
-  *h = hstouc(byte_count_str);
+  const char *eol =
+      static_cast<const char *>(memchr(*pos, '\n', end - *pos));
+  const char *next = eol ? eol + 1 : end;
+  if (!eol)
+    eol = end;
+  if (eol > *pos && eol[-1] == '\r')
+    eol--;
+  *line = *pos;
+  *len = eol - *pos;
+  *pos = next;
   return true;
 }
 
-std::istream &safeGetline(std::istream &is, std::string &t) {
-  t.clear();
-
-  // The characters in the stream are read one-by-one using a std::streambuf.
-  // That is faster than reading them one-by-one using the std::istream.
-  // Code that uses streambuf this way must be guarded by a sentry object.
-  // The sentry object performs various tasks,
-  // such as thread synchronization and updating the stream state.
-
-  std::istream::sentry se(is, true);
-  std::streambuf *sb = is.rdbuf();
-
-  for (;;) {
-    int c = sb->sbumpc();
-    switch (c) {
-    case '\n':
-      return is;
-    case '\r':
-      if (sb->sgetc() == '\n')
-        sb->sbumpc();
-      return is;
-    case std::streambuf::traits_type::eof():
-      // Also handle the case when the last line has no line ending
-      if (t.empty())
-        is.setstate(std::ios::eofbit);
-      return is;
-    default:
-      t += (char)c;
-    }
+// Parsed image cache. Each cached image is stored under a name derived from
+// the source path, and is only used if the source size, mtime and content
+// hash match, and it was written by the same version of the parsers.
+constexpr char kImageCacheMagic[8] = {'C', '2', '5', '6', 'I', 'M', 'G', '1'};
+
+// Bump whenever ParseIHex, ParseS28 or the cache layout change, so caches of
+// images parsed the old way are ignored.
+constexpr uint32_t kImageCacheVersion = 2;
+
+struct ImageCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_spans;
+  uint64_t source_size;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  uint64_t source_hash;
+};
+
+struct ImageCacheSpan {
+  uint32_t address;
+  uint32_t size;
+};
+
+std::string ImageCachePath(const std::string &filename) {
+  // FNV-1a of the absolute path.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : fs::absolute(filename).string()) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  std::stringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << hash << ".img";
+  return (fs::path(FLAGS_loader_cache_dir) / name.str()).string();
+}
+
+bool LoadCachedImage(const std::string &filename, const MappedFile &source,
+                     uint64_t source_hash, C256SystemBus *system_bus) {
+  MappedFile cache;
+  if (!cache.Open(ImageCachePath(filename)))
+    return false;
+
+  ImageCacheHeader header{};
+  if (cache.size() < sizeof(header))
+    return false;
+  memcpy(&header, cache.data(), sizeof(header));
+  if (memcmp(header.magic, kImageCacheMagic, sizeof(kImageCacheMagic)) ||
+      header.version != kImageCacheVersion ||
+      header.source_size != static_cast<uint64_t>(source.size()) ||
+      header.source_mtime_sec != source.stat().st_mtim.tv_sec ||
+      header.source_mtime_nsec != source.stat().st_mtim.tv_nsec ||
+      header.source_hash != source_hash) {
+    return false;
+  }
+
+  // Validate the whole index before touching memory.
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.num_spans; i++) {
+    ImageCacheSpan span;
+    if (cache.size() - offset < sizeof(span))
+      return false;
+    memcpy(&span, cache.data() + offset, sizeof(span));
+    offset += sizeof(span);
+    if (cache.size() - offset < span.size)
+      return false;
+    offset += span.size;
+  }
+
+  offset = sizeof(header);
+  for (uint32_t i = 0; i < header.num_spans; i++) {
+    ImageCacheSpan span;
+    memcpy(&span, cache.data() + offset, sizeof(span));
+    offset += sizeof(span);
+    system_bus->WriteBlock(span.address, cache.data() + offset, span.size);
+    offset += span.size;
+  }
+  LOG(INFO) << "Loaded cached image for: " << filename;
+  return true;
+}
+
+void SaveCachedImage(const std::string &filename, const MappedFile &source,
+                     uint64_t source_hash, const LoadImage &image) {
+  std::error_code ec;
+  fs::create_directories(FLAGS_loader_cache_dir, ec);
+  if (ec) {
+    LOG(ERROR) << "Unable to create cache dir: " << FLAGS_loader_cache_dir;
+    return;
+  }
+
+  // Write to a temporary and rename so concurrent emulators never observe a
+  // partially written cache file.
+  std::string cache_path = ImageCachePath(filename);
+  std::string tmp_path = cache_path + "." + std::to_string(getpid());
+  std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return;
+
+  // Value initialised, so the padding written out is zeroed too.
+  ImageCacheHeader header{};
+  memcpy(header.magic, kImageCacheMagic, sizeof(kImageCacheMagic));
+  header.version = kImageCacheVersion;
+  header.num_spans = image.spans.size();
+  header.source_size = source.size();
+  header.source_mtime_sec = source.stat().st_mtim.tv_sec;
+  header.source_mtime_nsec = source.stat().st_mtim.tv_nsec;
+  header.source_hash = source_hash;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const auto &span : image.spans) {
+    ImageCacheSpan cache_span{span.address,
+                              static_cast<uint32_t>(span.data.size())};
+    out.write(reinterpret_cast<const char *>(&cache_span), sizeof(cache_span));
+    out.write(reinterpret_cast<const char *>(span.data.data()),
+              span.data.size());
+  }
+  out.close();
+  if (!out || rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+    LOG(ERROR) << "Unable to write image cache: " << cache_path;
+    unlink(tmp_path.c_str());
   }
 }
 
 } // namespace
 
-bool LoadFromS28(const std::string &filename, SystemBus *system_bus) {
-  std::ifstream srec_stream;
-  srec_stream.open(filename);
-  while (!srec_stream.eof()) {
-    std::string line;
-    std::getline(srec_stream, line);
-    if (line.empty())
-      return true;
-    CHECK_EQ(line[0], 'S');
-    char rec_type = line[1];
+void LoadImage::Append(uint32_t address, const uint8_t *data, size_t size) {
+  if (!size)
+    return;
+  if (!spans.empty()) {
+    LoadSpan &last = spans.back();
+    if (last.address + last.data.size() == address) {
+      last.data.insert(last.data.end(), data, data + size);
+      return;
+    }
+  }
+  spans.push_back({address, std::vector<uint8_t>(data, data + size)});
+}
 
-    std::stringstream line_stream(line.substr(2));
+bool ParseS28(const char *begin, const char *end, LoadImage *image) {
+  uint8_t record[kMaxRecordSize];
+  const char *line;
+  size_t len;
+  int line_no = 0;
+  while (NextLine(&begin, end, &line, &len)) {
+    line_no++;
+    if (len == 0)
+      continue;
+    if (line[0] != 'S' || len < 4) {
+      LOG(ERROR) << "Invalid S-record in line #" << line_no;
+      return false;
+    }
 
-    // 24 bit data load
-    if (rec_type == '2') {
-      uint8_t byte_count;
+    // 16, 24 and 32 bit data loads; the header, count and start address
+    // records carry nothing to load.
+    size_t address_size;
+    switch (line[1]) {
+    case '1':
+      address_size = 2;
+      break;
+    case '2':
+      address_size = 3;
+      break;
+    case '3':
+      address_size = 4;
+      break;
+    default:
+      continue;
+    }
 
-      if (!ReadHex(line_stream, &byte_count)) {
-        LOG(ERROR) << "Bad format in " << filename
-                   << " (could not read byte count)";
-        return false;
-      }
-      if (byte_count * 2 != (uint16_t)line.size() - 5) {
-        LOG(ERROR) << "Bad format in " << filename << " (invalid byte count)";
-        return false;
-      }
-      uint8_t address[3];
-      if (!ReadHex(line_stream, &address[0]) ||
-          !ReadHex(line_stream, &address[1]) ||
-          !ReadHex(line_stream, &address[2])) {
-        LOG(ERROR) << "Bad format in " << filename
-                   << " (could not read address)";
-        return false;
-      };
-      byte_count -= 4;
-      uint32_t addr = address[0] << 16 | address[1] << 8 | address[2];
-      while (byte_count--) {
-        uint8_t byte;
-        if (!ReadHex(line_stream, &byte)) {
-          LOG(ERROR) << "Bad format in " << filename
-                     << " (could not read data byte)";
-          return false;
-        }
-
-        system_bus->WriteByte(addr++, byte);
-      }
-      uint8_t checksum;
-      if (!ReadHex(line_stream, &checksum)) {
-        LOG(ERROR) << "Bad format in " << filename
-                   << " (could not read checksum)";
-        return false;
-      }
+    size_t num_bytes = (len - 2) / 2;
+    if ((len - 2) % 2 || num_bytes > kMaxRecordSize ||
+        !DecodeHex(line + 2, num_bytes, record)) {
+      LOG(ERROR) << "Could not read hex value in line #" << line_no;
+      return false;
+    }
+    uint8_t byte_count = record[0];
+    if (byte_count + 1u != num_bytes || byte_count < address_size + 1) {
+      LOG(ERROR) << "Invalid byte count in line #" << line_no;
+      return false;
+    }
+    uint8_t sum = 0;
+    for (size_t i = 0; i < num_bytes; i++)
+      sum += record[i];
+    if (sum != 0xff) {
+      LOG(ERROR) << "Bad checksum in line #" << line_no;
+      return false;
     }
+    uint32_t address = 0;
+    for (size_t i = 0; i < address_size; i++)
+      address = (address << 8) | record[1 + i];
+    image->Append(address, record + 1 + address_size,
+                  byte_count - address_size - 1);
   }
   return true;
 }
 
-bool LoadFromIHex(const std::string &filename, SystemBus *system_bus) {
-  std::ifstream hex(filename);
-  if (!hex) {
-    LOG(ERROR) << "Unable to open file: " << filename;
-    return false;
-  }
+bool ParseIHex(const char *begin, const char *end, LoadImage *image) {
+  uint8_t record[kMaxRecordSize];
+  const char *line;
+  size_t len;
   int line_no = 0;
-  uint32_t page_addr = 0;
-  LOG(INFO) << "Loading: " << filename;
-  while (!hex.eof()) {
-    // Read record type.
-    std::string line;
-    safeGetline(hex, line);
-    if (line.empty())
-      break;
+  uint32_t base_addr = 0;
+  while (NextLine(&begin, end, &line, &len)) {
     line_no++;
+    if (len == 0)
+      continue;
     if (line[0] != ':') {
-      LOG(ERROR) << "Bad format in " << filename
-                 << "(Invalid start code in line #" << line_no << ": '" << line
-                 << "')";
+      LOG(ERROR) << "Invalid start code in line #" << line_no << ": '"
+                 << std::string(line, len) << "'";
       return false;
     }
-    std::stringstream line_stream(line.substr(1));
-    uint8_t sum = 0;
-
-    uint8_t byte_count;
-    if (!ReadHex(line_stream, &byte_count)) {
-      LOG(ERROR) << " Bad format in " << filename
-                 << " (could not read hex value)";
+    size_t num_bytes = (len - 1) / 2;
+    if ((len - 1) % 2 || num_bytes < 5 || num_bytes > kMaxRecordSize ||
+        !DecodeHex(line + 1, num_bytes, record)) {
+      LOG(ERROR) << "Could not read hex value in line #" << line_no;
+      return false;
+    }
+    uint8_t byte_count = record[0];
+    if (byte_count + 5u != num_bytes) {
+      LOG(ERROR) << "Bad byte count in line #" << line_no;
       return false;
     }
-    if ((byte_count * 2 != (uint16_t)line.size() - 11)) {
-      LOG(ERROR) << "Bad format in " << filename << " (bad byte count)";
+    uint8_t sum = 0;
+    for (size_t i = 0; i < num_bytes; i++)
+      sum += record[i];
+    if (sum != 0) {
+      LOG(ERROR) << "Bad checksum in line #" << line_no;
       return false;
     }
-    sum += byte_count;
-    uint8_t addr_hi, addr_low;
-    CHECK(ReadHex(line_stream, &addr_hi));
-    CHECK(ReadHex(line_stream, &addr_low));
-    sum += addr_hi;
-    sum += addr_low;
-    uint16_t address = (addr_hi << 8) | addr_low;
-    uint8_t record_type;
-    CHECK(ReadHex(line_stream, &record_type));
-    sum += record_type;
-    if (record_type == 1) { // EOF
+
+    uint16_t address = (record[1] << 8) | record[2];
+    uint8_t record_type = record[3];
+    const uint8_t *data = record + 4;
+    if (record_type == 0) { // DATA
+      image->Append(base_addr + address, data, byte_count);
+    } else if (record_type == 1) { // EOF
       return true;
-    } else if (record_type == 0) { // DATA
-      while (byte_count--) {
-        uint8_t data;
-        CHECK(ReadHex(line_stream, &data));
-        sum += data;
-        uint32_t addr = page_addr + (address++);
-
-        system_bus->WriteByte(addr, data);
-      }
-      uint8_t checksum;
-      CHECK(ReadHex(line_stream, &checksum));
-      checksum += sum;
-      CHECK_EQ(checksum, 0);
-    } else if (record_type == 4) { // Extended Linear Address
-      uint8_t page_addr_hi;
-      uint8_t page_addr_lo;
-      if (!ReadHex(line_stream, &page_addr_lo) ||
-          !ReadHex(line_stream, &page_addr_hi)) {
-        LOG(ERROR) << "Bad format in " << filename
-                   << " (could not read extended linear address)";
+    } else if (record_type == 2 || record_type == 4) { // Extended Address
+      if (byte_count != 2) {
+        LOG(ERROR) << "Could not read extended address in line #" << line_no;
         return false;
       }
-      page_addr = (page_addr_hi << 16) | (page_addr_lo << 8);
+      uint32_t ext_addr = (data[0] << 8) | data[1];
+      base_addr = record_type == 2 ? ext_addr << 4 : ext_addr << 16;
     }
   }
   return true;
@@ -193,29 +317,55 @@ bool LoadFromIHex(const std::string &filename, SystemBus *system_bus) {
 
 bool Loader::LoadFromHex(const std::string &filename) {
   fs::path path(filename);
+  bool (*parse)(const char *, const char *, LoadImage *);
   if (path.extension().string() == ".hex") {
-    return LoadFromIHex(filename, system_bus_);
+    parse = ParseIHex;
   } else if (path.extension().string() == ".s28") {
-    return LoadFromS28(filename, system_bus_);
+    parse = ParseS28;
   } else {
     LOG(ERROR) << "Unknown file format: " << path.extension();
     return false;
   }
+
+  MappedFile file;
+  if (!file.Open(filename)) {
+    LOG(ERROR) << "Unable to open file: " << filename;
+    return false;
+  }
+  LOG(INFO) << "Loading: " << filename;
+  bool use_cache = !FLAGS_loader_cache_dir.empty();
+  // Hashing the text is far cheaper than parsing it.
+  uint64_t source_hash = use_cache ? HashBytes(file.data(), file.size()) : 0;
+  if (use_cache &&
+      LoadCachedImage(filename, file, source_hash, system_bus_)) {
+    return true;
+  }
+
+  LoadImage image;
+  const char *text = reinterpret_cast<const char *>(file.data());
+  if (!parse(text, text + file.size(), &image)) {
+    LOG(ERROR) << "Bad format in " << filename;
+    return false;
+  }
+  WriteImage(image);
+  if (use_cache)
+    SaveCachedImage(filename, file, source_hash, image);
+  return true;
+}
+
+void Loader::WriteImage(const LoadImage &image) {
+  for (const auto &span : image.spans)
+    system_bus_->WriteBlock(span.address, span.data.data(), span.data.size());
 }
 
 bool Loader::LoadFromBin(const std::string &filename, uint32_t base_address) {
-  std::ifstream in_file(filename);
-  if (!in_file.is_open()) {
+  MappedFile file;
+  if (!file.Open(filename)) {
     LOG(ERROR) << "Unable to open file: " << filename;
     return false;
   }
-  uint32_t address = base_address;
-  char byte;
-  while (in_file.get(byte)) {
-    system_bus_->WriteByte(address, byte);
-    address++;
-  }
-  LOG(INFO) << "Done @ " << address;
+  system_bus_->WriteBlock(base_address, file.data(), file.size());
+  LOG(INFO) << "Done @ " << base_address + file.size();
   return true;
 }
 
@@ -444,12 +594,12 @@ bool Loader::LoadFromO65(const std::string &filename, uint32_t reloc_address,
     LOG(INFO) << "STACK: " << std::hex << stack;
 
   std::vector<uint8_t> program(tlen + dlen);
-  in_file.read(reinterpret_cast<char *>(program.data()), tlen);
+  in_file.read(reinterpret_cast<char *>(program.data()), tlen + dlen);
   CHECK(!in_file.eof());
 
   // Obtain the external (undefined) references list. This is meaningless for us
   // tho.
-  uint32_t num_references;
+  uint32_t num_references = 0;
   std::vector<std::string> external_references;
   in_file.read(reinterpret_cast<char *>(&num_references),
                header.mode.m.size ? 4 : 2);
@@ -462,52 +612,96 @@ bool Loader::LoadFromO65(const std::string &filename, uint32_t reloc_address,
     external_references.push_back(ref);
   }
 
-  // Now the relocation tables, the fun part
-  uint32_t reloc_offset = 0;
-  while (true) {
-    uint8_t offset = in_file.get();
-    if (offset == 0)
-      break;
-    if (offset == 0xff) {
-      reloc_offset += 0xfe;
-      continue;
-    }
-    reloc_offset += offset;
-    uint8_t type_seg = in_file.get();
-    RelocationType type = static_cast<RelocationType>(type_seg & 0xf0);
-    RelocationSegment segment = static_cast<RelocationSegment>(type_seg & 0x0f);
-    if (verbose)
-      LOG(INFO) << "RelocEntry: offset: " << std::hex << (int)reloc_offset
-                << " relative_offset:" << (int)offset << " type: " << (int)type
-                << " segment: " << (int)segment;
-    if (segment == TEXT_SEGMENT) { // text
-      DoReloc(tbase, reloc_address, in_file, &program, reloc_offset, type,
-              verbose);
-    } else if (segment == DATA_SEGMENT) { // data
-      DoReloc(dbase, reloc_address + tlen, in_file, &program, reloc_offset,
-              type, verbose);
-    } else if (segment == ZP_SEGMENT) { // zp
-      DoReloc(0, zpbase, in_file, &program, reloc_offset, type, verbose);
-    } else if (segment == BSS_SEGMENT) { // bss
-      DoReloc(bssbase, reloc_address + tlen + dlen, in_file, &program,
-              reloc_offset, type, verbose);
-    } else {
-      LOG(ERROR) << "Unhandled o65 segment: " << std::hex << (int)segment;
-      return false;
+  // Now the relocation tables, the fun part. There is one for the text
+  // segment followed by one for the data segment; offsets in each are relative
+  // to the start of their segment.
+  auto process_reloc_table = [&](uint32_t segment_offset) {
+    uint32_t reloc_offset = 0;
+    while (true) {
+      uint8_t offset = in_file.get();
+      if (offset == 0)
+        return true;
+      if (offset == 0xff) {
+        reloc_offset += 0xfe;
+        continue;
+      }
+      reloc_offset += offset;
+      uint8_t type_seg = in_file.get();
+      RelocationType type = static_cast<RelocationType>(type_seg & 0xf0);
+      RelocationSegment segment =
+          static_cast<RelocationSegment>(type_seg & 0x0f);
+      if (verbose)
+        LOG(INFO) << "RelocEntry: offset: " << std::hex << (int)reloc_offset
+                  << " relative_offset:" << (int)offset
+                  << " type: " << (int)type << " segment: " << (int)segment;
+      uint32_t program_offset = segment_offset + reloc_offset;
+      if (segment == TEXT_SEGMENT) { // text
+        DoReloc(tbase, reloc_address, in_file, &program, program_offset, type,
+                verbose);
+      } else if (segment == DATA_SEGMENT) { // data
+        DoReloc(dbase, reloc_address + tlen, in_file, &program, program_offset,
+                type, verbose);
+      } else if (segment == ZP_SEGMENT) { // zp
+        DoReloc(0, zpbase, in_file, &program, program_offset, type, verbose);
+      } else if (segment == BSS_SEGMENT) { // bss
+        DoReloc(bssbase, reloc_address + tlen + dlen, in_file, &program,
+                program_offset, type, verbose);
+      } else {
+        LOG(ERROR) << "Unhandled o65 segment: " << std::hex << (int)segment;
+        return false;
+      }
     }
   };
+  if (!process_reloc_table(0) || !process_reloc_table(tlen))
+    return false;
 
   // Now load the segments into memory.
-  int offset = 0;
-  for (offset = 0; offset < tlen + dlen; offset++)
-    system_bus_->WriteByte(reloc_address + offset, program[offset]);
+  system_bus_->WriteBlock(reloc_address, program.data(), tlen + dlen);
 
   // BSS
-  while (bsslen--) {
-    system_bus_->WriteByte(reloc_address + (offset++), 0);
-  }
+  std::vector<uint8_t> bss(bsslen, 0);
+  system_bus_->WriteBlock(reloc_address + tlen + dlen, bss.data(), bss.size());
 
   // Look for exported global symbols.
+  std::vector<LoadSymbol> exports;
+  uint32_t num_exports = 0;
+  in_file.read(reinterpret_cast<char *>(&num_exports),
+               header.mode.m.size ? 4 : 2);
+  while (in_file && num_exports--) {
+    std::string name;
+    char c;
+    while (in_file.get(c) && c) {
+      name.push_back(c);
+    }
+    uint8_t segment = in_file.get();
+    uint32_t value = 0;
+    in_file.read(reinterpret_cast<char *>(&value), header.mode.m.size ? 4 : 2);
+    if (!in_file)
+      break;
+    uint32_t address;
+    switch (segment) {
+    case TEXT_SEGMENT:
+      address = value - tbase + reloc_address;
+      break;
+    case DATA_SEGMENT:
+      address = value - dbase + reloc_address + tlen;
+      break;
+    case BSS_SEGMENT:
+      address = value - bssbase + reloc_address + tlen + dlen;
+      break;
+    case ZP_SEGMENT:
+      address = value;
+      break;
+    default:
+      // Absolute values are constants rather than addresses.
+      continue;
+    }
+    if (verbose)
+      LOG(INFO) << "Export: " << name << " = " << std::hex << address;
+    exports.push_back({name, address});
+  }
+  if (on_symbols_ && !exports.empty())
+    on_symbols_(exports);
 
   return true;
 }
@@ -2,13 +2,46 @@
 
 #include <glog/logging.h>
 
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "cpu.h"
 
+class C256SystemBus;
+
+// A contiguous run of bytes destined for one bus address.
+struct LoadSpan {
+  uint32_t address;
+  std::vector<uint8_t> data;
+};
+
+// The decoded contents of a HEX/S-record file, with consecutive records
+// coalesced into as few spans as possible.
+struct LoadImage {
+  std::vector<LoadSpan> spans;
+
+  void Append(uint32_t address, const uint8_t* data, size_t size);
+};
+
+// Decode an in-memory Intel HEX or Motorola S-record file.
+bool ParseIHex(const char* begin, const char* end, LoadImage* image);
+bool ParseS28(const char* begin, const char* end, LoadImage* image);
+
+// A symbol exported by a relocatable image, at its relocated address.
+struct LoadSymbol {
+  std::string name;
+  uint32_t address;
+};
+
 class Loader {
 public:
-  explicit Loader(SystemBus *system_bus) : system_bus_(system_bus) {}
+  // Called once per image with all of its exported symbols.
+  using SymbolCallback = std::function<void(const std::vector<LoadSymbol> &)>;
+
+  // 'on_symbols' may be null.
+  Loader(C256SystemBus *system_bus, SymbolCallback on_symbols = nullptr)
+      : system_bus_(system_bus), on_symbols_(std::move(on_symbols)) {}
 
   bool LoadFromHex(const std::string &filename);
   bool LoadFromBin(const std::string &filename, uint32_t base_address);
@@ -16,5 +49,8 @@ public:
                    bool verbose = true);
 
 private:
-  SystemBus *system_bus_;
-};
\ No newline at end of file
+  void WriteImage(const LoadImage &image);
+
+  C256SystemBus *system_bus_;
+  SymbolCallback on_symbols_;
+};
@@ -0,0 +1,66 @@
+#include "bus/loader.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace {
+
+bool ParseIHexString(const std::string& text, LoadImage* image) {
+  return ParseIHex(text.data(), text.data() + text.size(), image);
+}
+
+bool ParseS28String(const std::string& text, LoadImage* image) {
+  return ParseS28(text.data(), text.data() + text.size(), image);
+}
+
+}  // namespace
+
+TEST(LoaderTest, IHexCoalescesRecords) {
+  LoadImage image;
+  ASSERT_TRUE(ParseIHexString(
+      ":020000040018E2\r\n"
+      ":0400000001020304F2\r\n"
+      ":020004000506EF\r\n"
+      ":00000001FF\r\n",
+      &image));
+  ASSERT_EQ(image.spans.size(), 1u);
+  EXPECT_EQ(image.spans[0].address, 0x180000u);
+  EXPECT_EQ(image.spans[0].data,
+            std::vector<uint8_t>({0x01, 0x02, 0x03, 0x04, 0x05, 0x06}));
+}
+
+TEST(LoaderTest, IHexSplitsDiscontiguousRecords) {
+  LoadImage image;
+  ASSERT_TRUE(ParseIHexString(
+      ":0100000011EE\n"
+      ":0100100022CD\n"
+      ":00000001FF\n",
+      &image));
+  ASSERT_EQ(image.spans.size(), 2u);
+  EXPECT_EQ(image.spans[0].address, 0x0000u);
+  EXPECT_EQ(image.spans[1].address, 0x0010u);
+  EXPECT_EQ(image.spans[1].data, std::vector<uint8_t>({0x22}));
+}
+
+TEST(LoaderTest, IHexRejectsBadChecksum) {
+  LoadImage image;
+  EXPECT_FALSE(ParseIHexString(":0100000011EF\n", &image));
+}
+
+TEST(LoaderTest, IHexRejectsBadDigits) {
+  LoadImage image;
+  EXPECT_FALSE(ParseIHexString(":01000000G1EE\n", &image));
+}
+
+TEST(LoaderTest, S28DataRecords) {
+  LoadImage image;
+  ASSERT_TRUE(ParseS28String(
+      "S00600004844521B\n"
+      "S2071900000A0B0CBE\n"
+      "S804000000FB\n",
+      &image));
+  ASSERT_EQ(image.spans.size(), 1u);
+  EXPECT_EQ(image.spans[0].address, 0x190000u);
+  EXPECT_EQ(image.spans[0].data, std::vector<uint8_t>({0x0A, 0x0B, 0x0C}));
+}
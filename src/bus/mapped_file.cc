@@ -0,0 +1,50 @@
+#include "bus/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const std::string& path, bool copy_on_write) {
+  Close();
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return false;
+  }
+  if (fstat(fd_, &stat_) != 0 || !S_ISREG(stat_.st_mode)) {
+    Close();
+    return false;
+  }
+  size_ = stat_.st_size;
+  copy_on_write_ = copy_on_write;
+  if (size_ == 0) {
+    // mmap refuses zero length mappings; an empty file is still valid.
+    return true;
+  }
+  int prot = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* addr = mmap(nullptr, size_, prot, MAP_PRIVATE, fd_, 0);
+  if (addr == MAP_FAILED) {
+    PLOG(ERROR) << "Unable to map: " << path;
+    Close();
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(addr);
+  madvise(data_, size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  size_ = 0;
+  stat_ = {};
+}
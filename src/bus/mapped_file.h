@@ -0,0 +1,35 @@
+#pragma once
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A read-only (or private copy-on-write) memory mapping of a host file.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Map the file at 'path'. If 'copy_on_write' is set the mapping is writable
+  // but private; modifications are never written back to the host file.
+  bool Open(const std::string& path, bool copy_on_write = false);
+  void Close();
+
+  bool is_open() const { return fd_ >= 0; }
+  const uint8_t* data() const { return data_; }
+  uint8_t* mutable_data() { return copy_on_write_ ? data_ : nullptr; }
+  size_t size() const { return size_; }
+  const struct stat& stat() const { return stat_; }
+
+ private:
+  int fd_ = -1;
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  bool copy_on_write_ = false;
+  struct stat stat_ {};
+};
@@ -26,6 +26,9 @@ public:
   virtual void ps2_common_reset();
   virtual void ps2_common_post_load();
 
+  // Bytes waiting to be read by the host.
+  int queue_count() const { return queue_.count; }
+
   int32_t write_cmd;
 
 private:
@@ -52,6 +55,9 @@ public:
   void ps2_write_keyboard(int val);
   void ps2_keyboard_set_translation(int mode);
 
+  // Key events are dropped until the host enables scanning.
+  bool scan_enabled() const { return scan_enabled_; }
+
 private:
   bool scan_enabled_;
   int translate_;
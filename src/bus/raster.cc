@@ -0,0 +1,78 @@
+#include "bus/raster.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "bus/vicky_def.h"
+
+Raster::Raster(Host host, uint16_t line, uint16_t total_lines,
+               uint16_t line_dots)
+    : host_(std::move(host)),
+      line_(line),
+      total_lines_(total_lines),
+      line_dots_(line_dots) {}
+
+uint16_t Raster::Column() const {
+  uint64_t scanline = host_.scanline();
+  uint64_t start = host_.scanline_cycle(scanline);
+  uint64_t length = host_.scanline_cycle(scanline + 1) - start;
+  uint64_t now = host_.now();
+  if (now < start || length == 0)
+    return 0;
+  return std::min<uint64_t>((now - start) * line_dots_ / length,
+                            line_dots_ - 1);
+}
+
+uint16_t Raster::NextLine() {
+  line_ = (line_ + 1) % total_lines_;
+  return line_;
+}
+
+void Raster::SetMode(uint16_t total_lines, uint16_t line_dots) {
+  total_lines_ = total_lines;
+  line_dots_ = line_dots;
+  line_ = total_lines_ - 1;
+}
+
+void Raster::set_irq_ctrl(uint8_t v) {
+  irq_ctrl_ = v & (Line_Irq_Enable0 | Line_Irq_Enable1);
+  Reschedule();
+}
+
+void Raster::set_compare(int index, uint16_t line) {
+  compare_[index] = line;
+  Reschedule();
+}
+
+void Raster::Reschedule() { ScheduleInterrupt(host_.scanline(), line_); }
+
+void Raster::ScheduleInterrupt(uint64_t scanline, uint16_t line) {
+  uint64_t generation = ++generation_;
+  uint16_t distance = 0;
+  for (int i = 0; i < 2; i++) {
+    if (!(irq_ctrl_ & (Line_Irq_Enable0 << i)) || compare_[i] >= total_lines_)
+      continue;
+    uint16_t d = (compare_[i] + total_lines_ - line) % total_lines_;
+    if (d == 0)
+      d = total_lines_;
+    if (distance == 0 || d < distance)
+      distance = d;
+  }
+  if (distance == 0)
+    return;
+
+  uint64_t target_scanline = scanline + distance;
+  uint16_t target_line = (line + distance) % total_lines_;
+  uint64_t deadline = host_.scanline_cycle(target_scanline);
+  uint64_t now = host_.now();
+  host_.schedule(deadline > now ? deadline - now : 0,
+                 [this, generation, target_scanline, target_line]() {
+                   if (generation != generation_)
+                     return;
+                   host_.interrupt();
+                   // Carry on from the matched line rather than the
+                   // displayed one, which may not have advanced yet if the
+                   // scanline event runs after us.
+                   ScheduleInterrupt(target_scanline, target_line);
+                 });
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// The beam's position within the frame, and the line compare interrupts
+// timed from it. Lines count vertical blanking after the visible ones and
+// advance with the System's scanlines.
+class Raster {
+ public:
+  // How the raster reaches the rest of the machine.
+  struct Host {
+    // Runs 'event' on the CPU thread 'delay_cycles' CPU cycles from now.
+    std::function<void(uint64_t delay_cycles, std::function<void()> event)>
+        schedule;
+    // Raises the line interrupt.
+    std::function<void()> interrupt;
+    // The current CPU cycle.
+    std::function<uint64_t()> now;
+    // The System scanline being displayed now.
+    std::function<uint64_t()> scanline;
+    // The CPU cycle System scanline 'scanline' starts at.
+    std::function<uint64_t(uint64_t scanline)> scanline_cycle;
+  };
+
+  // Starts on 'line' of a frame 'total_lines' long, with 'line_dots' dots
+  // to a line.
+  Raster(Host host, uint16_t line, uint16_t total_lines, uint16_t line_dots);
+
+  // The line being displayed and the dot the beam is at on it.
+  uint16_t row() const { return line_; }
+  uint16_t Column() const;
+
+  // Moves to the next line, as the System's scanline advances.
+  uint16_t NextLine();
+
+  // Takes up a new mode's timing, on the last line of its frame. Call
+  // Reschedule() once the System's scanlines are retimed to match.
+  void SetMode(uint16_t total_lines, uint16_t line_dots);
+
+  // The line interrupt control register: Line_Irq_Enable0 and
+  // Line_Irq_Enable1 enable the two compares.
+  uint8_t irq_ctrl() const { return irq_ctrl_; }
+  void set_irq_ctrl(uint8_t v);
+  uint16_t compare(int index) const { return compare_[index]; }
+  void set_compare(int index, uint16_t line);
+
+  // Schedules the next enabled compare match, dropping any earlier one.
+  void Reschedule();
+
+ private:
+  // Schedules the next match after 'line', which is displayed at System
+  // scanline 'scanline'.
+  void ScheduleInterrupt(uint64_t scanline, uint16_t line);
+
+  Host host_;
+  uint16_t line_;
+  uint16_t total_lines_;
+  uint16_t line_dots_;
+
+  uint8_t irq_ctrl_ = 0;
+  uint16_t compare_[2]{};
+  // Bumped to invalidate scheduled interrupts.
+  uint64_t generation_ = 0;
+};
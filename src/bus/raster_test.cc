@@ -0,0 +1,136 @@
+#include "bus/raster.h"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "bus/vicky_def.h"
+
+namespace {
+
+// A 640x480 frame, with an easy number of CPU cycles to a scanline.
+constexpr uint16_t kTotalLines = 525;
+constexpr uint16_t kLineDots = 800;
+constexpr uint64_t kLineCycles = 100;
+
+class RasterTest : public testing::Test {
+ protected:
+  RasterTest()
+      : raster_(Raster::Host{[this](uint64_t delay_cycles,
+                                    std::function<void()> event) {
+                               events_.emplace(now_ + delay_cycles,
+                                               std::move(event));
+                             },
+                             [this]() {
+                               interrupts_.push_back(
+                                   {now_, raster_.row(), raster_.Column()});
+                             },
+                             [this]() { return now_; },
+                             [this]() { return scanline_; },
+                             [](uint64_t scanline) {
+                               return scanline * kLineCycles;
+                             }},
+                kTotalLines - 1, kTotalLines, kLineDots) {}
+
+  // Runs scanlines and events up to 'cycle', as System does. A scanline
+  // runs before an event due at the same cycle.
+  void RunUntil(uint64_t cycle) {
+    for (;;) {
+      uint64_t next_line = (scanline_ + 1) * kLineCycles;
+      bool event_first =
+          !events_.empty() && events_.begin()->first < next_line;
+      uint64_t next = event_first ? events_.begin()->first : next_line;
+      if (next > cycle)
+        break;
+      now_ = next;
+      if (event_first) {
+        auto event = std::move(events_.begin()->second);
+        events_.erase(events_.begin());
+        event();
+      } else {
+        scanline_++;
+        raster_.NextLine();
+      }
+    }
+    now_ = cycle;
+  }
+
+  struct Interrupt {
+    uint64_t cycle;
+    uint16_t row;
+    uint16_t column;
+  };
+
+  uint64_t now_ = 0;
+  uint64_t scanline_ = 0;
+  std::multimap<uint64_t, std::function<void()>> events_;
+  std::vector<Interrupt> interrupts_;
+  Raster raster_;
+};
+
+TEST_F(RasterTest, ColumnFollowsTheCycle) {
+  RunUntil(20 * kLineCycles + kLineCycles / 2);
+  // Frames start on the last line, so scanline 20 shows line 19.
+  EXPECT_EQ(19, raster_.row());
+  EXPECT_EQ(kLineDots / 2, raster_.Column());
+  RunUntil(21 * kLineCycles);
+  EXPECT_EQ(20, raster_.row());
+  EXPECT_EQ(0, raster_.Column());
+}
+
+TEST_F(RasterTest, InterruptsAtTheStartOfTheComparedLine) {
+  raster_.set_compare(0, 10);
+  raster_.set_irq_ctrl(Line_Irq_Enable0);
+  // Line 10 is displayed at scanline 11.
+  RunUntil(12 * kLineCycles);
+  ASSERT_EQ(1u, interrupts_.size());
+  EXPECT_EQ(11 * kLineCycles, interrupts_[0].cycle);
+  EXPECT_EQ(10, interrupts_[0].row);
+  EXPECT_EQ(0, interrupts_[0].column);
+
+  // And again a frame later.
+  RunUntil((11 + kTotalLines) * kLineCycles);
+  ASSERT_EQ(2u, interrupts_.size());
+  EXPECT_EQ((11 + kTotalLines) * kLineCycles, interrupts_[1].cycle);
+  EXPECT_EQ(10, interrupts_[1].row);
+}
+
+TEST_F(RasterTest, CompareSetMidLine) {
+  RunUntil(20 * kLineCycles + kLineCycles / 2);
+  raster_.set_irq_ctrl(Line_Irq_Enable1);
+  raster_.set_compare(1, 30);
+  RunUntil(40 * kLineCycles);
+  ASSERT_EQ(1u, interrupts_.size());
+  EXPECT_EQ(31 * kLineCycles, interrupts_[0].cycle);
+  EXPECT_EQ(30, interrupts_[0].row);
+  EXPECT_EQ(0, interrupts_[0].column);
+}
+
+TEST_F(RasterTest, NearestOfBothCompares) {
+  raster_.set_compare(0, 100);
+  raster_.set_compare(1, 50);
+  raster_.set_irq_ctrl(Line_Irq_Enable0 | Line_Irq_Enable1);
+  RunUntil(200 * kLineCycles);
+  ASSERT_EQ(2u, interrupts_.size());
+  EXPECT_EQ(50, interrupts_[0].row);
+  EXPECT_EQ(100, interrupts_[1].row);
+
+  raster_.set_irq_ctrl(0);
+  RunUntil((200 + kTotalLines) * kLineCycles);
+  EXPECT_EQ(2u, interrupts_.size());
+}
+
+TEST_F(RasterTest, CompareOnTheCurrentLineWaitsAFrame) {
+  RunUntil(5 * kLineCycles + 10);
+  raster_.set_compare(0, 4);
+  raster_.set_irq_ctrl(Line_Irq_Enable0);
+  RunUntil((5 + kTotalLines) * kLineCycles);
+  ASSERT_EQ(1u, interrupts_.size());
+  EXPECT_EQ((5 + kTotalLines) * kLineCycles, interrupts_[0].cycle);
+  EXPECT_EQ(4, interrupts_[0].row);
+}
+
+}  // namespace
@@ -2,6 +2,8 @@
 
 #include <glog/logging.h>
 
+#include "bus/hash.h"
+
 bool ReadRegister(uint32_t addr,
                   const std::vector<Reg>& registers,
                   uint8_t* v) {
@@ -31,3 +33,9 @@ bool StoreRegister(uint32_t addr,
   }
   return false;
 }
+
+uint64_t HashRegisters(const std::vector<Reg>& registers, uint64_t seed) {
+  for (const auto& reg : registers)
+    seed = HashBytes(reg.reg_ptr, reg.byte_width, seed);
+  return seed;
+}
@@ -12,3 +12,6 @@ struct Reg {
 bool ReadRegister(uint32_t addr, const std::vector<Reg>& registers, uint8_t* v);
 
 bool StoreRegister(uint32_t addr, uint8_t v, const std::vector<Reg>& registers);
+
+// Hashes the current values of 'registers', for comparing device state.
+uint64_t HashRegisters(const std::vector<Reg>& registers, uint64_t seed);
@@ -0,0 +1,204 @@
+#include "bus/scaler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Blends 'a' towards 'b' by 'weight' 256ths (0-255). Red and blue, then
+// green and alpha, are done together in one multiply each: their 8-bit
+// lanes are 16 bits apart, so the products don't collide.
+inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t weight) {
+  uint32_t keep = 256 - weight;
+  uint32_t rb = (((a & 0x00FF00FF) * keep + (b & 0x00FF00FF) * weight) >> 8) &
+                0x00FF00FF;
+  uint32_t ga =
+      (((a >> 8) & 0x00FF00FF) * keep + ((b >> 8) & 0x00FF00FF) * weight) &
+      0xFF00FF00;
+  return rb | ga;
+}
+
+// The source position, in 16.16 fixed point, of the centre of each of
+// 'dst_size' destination pixels, clamped to the source.
+std::vector<int32_t> SamplePositions(int src_size, int dst_size) {
+  std::vector<int32_t> positions(dst_size);
+  for (int i = 0; i < dst_size; i++) {
+    int64_t pos = (int64_t(2 * i + 1) * src_size << 16) / (2 * dst_size) -
+                  (1 << 15);
+    positions[i] = std::clamp<int64_t>(pos, 0, int64_t(src_size - 1) << 16);
+  }
+  return positions;
+}
+
+}  // namespace
+
+bool ParseScalingQuality(const std::string& name, ScalingQuality* quality) {
+  if (name == "nearest")
+    *quality = ScalingQuality::NEAREST;
+  else if (name == "linear")
+    *quality = ScalingQuality::LINEAR;
+  else if (name == "best")
+    *quality = ScalingQuality::BEST;
+  else
+    return false;
+  return true;
+}
+
+void ScaleNearest(const uint32_t* src, int src_width, int src_height,
+                  uint32_t* dst, int dst_width, int dst_height) {
+  std::vector<int> columns(dst_width);
+  for (int x = 0; x < dst_width; x++)
+    columns[x] = int64_t(x) * src_width / dst_width;
+
+  int last_row = -1;
+  for (int y = 0; y < dst_height; y++) {
+    int row = int64_t(y) * src_height / dst_height;
+    uint32_t* out = dst + y * dst_width;
+    if (row == last_row) {
+      memcpy(out, out - dst_width, dst_width * sizeof(uint32_t));
+      continue;
+    }
+    const uint32_t* in = src + row * src_width;
+    for (int x = 0; x < dst_width; x++)
+      out[x] = in[columns[x]];
+    last_row = row;
+  }
+}
+
+void ScaleBilinear(const uint32_t* src, int src_width, int src_height,
+                   uint32_t* dst, int dst_width, int dst_height) {
+  std::vector<int32_t> columns = SamplePositions(src_width, dst_width);
+  std::vector<int32_t> rows = SamplePositions(src_height, dst_height);
+
+  // Each source row pair is blended vertically into 'blended' once, then
+  // sampled horizontally.
+  std::vector<uint32_t> blended(src_width);
+  for (int y = 0; y < dst_height; y++) {
+    int row = rows[y] >> 16;
+    uint32_t weight = (rows[y] >> 8) & 0xFF;
+    const uint32_t* top = src + row * src_width;
+    const uint32_t* bottom =
+        src + std::min(row + 1, src_height - 1) * src_width;
+    for (int x = 0; x < src_width; x++)
+      blended[x] = Lerp(top[x], bottom[x], weight);
+
+    uint32_t* out = dst + y * dst_width;
+    for (int x = 0; x < dst_width; x++) {
+      int column = columns[x] >> 16;
+      int next = std::min(column + 1, src_width - 1);
+      out[x] = Lerp(blended[column], blended[next], (columns[x] >> 8) & 0xFF);
+    }
+  }
+}
+
+void Scale2x(const uint32_t* src, int width, int height, uint32_t* dst) {
+  for (int y = 0; y < height; y++) {
+    const uint32_t* row = src + y * width;
+    const uint32_t* above = y > 0 ? row - width : row;
+    const uint32_t* below = y < height - 1 ? row + width : row;
+    uint32_t* out0 = dst + 2 * y * 2 * width;
+    uint32_t* out1 = out0 + 2 * width;
+    for (int x = 0; x < width; x++) {
+      uint32_t b = above[x];
+      uint32_t d = row[x > 0 ? x - 1 : x];
+      uint32_t e = row[x];
+      uint32_t f = row[x < width - 1 ? x + 1 : x];
+      uint32_t h = below[x];
+      // Only fill in a corner where two neighbours meet along an edge.
+      if (b != h && d != f) {
+        out0[2 * x] = d == b ? d : e;
+        out0[2 * x + 1] = b == f ? f : e;
+        out1[2 * x] = d == h ? d : e;
+        out1[2 * x + 1] = h == f ? f : e;
+      } else {
+        out0[2 * x] = out0[2 * x + 1] = out1[2 * x] = out1[2 * x + 1] = e;
+      }
+    }
+  }
+}
+
+FrameScaler::FrameScaler(bool threaded) {
+  if (threaded)
+    thread_ = std::thread(&FrameScaler::Run, this);
+}
+
+FrameScaler::~FrameScaler() {
+  if (!threaded())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void FrameScaler::Scale(const uint32_t* frame, int width, int height,
+                        int dst_width, int dst_height,
+                        ScalingQuality quality) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return !busy_; });
+  input_.assign(frame, frame + width * height);
+  width_ = width;
+  height_ = height;
+  dst_width_ = dst_width;
+  dst_height_ = dst_height;
+  quality_ = quality;
+  if (!threaded()) {
+    ScaleInput();
+    return;
+  }
+  busy_ = true;
+  cv_.notify_all();
+}
+
+const uint32_t* FrameScaler::Wait(int* width, int* height) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return !busy_; });
+  *width = dst_width_;
+  *height = dst_height_;
+  return output_.data();
+}
+
+void FrameScaler::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return busy_ || exit_; });
+    if (exit_)
+      return;
+    // Scale() and Wait() block while busy_, so the buffers are ours.
+    lock.unlock();
+    ScaleInput();
+    lock.lock();
+    busy_ = false;
+    cv_.notify_all();
+  }
+}
+
+void FrameScaler::ScaleInput() {
+  output_.resize(dst_width_ * dst_height_);
+  const uint32_t* src = input_.data();
+  int width = width_;
+  int height = height_;
+
+  if (quality_ == ScalingQuality::BEST) {
+    // Scale2x as far as the target allows, then interpolate what's left.
+    for (int i = 0; width * 2 <= dst_width_ && height * 2 <= dst_height_;
+         i ^= 1) {
+      scratch_[i].resize(width * height * 4);
+      Scale2x(src, width, height, scratch_[i].data());
+      src = scratch_[i].data();
+      width *= 2;
+      height *= 2;
+    }
+  }
+
+  if (width == dst_width_ && height == dst_height_) {
+    memcpy(output_.data(), src, output_.size() * sizeof(uint32_t));
+  } else if (quality_ == ScalingQuality::NEAREST) {
+    ScaleNearest(src, width, height, output_.data(), dst_width_, dst_height_);
+  } else {
+    ScaleBilinear(src, width, height, output_.data(), dst_width_,
+                  dst_height_);
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How frames are scaled for display: NEAREST repeats pixels, LINEAR
+// interpolates between them, and BEST smooths edges with Scale2x before
+// interpolating the remainder.
+enum class ScalingQuality { NEAREST, LINEAR, BEST };
+
+// Parses "nearest", "linear" or "best". False for anything else.
+bool ParseScalingQuality(const std::string& name, ScalingQuality* quality);
+
+// Image scalers over 32-bit BGRA pixels, rows packed without padding. They
+// work on integers only, two channels per 32-bit multiply, in loops simple
+// enough for the compiler to vectorize.
+void ScaleNearest(const uint32_t* src, int src_width, int src_height,
+                  uint32_t* dst, int dst_width, int dst_height);
+void ScaleBilinear(const uint32_t* src, int src_width, int src_height,
+                   uint32_t* dst, int dst_width, int dst_height);
+// Doubles both dimensions; 'dst' is 2 * width by 2 * height.
+void Scale2x(const uint32_t* src, int width, int height, uint32_t* dst);
+
+// Scales whole frames, either in the caller or on a thread of its own.
+class FrameScaler {
+ public:
+  explicit FrameScaler(bool threaded);
+  ~FrameScaler();
+
+  bool threaded() const { return thread_.joinable(); }
+
+  // Starts scaling 'frame'. Threaded, the frame is copied and scaled in the
+  // background; otherwise it's done by the time this returns. Either way the
+  // result is collected with Wait().
+  void Scale(const uint32_t* frame, int width, int height, int dst_width,
+             int dst_height, ScalingQuality quality);
+
+  // Returns the last frame scaled, waiting for it if need be, and its size.
+  // Valid until the next Scale().
+  const uint32_t* Wait(int* width, int* height);
+
+ private:
+  void Run();
+  void ScaleInput();
+
+  std::vector<uint32_t> input_;
+  int width_ = 0;
+  int height_ = 0;
+  int dst_width_ = 0;
+  int dst_height_ = 0;
+  ScalingQuality quality_ = ScalingQuality::NEAREST;
+
+  std::vector<uint32_t> output_;
+  // Scale2x passes for BEST.
+  std::vector<uint32_t> scratch_[2];
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool busy_ = false;
+  bool exit_ = false;
+  std::thread thread_;
+};
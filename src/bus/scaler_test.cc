@@ -0,0 +1,55 @@
+#include "bus/scaler.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+TEST(ScalerTest, NearestAndBilinear) {
+  const uint32_t src[] = {0xFF000000, 0xFF0000FF};
+
+  std::vector<uint32_t> nearest(4);
+  ScaleNearest(src, 2, 1, nearest.data(), 4, 1);
+  EXPECT_EQ(nearest, std::vector<uint32_t>(
+                         {0xFF000000, 0xFF000000, 0xFF0000FF, 0xFF0000FF}));
+
+  // Samples fall a quarter of a source pixel either side of each source
+  // pixel's centre, clamped to the edges.
+  std::vector<uint32_t> linear(4);
+  ScaleBilinear(src, 2, 1, linear.data(), 4, 1);
+  EXPECT_EQ(linear[0], 0xFF000000u);
+  EXPECT_EQ(linear[1], 0xFF00003Fu);
+  EXPECT_EQ(linear[2], 0xFF0000BFu);
+  EXPECT_EQ(linear[3], 0xFF0000FFu);
+}
+
+TEST(ScalerTest, Scale2xSmoothsDiagonals) {
+  // A diagonal edge: the corners along it take the neighbouring colour,
+  // where pixel doubling would leave steps.
+  constexpr uint32_t X = 1, o = 0;
+  const uint32_t src[] = {X, o,  //
+                          X, X};
+  std::vector<uint32_t> dst(16);
+  Scale2x(src, 2, 2, dst.data());
+  EXPECT_EQ(dst, std::vector<uint32_t>({X, X, o, o,  //
+                                        X, X, X, o,  //
+                                        X, X, X, X,  //
+                                        X, X, X, X}));
+
+  FrameScaler scaler(true);
+  scaler.Scale(src, 2, 2, 4, 4, ScalingQuality::BEST);
+  int width, height;
+  const uint32_t* scaled = scaler.Wait(&width, &height);
+  EXPECT_EQ(width, 4);
+  EXPECT_EQ(height, 4);
+  EXPECT_EQ(std::vector<uint32_t>(scaled, scaled + 16), dst);
+}
+
+TEST(ScalerTest, ParsesQualityNames) {
+  ScalingQuality quality = ScalingQuality::NEAREST;
+  EXPECT_TRUE(ParseScalingQuality("best", &quality));
+  EXPECT_EQ(quality, ScalingQuality::BEST);
+  EXPECT_TRUE(ParseScalingQuality("linear", &quality));
+  EXPECT_EQ(quality, ScalingQuality::LINEAR);
+  EXPECT_FALSE(ParseScalingQuality("bicubic", &quality));
+  EXPECT_EQ(quality, ScalingQuality::LINEAR);
+}
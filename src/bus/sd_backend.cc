@@ -0,0 +1,289 @@
+#include "bus/sd_backend.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+DEFINE_int32(sd_flush_interval_ms, 1000,
+             "Write buffered SD card writes back to the host at least this "
+             "often, in emulated time, while a file is being written");
+DEFINE_string(sd_fsync, "never",
+              "When to fsync SD card files written on the host: never, close, "
+              "or always (on every flush)");
+DEFINE_bool(sd_inotify, true,
+            "Use inotify to notice changes to host directories listed by the "
+            "SD card; otherwise directory mtimes are compared, which is "
+            "deterministic but misses files being rewritten in place");
+
+namespace fs = std::experimental::filesystem;
+
+namespace {
+
+// Sequential writes are coalesced up to this size before going to the host.
+constexpr size_t kWriteBufferSize = 64 * 1024;
+
+// Fills an 8.3 name from a host file name: up to 8 characters before the
+// first dot and 3 after the last, NUL padded.
+void ToShortName(const std::string& name, char short_name[11]) {
+  memset(short_name, 0, 11);
+  size_t dot = name.find('.');
+  std::string base = name.substr(0, dot);
+  memcpy(short_name, base.data(), std::min<size_t>(base.size(), 8));
+  if (dot == std::string::npos)
+    return;
+  std::string extension = name.substr(name.rfind('.') + 1);
+  memcpy(short_name + 8, extension.data(),
+         std::min<size_t>(extension.size(), 3));
+}
+
+class HostFile : public SdFile {
+ public:
+  HostFile(FILE* f, uint32_t size, bool writable)
+      : f_(f), size_(size), writable_(writable) {}
+
+  ~HostFile() override {
+    Flush();
+    if (writable_ && FLAGS_sd_fsync != "never")
+      fsync(fileno(f_));
+    fclose(f_);
+  }
+
+  uint32_t size() const override { return size_; }
+
+  size_t Read(uint32_t offset, uint8_t* data, size_t size) override {
+    // Pending writes have to reach the file before it can be read back.
+    if (!pending_.empty() && offset < pending_offset_ + pending_.size() &&
+        offset + size > pending_offset_ && !Flush()) {
+      return 0;
+    }
+    // Reads are almost always sequential, so only seek when they aren't.
+    if (offset != position_ && fseek(f_, offset, SEEK_SET) != 0)
+      return 0;
+    size_t read = fread(data, 1, size, f_);
+    position_ = offset + read;
+    return read;
+  }
+
+  size_t Write(uint32_t offset, const uint8_t* data, size_t size) override {
+    if (!writable_)
+      return 0;
+    if (!pending_.empty() && offset != pending_offset_ + pending_.size())
+      Flush();
+    if (pending_.empty())
+      pending_offset_ = offset;
+    pending_.insert(pending_.end(), data, data + size);
+    size_ = std::max<uint32_t>(size_, offset + size);
+    if (pending_.size() >= kWriteBufferSize)
+      Flush();
+    return size;
+  }
+
+  bool Flush() override {
+    if (pending_.empty())
+      return true;
+    // Always seek: stdio needs one between a read and a write, even when
+    // the position is already right.
+    bool ok = fseek(f_, pending_offset_, SEEK_SET) == 0 &&
+              fwrite(pending_.data(), 1, pending_.size(), f_) ==
+                  pending_.size() &&
+              fflush(f_) == 0;
+    if (!ok) {
+      LOG(ERROR) << "Unable to write back to SD card file: "
+                 << strerror(errno);
+      position_ = UINT32_MAX;  // Unknown; the next access seeks.
+      pending_.clear();
+      return false;
+    }
+    position_ = pending_offset_ + pending_.size();
+    pending_.clear();
+    if (FLAGS_sd_fsync == "always")
+      fsync(fileno(f_));
+    return true;
+  }
+
+  FILE* f_;
+  uint32_t size_;
+  bool writable_;
+  uint32_t position_ = 0;
+
+  uint32_t pending_offset_ = 0;
+  std::vector<uint8_t> pending_;
+};
+
+}  // namespace
+
+HostDirectoryBackend::HostDirectoryBackend(const std::string& root)
+    : root_(root) {
+  if (FLAGS_sd_inotify) {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0)
+      LOG(ERROR) << "inotify unavailable, using directory mtimes instead";
+  }
+}
+
+HostDirectoryBackend::~HostDirectoryBackend() {
+  if (inotify_fd_ >= 0)
+    close(inotify_fd_);
+}
+
+bool HostDirectoryBackend::HostPath(const std::string& path,
+                                    fs::path* host_path) const {
+  // The guest picks the path, so resolve "." and ".." here, and refuse
+  // anything that climbs out of the root.
+  std::vector<std::string> components;
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = std::min(path.find('/', start), path.size());
+    std::string component = path.substr(start, end - start);
+    start = end + 1;
+    if (component.empty() || component == ".")
+      continue;
+    if (component == "..") {
+      if (components.empty()) {
+        LOG(ERROR) << "SD card path outside the card: " << path;
+        return false;
+      }
+      components.pop_back();
+      continue;
+    }
+    components.push_back(component);
+  }
+  *host_path = root_;
+  for (const std::string& component : components)
+    *host_path /= component;
+  return true;
+}
+
+std::unique_ptr<SdFile> HostDirectoryBackend::Open(const std::string& path) {
+  fs::path host_path;
+  if (!HostPath(path, &host_path))
+    return nullptr;
+  std::error_code error;
+  if (!fs::is_regular_file(host_path, error))
+    return nullptr;
+  uint32_t size = fs::file_size(host_path, error);
+  if (error)
+    return nullptr;
+  // Open for update where the host allows it, so the guest can write back.
+  bool writable = true;
+  FILE* f = fopen(host_path.string().c_str(), "r+b");
+  if (!f) {
+    writable = false;
+    f = fopen(host_path.string().c_str(), "rb");
+  }
+  if (!f) {
+    LOG(ERROR) << "Unable to open SD card file: " << host_path;
+    return nullptr;
+  }
+  return std::make_unique<HostFile>(f, size, writable);
+}
+
+std::unique_ptr<SdFile> HostDirectoryBackend::Create(const std::string& path) {
+  fs::path host_path;
+  if (!HostPath(path, &host_path))
+    return nullptr;
+  std::error_code error;
+  if (fs::is_directory(host_path, error))
+    return nullptr;
+  FILE* f = fopen(host_path.string().c_str(), "w+b");
+  if (!f) {
+    LOG(ERROR) << "Unable to create SD card file: " << host_path;
+    return nullptr;
+  }
+  return std::make_unique<HostFile>(f, 0, true);
+}
+
+bool HostDirectoryBackend::IsDirectory(const std::string& path) {
+  fs::path host_path;
+  std::error_code error;
+  return HostPath(path, &host_path) && fs::is_directory(host_path, error);
+}
+
+bool HostDirectoryBackend::ListDirectory(
+    const std::string& path, std::vector<SdDirectoryEntry>* entries) {
+  fs::path host_path;
+  if (!HostPath(path, &host_path))
+    return false;
+  std::error_code error;
+  fs::directory_iterator it(host_path, error);
+  if (error)
+    return false;
+  entries->clear();
+  for (; it != fs::directory_iterator(); it.increment(error)) {
+    std::string name = it->path().filename().string();
+    if (name[0] == '.')
+      continue;
+    SdDirectoryEntry entry;
+    ToShortName(name, entry.name);
+    entry.directory = fs::is_directory(it->status());
+    entry.size = entry.directory ? 0 : fs::file_size(it->path(), error);
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+bool HostDirectoryBackend::DirectoryVersion(const std::string& path,
+                                            uint64_t* version) {
+  fs::path resolved;
+  if (!HostPath(path, &resolved))
+    return false;
+  std::string host_path = resolved.string();
+  if (inotify_fd_ < 0) {
+    struct stat st;
+    if (stat(host_path.c_str(), &st) != 0)
+      return false;
+    *version = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+    return true;
+  }
+
+  ReadInotifyEvents();
+  auto found = watches_.find(host_path);
+  if (found == watches_.end()) {
+    // The listing taken after this will be newer than the watch, so nothing
+    // can be missed in between.
+    int watch = inotify_add_watch(
+        inotify_fd_, host_path.c_str(),
+        IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |
+            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (watch < 0)
+      return false;
+    found = watches_.emplace(host_path, watch).first;
+    generations_[watch] = next_generation_++;
+  }
+  *version = generations_[found->second];
+  return true;
+}
+
+void HostDirectoryBackend::ReadInotifyEvents() {
+  alignas(struct inotify_event) char buffer[4096];
+  ssize_t size;
+  while ((size = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+    for (char* p = buffer; p < buffer + size;) {
+      auto* event = reinterpret_cast<struct inotify_event*>(p);
+      if (event->mask & IN_IGNORED) {
+        // The directory went away; it will be watched afresh if it's back.
+        generations_.erase(event->wd);
+        for (auto it = watches_.begin(); it != watches_.end(); ++it) {
+          if (it->second == event->wd) {
+            watches_.erase(it);
+            break;
+          }
+        }
+      } else if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost; assume everything changed.
+        for (auto& generation : generations_)
+          generation.second = next_generation_++;
+      } else {
+        generations_[event->wd] = next_generation_++;
+      }
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
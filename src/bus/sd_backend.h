@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <experimental/filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One entry of a directory listing, as the CH376 reports it.
+struct SdDirectoryEntry {
+  char name[11];  // 8.3 name, space or NUL padded, without the dot.
+  bool directory;
+  uint32_t size;
+};
+
+// An open file on the SD card. Reads and writes are positional; the CH376
+// tracks the file pointer itself. Anything still buffered is written back
+// when the file is destroyed.
+class SdFile {
+ public:
+  virtual ~SdFile() = default;
+
+  virtual uint32_t size() const = 0;
+  // Returns the number of bytes read, short at the end of the file.
+  virtual size_t Read(uint32_t offset, uint8_t* data, size_t size) = 0;
+  // Returns the number of bytes written, growing the file as needed. Files
+  // on read-only backends write nothing.
+  virtual size_t Write(uint32_t offset, const uint8_t* data, size_t size) {
+    return 0;
+  }
+  // Writes back anything buffered. Returns false if that failed.
+  virtual bool Flush() { return true; }
+};
+
+// The storage behind the CH376. Paths are the guest's, e.g. "/GAMES/A.BIN",
+// relative to the root of the card.
+class SdBackend {
+ public:
+  virtual ~SdBackend() = default;
+
+  // Returns null if there is no file at 'path' (or it is a directory).
+  virtual std::unique_ptr<SdFile> Open(const std::string& path) = 0;
+  virtual bool IsDirectory(const std::string& path) = 0;
+  // Creates the file at 'path', or truncates an existing one. Returns null
+  // on failure, or if the backend is read-only.
+  virtual std::unique_ptr<SdFile> Create(const std::string& path) {
+    return nullptr;
+  }
+  // Lists the directory at 'path', leaving out '.' entries and hidden
+  // files. Returns false if it isn't a directory.
+  virtual bool ListDirectory(const std::string& path,
+                             std::vector<SdDirectoryEntry>* entries) = 0;
+  // Sets '*version' to a value that changes whenever the listing of the
+  // directory at 'path' might have, so listings can be cached. Returns false
+  // if that can't be tracked, in which case nothing should be cached.
+  virtual bool DirectoryVersion(const std::string& path, uint64_t* version) {
+    return false;
+  }
+};
+
+// Serves files straight out of a directory on the host. Writes are collected
+// in a write-back buffer per file, which is flushed when it fills, when the
+// file is closed, or when the CH376 flushes it -sd_flush_interval_ms (of
+// emulated time) after a write. -sd_fsync picks when flushes also fsync.
+//
+// Directory changes are tracked with inotify, or with the directory's mtime
+// when -sd_inotify is off. The mtime doesn't change when a file is merely
+// rewritten, but unlike inotify it doesn't depend on when the host delivers
+// events, so two emulators checking the same directory agree.
+class HostDirectoryBackend : public SdBackend {
+ public:
+  explicit HostDirectoryBackend(const std::string& root);
+  ~HostDirectoryBackend() override;
+
+  std::unique_ptr<SdFile> Open(const std::string& path) override;
+  bool IsDirectory(const std::string& path) override;
+  std::unique_ptr<SdFile> Create(const std::string& path) override;
+  bool ListDirectory(const std::string& path,
+                     std::vector<SdDirectoryEntry>* entries) override;
+  bool DirectoryVersion(const std::string& path, uint64_t* version) override;
+
+ private:
+  // Maps a guest path to the host, resolving "." and "..". False if the
+  // path leads outside the root.
+  bool HostPath(const std::string& path,
+                std::experimental::filesystem::path* host_path) const;
+  // Bumps the generation of every watch that has seen events.
+  void ReadInotifyEvents();
+
+  std::experimental::filesystem::path root_;
+
+  int inotify_fd_ = -1;
+  std::unordered_map<std::string, int> watches_;  // Host path to watch.
+  std::unordered_map<int, uint64_t> generations_;  // Watch to generation.
+  uint64_t next_generation_ = 1;
+};
@@ -0,0 +1,82 @@
+#include "bus/sd_backend.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <string>
+
+namespace {
+
+// A new, empty directory, so nothing is left over from earlier runs.
+std::string FreshDirectory() {
+  std::string path = testing::TempDir() + "/sd_backend_XXXXXX";
+  if (!mkdtemp(&path[0]))
+    ADD_FAILURE() << "Unable to create a directory in " << testing::TempDir();
+  return path;
+}
+
+}  // namespace
+
+TEST(HostDirectoryBackendTest, WritesBackOnReadAndClose) {
+  HostDirectoryBackend backend(FreshDirectory());
+  std::unique_ptr<SdFile> file = backend.Create("/SAVE.DAT");
+  ASSERT_TRUE(file);
+  const uint8_t data[] = {'h', 'e', 'l', 'l', 'o'};
+  EXPECT_EQ(file->Write(0, data, 3), 3u);
+  EXPECT_EQ(file->Write(3, data + 3, 2), 2u);
+  EXPECT_EQ(file->size(), 5u);
+
+  // Reading back what is still buffered flushes it first.
+  uint8_t read[8] = {};
+  EXPECT_EQ(file->Read(1, read, sizeof(read)), 4u);
+  EXPECT_EQ(std::string(reinterpret_cast<char*>(read), 4), "ello");
+
+  EXPECT_EQ(file->Write(5, data, 5), 5u);
+  file.reset();
+
+  file = backend.Open("/SAVE.DAT");
+  ASSERT_TRUE(file);
+  EXPECT_EQ(file->size(), 10u);
+  EXPECT_EQ(file->Read(4, read, sizeof(read)), 6u);
+  EXPECT_EQ(std::string(reinterpret_cast<char*>(read), 6), "ohello");
+}
+
+TEST(HostDirectoryBackendTest, DirectoryVersionChanges) {
+  HostDirectoryBackend backend(FreshDirectory());
+  uint64_t before, after;
+  ASSERT_TRUE(backend.DirectoryVersion("/", &before));
+  ASSERT_TRUE(backend.DirectoryVersion("/", &after));
+  EXPECT_EQ(before, after);
+
+  backend.Create("/NEW.DAT");
+  ASSERT_TRUE(backend.DirectoryVersion("/", &after));
+  EXPECT_NE(before, after);
+  EXPECT_FALSE(backend.DirectoryVersion("/MISSING", &after));
+}
+
+TEST(HostDirectoryBackendTest, StaysInsideTheRoot) {
+  std::string outside = FreshDirectory();
+  std::string root = outside + "/card";
+  ASSERT_EQ(mkdir(root.c_str(), 0755), 0);
+  FILE* f = fopen((outside + "/SECRET.TXT").c_str(), "w");
+  ASSERT_TRUE(f);
+  fputs("secret", f);
+  fclose(f);
+
+  HostDirectoryBackend backend(root);
+  EXPECT_FALSE(backend.Open("/../SECRET.TXT"));
+  EXPECT_FALSE(backend.Create("/../SECRET.TXT"));
+  EXPECT_FALSE(backend.Create("/SUB/../../SECRET.TXT"));
+  EXPECT_FALSE(backend.IsDirectory("/.."));
+  std::vector<SdDirectoryEntry> entries;
+  EXPECT_FALSE(backend.ListDirectory("/..", &entries));
+
+  // ".." that stays inside is fine.
+  ASSERT_TRUE(backend.Create("/NEW.DAT"));
+  EXPECT_TRUE(backend.Open("/./SUB/../NEW.DAT"));
+
+  struct stat info;
+  ASSERT_EQ(stat((outside + "/SECRET.TXT").c_str(), &info), 0);
+  EXPECT_EQ(info.st_size, 6);
+}
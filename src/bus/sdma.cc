@@ -0,0 +1,54 @@
+#include "bus/sdma.h"
+
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t kSdmaControlReg = 0x180;
+
+// The largest linear transfer the hardware accepts.
+constexpr uint32_t kMaxSize = 0x400000;
+
+// The engine moves one byte per system clock.
+constexpr uint64_t kCyclesPerByte = 1;
+
+}  // namespace
+
+SDMA::SDMA(Host host)
+    : DmaEngine("SDMA", kSdmaControlReg, host),
+      read_(std::move(host.read)),
+      write_(std::move(host.write)) {}
+
+void SDMA::CheckTransfer(uint32_t bytes) {
+  status_reg_.reg.size_err |= bytes > kMaxSize;
+}
+
+uint64_t SDMA::TransferCycles(uint32_t bytes) const {
+  return bytes * kCyclesPerByte;
+}
+
+void SDMA::Transfer() {
+  bool fill = ctrl_reg_.reg.trf_fill;
+  if (!ctrl_reg_.reg.linear_block) {
+    // Linear ("1d") transfer.
+    buffer_.resize(size_.linear.size);
+    if (fill)
+      memset(buffer_.data(), write_byte_, buffer_.size());
+    else
+      read_(src_addr_, buffer_.data(), buffer_.size());
+    write_(dst_addr_, buffer_.data(), buffer_.size());
+    return;
+  }
+
+  // Block ("2d") transfer, a row at a time.
+  uint16_t width = size_.block.x_size;
+  buffer_.resize(width);
+  if (fill)
+    memset(buffer_.data(), write_byte_, width);
+  for (uint32_t y = 0; y < size_.block.y_size; y++) {
+    if (!fill)
+      read_(src_addr_ + y * src_stride_, buffer_.data(), width);
+    write_(dst_addr_ + y * dst_stride_, buffer_.data(), width);
+  }
+}
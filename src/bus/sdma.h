@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "bus/dma_engine.h"
+
+// The system DMA engine at 0x180: linear and 2D copies and fills between
+// any addresses on the system bus (RAM to RAM, RAM to VRAM and back). Data
+// is moved through the bus page table a page at a time, at a byte per
+// system clock.
+class SDMA : public DmaEngine {
+ public:
+  struct Host : DmaEngine::Host {
+    // Copy to and from the system bus.
+    std::function<void(uint32_t addr, uint8_t* data, size_t size)> read;
+    std::function<void(uint32_t addr, const uint8_t* data, size_t size)>
+        write;
+  };
+
+  explicit SDMA(Host host);
+
+ private:
+  void CheckTransfer(uint32_t bytes) override;
+  void Transfer() override;
+  uint64_t TransferCycles(uint32_t bytes) const override;
+
+  std::function<void(uint32_t addr, uint8_t* data, size_t size)> read_;
+  std::function<void(uint32_t addr, const uint8_t* data, size_t size)> write_;
+
+  // Staging for one transfer, so overlapping copies behave like memmove.
+  std::vector<uint8_t> buffer_;
+};
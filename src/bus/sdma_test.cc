@@ -0,0 +1,134 @@
+#include "bus/sdma.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+#include "bus/dma_engine_test.h"
+
+namespace {
+
+// The whole 24 bit bus, as plain memory.
+constexpr uint32_t kMemorySize = 0x1000000;
+
+class SDMATest : public DmaEngineTest {
+ protected:
+  SDMATest()
+      : DmaEngineTest(0x180),
+        memory_(kMemorySize),
+        sdma_(SDMA::Host{
+            MakeHost(),
+            [this](uint32_t addr, uint8_t* data, size_t size) {
+              memcpy(data, &memory_[addr], size);
+            },
+            [this](uint32_t addr, const uint8_t* data, size_t size) {
+              memcpy(&memory_[addr], data, size);
+            }}) {
+    engine_ = &sdma_;
+    for (size_t i = 0; i < memory_.size(); i++)
+      memory_[i] = i * 13;
+  }
+
+  std::vector<uint8_t> memory_;
+  SDMA sdma_;
+};
+
+}  // namespace
+
+TEST_F(SDMATest, LinearCopy) {
+  std::vector<uint8_t> before = memory_;
+  Store(kSrcAddr, 0x1000, 3);
+  Store(kDstAddr, 0xB00000, 3);
+  Store(kSize, 300, 4);
+  Start(0);
+
+  for (int i = 0; i < 300; i++)
+    ASSERT_EQ(memory_[0xB00000 + i], before[0x1000 + i]) << i;
+  EXPECT_EQ(memory_[0xB00000 + 300], before[0xB00000 + 300]);
+}
+
+TEST_F(SDMATest, OverlappingCopyActsLikeMemmove) {
+  std::vector<uint8_t> before = memory_;
+  Store(kSrcAddr, 0x2000, 3);
+  Store(kDstAddr, 0x2001, 3);
+  Store(kSize, 16, 4);
+  Start(0);
+
+  for (int i = 0; i < 16; i++)
+    ASSERT_EQ(memory_[0x2001 + i], before[0x2000 + i]) << i;
+}
+
+TEST_F(SDMATest, LinearFill) {
+  std::vector<uint8_t> before = memory_;
+  Store(kFillByte, 0xAB, 1);
+  Store(kDstAddr, 0x3000, 3);
+  Store(kSize, 100, 4);
+  Start(kFill);
+
+  for (int i = 0; i < 100; i++)
+    ASSERT_EQ(memory_[0x3000 + i], 0xAB) << i;
+  EXPECT_EQ(memory_[0x3000 + 100], before[0x3000 + 100]);
+}
+
+TEST_F(SDMATest, BlockCopy) {
+  std::vector<uint8_t> before = memory_;
+  Store(kSrcAddr, 0x100, 3);
+  Store(kDstAddr, 0xB10000, 3);
+  Store(kSize, 4 | (3 << 16), 4);  // 4 wide, 3 high.
+  Store(kSrcStride, 640, 2);
+  Store(kDstStride, 800, 2);
+  Start(kBlock);
+
+  for (int y = 0; y < 3; y++) {
+    for (int x = 0; x < 4; x++)
+      EXPECT_EQ(memory_[0xB10000 + y * 800 + x], before[0x100 + y * 640 + x]);
+    // Nothing past the end of each row.
+    EXPECT_EQ(memory_[0xB10000 + y * 800 + 4], before[0xB10000 + y * 800 + 4]);
+  }
+  EXPECT_EQ(memory_[0xB10000 + 3 * 800], before[0xB10000 + 3 * 800]);
+}
+
+TEST_F(SDMATest, BlockFill) {
+  std::vector<uint8_t> before = memory_;
+  Store(kFillByte, 0x5A, 1);
+  Store(kDstAddr, 0x8000, 3);
+  Store(kSize, 2 | (2 << 16), 4);
+  Store(kDstStride, 100, 2);
+  Start(kBlock | kFill);
+
+  for (int y = 0; y < 2; y++) {
+    EXPECT_EQ(memory_[0x8000 + y * 100], 0x5A);
+    EXPECT_EQ(memory_[0x8000 + y * 100 + 1], 0x5A);
+    EXPECT_EQ(memory_[0x8000 + y * 100 + 2], before[0x8000 + y * 100 + 2]);
+  }
+}
+
+TEST_F(SDMATest, CompletesAfterTheTransferTime) {
+  Store(kDstAddr, 0x4000, 3);
+  Store(kSize, 16 | (4 << 16), 4);
+  Store(kDstStride, 16, 2);
+  Start(kBlock | kFill | kIntEnable);
+
+  ASSERT_EQ(delays_.size(), 1u);
+  EXPECT_EQ(delays_[0], 64u);
+  EXPECT_EQ(Read(kStatus), kInProgress);
+  EXPECT_EQ(interrupts_, 0);
+
+  // Another start while busy is ignored.
+  Start(kBlock | kFill | kIntEnable);
+  EXPECT_EQ(delays_.size(), 1u);
+
+  RunEvents();
+  EXPECT_EQ(Read(kStatus), 0);
+  EXPECT_EQ(interrupts_, 1);
+}
+
+TEST_F(SDMATest, RejectsOversizedBlocks) {
+  // 0xFFFF x 0xFFFF bytes, which doesn't fit in an int.
+  Store(kSize, 0xFFFFFFFF, 4);
+  Start(kBlock | kFill | kIntEnable);
+
+  EXPECT_EQ(Read(kStatus), kSizeError);
+  EXPECT_TRUE(delays_.empty());
+}
@@ -0,0 +1,115 @@
+#include "bus/timer.h"
+
+#include <glog/logging.h>
+
+#include <utility>
+
+#include "bus/hash.h"
+
+namespace {
+
+constexpr uint32_t kTimerCtrlReg = 0;
+constexpr uint32_t kTimerCharge = 1;  // 3 bytes; reads give the live count
+constexpr uint32_t kTimerCmpReg = 4;
+constexpr uint32_t kTimerCmp = 5;  // 3 bytes
+
+constexpr uint32_t kCountMask = 0xFFFFFF;
+
+void StoreByteOf(uint32_t* value, int byte, uint8_t v) {
+  *value = (*value & ~(0xFFu << (byte * 8))) | (v << (byte * 8));
+}
+
+}  // namespace
+
+Timer::Timer(Host host, int index) : host_(std::move(host)), index_(index) {
+  ctrl_reg_.v = 0;
+  cmp_reg_.v = 0;
+}
+
+uint32_t Timer::Count(uint64_t cycle) const {
+  if (!ctrl_reg_.reg.enable)
+    return count_;
+  uint32_t elapsed = (cycle - base_cycle_) & kCountMask;
+  return (ctrl_reg_.reg.count_up ? count_ + elapsed : count_ - elapsed) &
+         kCountMask;
+}
+
+void Timer::Sync() {
+  uint64_t now = host_.now();
+  count_ = Count(now);
+  base_cycle_ = now;
+}
+
+void Timer::Reschedule() {
+  uint64_t generation = ++generation_;
+  if (!ctrl_reg_.reg.enable)
+    return;
+  uint32_t distance = (ctrl_reg_.reg.count_up ? compare_ - count_
+                                              : count_ - compare_) &
+                      kCountMask;
+  // Already there: the next match is a full wrap away.
+  uint64_t deadline = base_cycle_ + (distance ? distance : kCountMask + 1);
+  uint64_t now = host_.now();
+  host_.schedule(deadline > now ? deadline - now : 0,
+                 [this, generation, deadline]() {
+                   if (generation != generation_)
+                     return;
+                   // Account from the exact match cycle, not from when the
+                   // event got to run, so periods don't drift.
+                   base_cycle_ = deadline;
+                   OnMatch();
+                 });
+}
+
+void Timer::OnMatch() {
+  count_ = compare_;
+  host_.interrupt();
+  if (ctrl_reg_.reg.count_up && cmp_reg_.reg.reclear)
+    count_ = 0;
+  else if (!ctrl_reg_.reg.count_up && cmp_reg_.reg.reload)
+    count_ = charge_;
+  Reschedule();
+}
+
+void Timer::StoreByte(uint32_t addr, uint8_t v) {
+  Sync();
+  if (addr == kTimerCtrlReg) {
+    ctrl_reg_.v = v;
+    if (ctrl_reg_.reg.clear)
+      count_ = 0;
+    if (ctrl_reg_.reg.load)
+      count_ = charge_;
+    // Clear and load act once; they don't stay set.
+    ctrl_reg_.reg.clear = false;
+    ctrl_reg_.reg.load = false;
+  } else if (addr >= kTimerCharge && addr < kTimerCharge + 3) {
+    StoreByteOf(&charge_, addr - kTimerCharge, v);
+  } else if (addr == kTimerCmpReg) {
+    cmp_reg_.v = v;
+  } else if (addr >= kTimerCmp && addr < kTimerCmp + 3) {
+    StoreByteOf(&compare_, addr - kTimerCmp, v);
+  } else {
+    LOG(ERROR) << "Unknown timer " << index_ << " register write: " << std::hex
+               << addr << " := " << (int)v;
+    return;
+  }
+  Reschedule();
+}
+
+uint8_t Timer::ReadByte(uint32_t addr) {
+  if (addr == kTimerCtrlReg)
+    return ctrl_reg_.v;
+  if (addr >= kTimerCharge && addr < kTimerCharge + 3)
+    return Count(host_.now()) >> ((addr - kTimerCharge) * 8);
+  if (addr == kTimerCmpReg)
+    return cmp_reg_.v;
+  if (addr >= kTimerCmp && addr < kTimerCmp + 3)
+    return compare_ >> ((addr - kTimerCmp) * 8);
+  return 0;
+}
+
+uint64_t Timer::HashState(uint64_t seed) const {
+  const uint32_t state[] = {ctrl_reg_.v, cmp_reg_.v, charge_, compare_,
+                            Count(host_.now())};
+  return HashBytes(state, sizeof(state), seed);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// One of the three programmable timers at 0x160, 0x168 and 0x170. Each
+// counts system clock cycles up or down from its charge value, and raises
+// its interrupt when the count reaches the compare value, optionally
+// clearing or reloading to run periodically.
+//
+// Nothing is ticked per cycle: the count is derived from the cycle counter
+// when read, and a single event is scheduled for the next match, recomputed
+// whenever the registers change.
+class Timer {
+ public:
+  static constexpr uint32_t kRegisterCount = 8;
+
+  // How the timer reaches the rest of the machine.
+  struct Host {
+    // Runs 'event' on the CPU thread 'delay_cycles' CPU cycles from now.
+    std::function<void(uint64_t delay_cycles, std::function<void()> event)>
+        schedule;
+    // Raises the timer's interrupt.
+    std::function<void()> interrupt;
+    // The current CPU cycle.
+    std::function<uint64_t()> now;
+  };
+
+  // 'index' only names the timer in logs.
+  Timer(Host host, int index);
+
+  // 'addr' is relative to the timer's first register.
+  void StoreByte(uint32_t addr, uint8_t v);
+  uint8_t ReadByte(uint32_t addr);
+
+  uint64_t HashState(uint64_t seed) const;
+
+ private:
+  // The count as of 'cycle'.
+  uint32_t Count(uint64_t cycle) const;
+  // Folds the time elapsed so far into the count.
+  void Sync();
+  // Schedules the next compare match, dropping any earlier one.
+  void Reschedule();
+  void OnMatch();
+
+  Host host_;
+  const int index_;
+
+  union {
+    uint8_t v;
+    struct {
+      bool enable : 1;
+      bool clear : 1;     // write 1 to clear the count
+      bool load : 1;      // write 1 to load the count from the charge
+      bool count_up : 1;  // 0 counts down
+      uint8_t unused : 4;
+    } reg;
+  } ctrl_reg_;
+
+  union {
+    uint8_t v;
+    struct {
+      bool reclear : 1;  // counting up: start again from 0 on a match
+      bool reload : 1;   // counting down: reload the charge on a match
+      uint8_t unused : 6;
+    } reg;
+  } cmp_reg_;
+
+  uint32_t charge_ = 0;
+  uint32_t compare_ = 0;
+
+  // The count was 'count_' at 'base_cycle_'.
+  uint32_t count_ = 0;
+  uint64_t base_cycle_ = 0;
+  // Bumped to invalidate scheduled matches.
+  uint64_t generation_ = 0;
+};
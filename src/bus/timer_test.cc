@@ -0,0 +1,138 @@
+#include "bus/timer.h"
+
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kControl = 0;
+constexpr uint32_t kCharge = 1;
+constexpr uint32_t kCompareControl = 4;
+constexpr uint32_t kCompare = 5;
+
+constexpr uint8_t kEnable = 0x01;
+constexpr uint8_t kClear = 0x02;
+constexpr uint8_t kLoad = 0x04;
+constexpr uint8_t kCountUp = 0x08;
+
+constexpr uint8_t kReclear = 0x01;
+constexpr uint8_t kReload = 0x02;
+
+class TimerTest : public testing::Test {
+ protected:
+  TimerTest()
+      : timer_(Timer::Host{[this](uint64_t delay_cycles,
+                                  std::function<void()> event) {
+                             events_.emplace(now_ + delay_cycles,
+                                             std::move(event));
+                           },
+                           [this]() { interrupts_.push_back(now_); },
+                           [this]() { return now_; }},
+               0) {}
+
+  void Store(uint32_t addr, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+      timer_.StoreByte(addr + i, value >> (i * 8));
+  }
+
+  uint32_t Count() {
+    uint32_t count = 0;
+    for (int i = 0; i < 3; i++)
+      count |= timer_.ReadByte(kCharge + i) << (i * 8);
+    return count;
+  }
+
+  // Runs the events due up to 'cycle', in order, at their cycles.
+  void RunUntil(uint64_t cycle) {
+    while (!events_.empty() && events_.begin()->first <= cycle) {
+      now_ = events_.begin()->first;
+      auto event = std::move(events_.begin()->second);
+      events_.erase(events_.begin());
+      event();
+    }
+    now_ = cycle;
+  }
+
+  uint64_t now_ = 0;
+  std::multimap<uint64_t, std::function<void()>> events_;
+  std::vector<uint64_t> interrupts_;
+  Timer timer_;
+};
+
+TEST_F(TimerTest, CountsUpToTheCompare) {
+  now_ = 100;
+  Store(kCompare, 50, 3);
+  Store(kControl, kEnable | kClear | kCountUp, 1);
+  // Clear and load act once.
+  EXPECT_EQ(kEnable | kCountUp, timer_.ReadByte(kControl));
+  RunUntil(120);
+  EXPECT_EQ(20u, Count());
+
+  RunUntil(1000);
+  EXPECT_EQ(std::vector<uint64_t>{150}, interrupts_);
+  // Without reclear it carries on past the compare.
+  EXPECT_EQ(900u, Count());
+}
+
+TEST_F(TimerTest, ReclearRunsPeriodically) {
+  Store(kCompareControl, kReclear, 1);
+  Store(kCompare, 10, 3);
+  Store(kControl, kEnable | kClear | kCountUp, 1);
+  RunUntil(35);
+  EXPECT_EQ((std::vector<uint64_t>{10, 20, 30}), interrupts_);
+  EXPECT_EQ(5u, Count());
+}
+
+TEST_F(TimerTest, ReloadRunsPeriodically) {
+  Store(kCharge, 20, 3);
+  Store(kCompareControl, kReload, 1);
+  Store(kCompare, 0, 3);
+  Store(kControl, kEnable | kLoad, 1);
+  RunUntil(15);
+  EXPECT_EQ(5u, Count());
+  RunUntil(65);
+  EXPECT_EQ((std::vector<uint64_t>{20, 40, 60}), interrupts_);
+  EXPECT_EQ(15u, Count());
+}
+
+TEST_F(TimerTest, PeriodsDontDriftWhenEventsRunLate) {
+  Store(kCompareControl, kReclear, 1);
+  Store(kCompare, 10, 3);
+  Store(kControl, kEnable | kClear | kCountUp, 1);
+  // Run the first match 3 cycles late, as if mid-instruction.
+  auto event = std::move(events_.begin()->second);
+  events_.clear();
+  now_ = 13;
+  event();
+  RunUntil(30);
+  EXPECT_EQ((std::vector<uint64_t>{13, 20, 30}), interrupts_);
+}
+
+TEST_F(TimerTest, NewCompareReschedules) {
+  Store(kCompare, 100, 3);
+  Store(kControl, kEnable | kClear | kCountUp, 1);
+  RunUntil(30);
+  Store(kCompare, 50, 3);
+  RunUntil(200);
+  EXPECT_EQ(std::vector<uint64_t>{50}, interrupts_);
+}
+
+TEST_F(TimerTest, DisabledTimerHolds) {
+  Store(kCompare, 10, 3);
+  Store(kControl, kEnable | kClear | kCountUp, 1);
+  RunUntil(5);
+  Store(kControl, kCountUp, 1);
+  RunUntil(100);
+  EXPECT_TRUE(interrupts_.empty());
+  EXPECT_EQ(5u, Count());
+
+  Store(kControl, kEnable | kCountUp, 1);
+  RunUntil(110);
+  EXPECT_EQ(std::vector<uint64_t>{105}, interrupts_);
+}
+
+}  // namespace
@@ -2,116 +2,90 @@
 
 #include <glog/logging.h>
 
-#include "bus/int_controller.h"
+#include <algorithm>
+#include <cstring>
 
 namespace {
 
 constexpr uint32_t kVdmaControlReg = 0x400;
 
-constexpr uint32_t kVdmaByte2Write =
-    0x401; // same address as below; one for read, one for write
-constexpr uint32_t kVmdaStatusReg = 0x401;
-constexpr uint32_t kVdmaSrcAddy = 0x402;
-constexpr uint32_t kVdmaDstAddr = 0x405;
-constexpr uint32_t kVdmaTransferSize = 0x408;
-constexpr uint32_t kVdmaSrcStride = 0x40c;
-constexpr uint32_t kVdmaDstStride = 0x40e;
+// Transfers move one byte per dot clock.
+constexpr double kDotClockMhz = 25.175;
 
-void BitBlt(uint8_t* src,
-            uint8_t* dst,
+constexpr uint64_t kVramSize = VDMA::kVramSize;
+
+// Copies a 'width' x 'height' block a row at a time, top to bottom, clipping
+// rows that run past the end of VRAM.
+void BitBlt(uint8_t* vram,
+            uint32_t src,
+            uint32_t dst,
             uint32_t src_stride,
             uint32_t dst_stride,
             uint16_t x_size,
             uint16_t y_size) {
-  // TODO error handling
   for (uint16_t y = 0; y < y_size; y++) {
-    uint8_t* src_row = &src[(y * src_stride)];
-    uint8_t* dst_row = &dst[(y * dst_stride)];
-    for (uint16_t x = 0; x < x_size; x++) {
-      dst_row[x] = src_row[x];
-    }
+    uint64_t src_row = src + static_cast<uint64_t>(y) * src_stride;
+    uint64_t dst_row = dst + static_cast<uint64_t>(y) * dst_stride;
+    if (src_row >= kVramSize || dst_row >= kVramSize)
+      break;
+    size_t width = std::min<uint64_t>(
+        {x_size, kVramSize - src_row, kVramSize - dst_row});
+    memmove(&vram[dst_row], &vram[src_row], width);
   }
 }
 
-void FillBlt(uint8_t* dst,
+void FillBlt(uint8_t* vram,
+             uint32_t dst,
              uint32_t dst_stride,
              uint16_t x_size,
              uint16_t y_size,
              uint8_t fill_v) {
-  // TODO error handling
   for (uint16_t y = 0; y < y_size; y++) {
-    uint8_t* row = &dst[(y * dst_stride)];
-    for (uint16_t x = 0; x < x_size; x++) {
-      dst[(y * dst_stride) + x] = fill_v;
-    }
+    uint64_t row = dst + static_cast<uint64_t>(y) * dst_stride;
+    if (row >= kVramSize)
+      break;
+    memset(&vram[row], fill_v, std::min<uint64_t>(x_size, kVramSize - row));
   }
 }
 }  // namespace
 
-VDMA::VDMA(uint8_t* vram, InterruptController* int_controller)
-    : registers_({
-          {kVdmaControlReg, &ctrl_reg_.v, 1},
-          {kVdmaSrcAddy, &src_addr_, 3},
-          {kVdmaDstAddr, &dst_addr_, 3},
-          {kVdmaTransferSize, &size_, 4},
-          {kVdmaSrcStride, &src_stride_, 2},
-          {kVdmaDstStride, &dst_stride_, 2},
-      }),
-      vram_(vram), int_controller_(int_controller) {
-  memset(&ctrl_reg_, 0, sizeof(ctrl_reg_));
-  memset(&status_reg_, 0, sizeof(status_reg_));
-  memset(&write_byte_, 0, sizeof(write_byte_));
-  memset(&src_addr_, 0, sizeof(src_addr_));
-  memset(&dst_addr_, 0, sizeof(dst_addr_));
-  memset(&dst_stride_, 0, sizeof(dst_stride_));
-  memset(&src_stride_, 0, sizeof(src_stride_));
+VDMA::VDMA(Host host, uint8_t* vram)
+    : DmaEngine("VDMA", kVdmaControlReg, host),
+      clock_mhz_(host.clock_mhz),
+      vram_(vram) {}
+
+void VDMA::CheckTransfer(uint32_t bytes) {
+  status_reg_.reg.dst_add_err =
+      dst_addr_ >= kVramSize || ctrl_reg_.reg.sysram_dst;
+  status_reg_.reg.src_add_err =
+      !ctrl_reg_.reg.trf_fill &&
+      (src_addr_ >= kVramSize || ctrl_reg_.reg.sysram_src);
+  if (ctrl_reg_.reg.sysram_src || ctrl_reg_.reg.sysram_dst)
+    LOG(ERROR) << "VDMA to or from system RAM is not supported";
 }
 
-void VDMA::OnFrameStart() {
-  if (!ctrl_reg_.reg.enable)
-    return;
-  if (!ctrl_reg_.reg.start_trf)
-    return;
-  if (!ctrl_reg_.reg.linear_block) {
-    status_reg_.reg.vmda_ips = true;
+uint64_t VDMA::TransferCycles(uint32_t bytes) const {
+  return bytes * clock_mhz_ / kDotClockMhz;
+}
+
+void VDMA::Transfer() {
+  if (ctrl_reg_.reg.linear_block) {
     if (ctrl_reg_.reg.trf_fill) {
-      FillBlt(&vram_[dst_addr_], dst_stride_, size_.block.x_size,
+      FillBlt(vram_, dst_addr_, dst_stride_, size_.block.x_size,
               size_.block.y_size, write_byte_);
     } else {
-      BitBlt(&vram_[src_addr_], &vram_[dst_addr_], src_stride_, dst_stride_,
+      BitBlt(vram_, src_addr_, dst_addr_, src_stride_, dst_stride_,
              size_.block.x_size, size_.block.y_size);
     }
-    status_reg_.reg.vmda_ips = false;
-  } else {
-    // TODO linear ("1d") transfer
-  }
-  if (ctrl_reg_.reg.int_enable) {
-    int_controller_->SetVDMATransfer(true);
-  }
-}
-
-void VDMA::StoreByte(uint32_t addr, uint8_t v) {
-  if (StoreRegister(addr, v, registers_)) {
     return;
   }
 
-  // Write-only register shares same 'address' as the read-only status reg.
-  if (addr == kVdmaByte2Write) {
-    write_byte_ = v;
-    return;
-  }
-  LOG(ERROR) << "Unknown VDMA register write: " << std::hex << addr
-             << " := " << std::hex << (int)v;
-}
-
-uint8_t VDMA::ReadByte(uint32_t addr) {
-  uint8_t v;
-  if (ReadRegister(addr, registers_, &v)) {
-    return v;
-  }
-  if (addr == kVmdaStatusReg) {
-    return status_reg_.v;
+  // Linear ("1d") transfer.
+  uint64_t size = std::min<uint64_t>(size_.linear.size, kVramSize - dst_addr_);
+  if (ctrl_reg_.reg.trf_fill) {
+    memset(&vram_[dst_addr_], write_byte_, size);
+  } else {
+    size = std::min<uint64_t>(size, kVramSize - src_addr_);
+    memmove(&vram_[dst_addr_], &vram_[src_addr_], size);
   }
-  LOG(ERROR) << "Unknown VDMA register read: " << std::hex << addr;
-  return 0;
 }
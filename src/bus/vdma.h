@@ -2,63 +2,26 @@
 
 #include <cstdint>
 
-#include "bus/register_utils.h"
+#include "bus/dma_engine.h"
 
-class InterruptController;
-
-class VDMA {
+// The video DMA engine at 0x400: linear and 2D copies and fills within VRAM.
+// A transfer takes as long as moving its bytes at the dot clock would.
+class VDMA : public DmaEngine {
  public:
-  VDMA(uint8_t* vram, InterruptController* int_controller);
+  static constexpr uint32_t kVramSize = 0x400000;
+
+  struct Host : DmaEngine::Host {
+    // The CPU clock in MHz, to convert transfer times to cycles.
+    double clock_mhz;
+  };
 
-  void OnFrameStart();
-  void StoreByte(uint32_t addr, uint8_t v);
-  uint8_t ReadByte(uint32_t addr);
+  VDMA(Host host, uint8_t* vram);
 
  private:
-  std::vector<Reg> registers_;
-  std::vector<Reg> read_only_registers_;
+  void CheckTransfer(uint32_t bytes) override;
+  void Transfer() override;
+  uint64_t TransferCycles(uint32_t bytes) const override;
 
+  const double clock_mhz_;
   uint8_t* vram_;
-  InterruptController* int_controller_;
-
-  union {
-    uint8_t v;
-    struct {
-      bool enable : 1;
-      bool linear_block : 1;  // linear or block
-      bool trf_fill : 1;      // transfer or fill
-      bool int_enable : 1;    // generate interrupt on completion
-      bool start_trf : 1;     // begin?  clear when ready to start again
-      uint8_t unused : 3;
-    } reg;
-  } ctrl_reg_;
-
-  uint8_t write_byte_;  // write only
-
-  union {
-    uint8_t v;
-    struct {
-      bool size_err;     // if 1 size is invalid
-      bool dst_add_err;  // if 1, dest addr invalid
-      bool src_add_err;  // if 1 src addr invalid
-      bool vmda_ips;     // 1 if in progress (no cpu access to mem)
-    } reg;
-  } status_reg_;
-
-  uint32_t src_addr_;
-  uint32_t dst_addr_;
-
-  union {
-    struct {
-      uint32_t size : 24;
-      uint8_t ignored : 8;
-    } linear;
-    struct {
-      uint16_t x_size;
-      uint16_t y_size;
-    } block;
-  } size_;
-
-  uint16_t src_stride_;
-  uint16_t dst_stride_;
 };
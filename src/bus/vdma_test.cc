@@ -0,0 +1,109 @@
+#include "bus/vdma.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "bus/dma_engine_test.h"
+
+namespace {
+
+// The dot clock, so transfers take a cycle a byte.
+constexpr double kClockMhz = 25.175;
+
+class VDMATest : public DmaEngineTest {
+ protected:
+  VDMATest()
+      : DmaEngineTest(0x400),
+        vram_(VDMA::kVramSize),
+        vdma_(VDMA::Host{MakeHost(), kClockMhz}, vram_.data()) {
+    engine_ = &vdma_;
+    for (size_t i = 0; i < vram_.size(); i++)
+      vram_[i] = i * 13;
+  }
+
+  std::vector<uint8_t> vram_;
+  VDMA vdma_;
+};
+
+}  // namespace
+
+TEST_F(VDMATest, LinearCopy) {
+  std::vector<uint8_t> expected(vram_.begin() + 0x1000,
+                                vram_.begin() + 0x1000 + 300);
+  Store(kSrcAddr, 0x1000, 3);
+  Store(kDstAddr, 0x20000, 3);
+  Store(kSize, 300, 4);
+  Start(kIntEnable);
+
+  EXPECT_EQ(std::vector<uint8_t>(vram_.begin() + 0x20000,
+                                 vram_.begin() + 0x20000 + 300),
+            expected);
+  EXPECT_EQ(vram_[0x20000 + 300], uint8_t((0x20000 + 300) * 13));
+}
+
+TEST_F(VDMATest, LinearFill) {
+  Store(kFillByte, 0xAB, 1);
+  Store(kDstAddr, 0x3000, 3);
+  Store(kSize, 100, 4);
+  Start(kFill);
+
+  for (int i = 0; i < 100; i++)
+    ASSERT_EQ(vram_[0x3000 + i], 0xAB) << i;
+  EXPECT_EQ(vram_[0x3000 + 100], uint8_t((0x3000 + 100) * 13));
+}
+
+TEST_F(VDMATest, BlockCopy) {
+  std::vector<uint8_t> before = vram_;
+  Store(kSrcAddr, 0x100, 3);
+  Store(kDstAddr, 0x10000, 3);
+  Store(kSize, 4 | (3 << 16), 4);  // 4 wide, 3 high.
+  Store(kSrcStride, 640, 2);
+  Store(kDstStride, 800, 2);
+  Start(kBlock);
+
+  for (int y = 0; y < 3; y++) {
+    for (int x = 0; x < 4; x++)
+      EXPECT_EQ(vram_[0x10000 + y * 800 + x], before[0x100 + y * 640 + x]);
+    // Nothing past the end of each row.
+    EXPECT_EQ(vram_[0x10000 + y * 800 + 4], before[0x10000 + y * 800 + 4]);
+  }
+  EXPECT_EQ(vram_[0x10000 + 3 * 800], before[0x10000 + 3 * 800]);
+}
+
+TEST_F(VDMATest, BlockFill) {
+  std::vector<uint8_t> before = vram_;
+  Store(kFillByte, 0x5A, 1);
+  Store(kDstAddr, 0x8000, 3);
+  Store(kSize, 2 | (2 << 16), 4);
+  Store(kDstStride, 100, 2);
+  Start(kBlock | kFill);
+
+  for (int y = 0; y < 2; y++) {
+    EXPECT_EQ(vram_[0x8000 + y * 100], 0x5A);
+    EXPECT_EQ(vram_[0x8000 + y * 100 + 1], 0x5A);
+    EXPECT_EQ(vram_[0x8000 + y * 100 + 2], before[0x8000 + y * 100 + 2]);
+  }
+}
+
+TEST_F(VDMATest, CompletesAfterTheTransferTime) {
+  // The largest block, whose byte count doesn't fit in an int. Rows past the
+  // end of VRAM are clipped.
+  Store(kDstAddr, 0, 3);
+  Store(kSize, 0xFFFFFFFF, 4);
+  Store(kDstStride, 0xFFFF, 2);
+  Start(kBlock | kFill | kIntEnable);
+
+  ASSERT_EQ(delays_.size(), 1u);
+  EXPECT_EQ(delays_[0], 0xFFFFu * 0xFFFF);
+  EXPECT_EQ(Read(kStatus), kInProgress);
+  EXPECT_EQ(interrupts_, 0);
+
+  // Another start while busy is ignored.
+  Start(kBlock | kFill | kIntEnable);
+  EXPECT_EQ(delays_.size(), 1u);
+
+  RunEvents();
+  EXPECT_EQ(Read(kStatus), 0);
+  EXPECT_EQ(interrupts_, 1);
+}
@@ -1,9 +1,13 @@
 #include "bus/vicky.h"
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <thread>
 
+#include <gflags/gflags.h>
+
+#include "bus/hash.h"
 #include "bus/int_controller.h"
 #include "bus/vicky_def.h"
 #include "system.h"
@@ -18,6 +22,9 @@ constexpr uint8_t kTileSize = 16;
 constexpr uint8_t kSpriteSize = 32;
 constexpr uint16_t kTileSetStride = 256;
 
+// A line of pixels as a bitmask, one bit per dot.
+constexpr int kLineWords = (kVickyMaxWidth + 63) / 64;
+
 bool Set16(uint32_t addr, uint32_t start_addr, uint16_t *dest, uint8_t v) {
   uint16_t o = addr - start_addr;
   if (o > 1)
@@ -57,20 +64,15 @@ void SetHigher8(uint16_t *destination, uint8_t value) {
   *destination |= (value << 8);
 }
 
-std::string ScalingQualityStr(Vicky::ScalingQuality scaling_quality) {
-  switch (scaling_quality) {
-  case Vicky::ScalingQuality::NEAREST:
-    return "0";
-  case Vicky::ScalingQuality::LINEAR:
-    return "1";
-  default:
-  case Vicky::ScalingQuality::BEST:
-    return "2";
-  }
-}
-
 } // namespace
 
+DEFINE_bool(scaler_thread, false,
+            "Scale frames for display on a separate thread, a frame behind");
+DEFINE_double(scale, 1.0,
+              "Scale the display, and recorded video, by this factor");
+DEFINE_string(scaling_quality, "nearest",
+              "How frames are scaled: nearest, linear or best");
+
 #define CHECK_GL                                                               \
   {                                                                            \
     GLenum gl_error = glGetError();                                            \
@@ -78,7 +80,24 @@ std::string ScalingQualityStr(Vicky::ScalingQuality scaling_quality) {
   }
 
 Vicky::Vicky(System *system, InterruptController *int_controller)
-    : sys_(system), int_controller_(int_controller) {
+    : sys_(system), int_controller_(int_controller),
+      scale_(FLAGS_scale),
+      scaler_(std::make_unique<FrameScaler>(FLAGS_scaler_thread)),
+      raster_(
+          Raster::Host{
+              [system](uint64_t delay_cycles, std::function<void()> event) {
+                system->ScheduleEvent(delay_cycles, std::move(event));
+              },
+              [int_controller]() { int_controller->SetLineInterrupt(true); },
+              [system]() { return system->cpu()->cpu_state.cycle; },
+              [system]() { return system->total_scanlines(); },
+              [system](uint64_t scanline) {
+                return system->ScanlineCycle(scanline);
+              }},
+          kVicky640x480.height - 1, kVicky640x480.total_lines,
+          kVicky640x480.line_dots) {
+  if (!ParseScalingQuality(FLAGS_scaling_quality, &scaling_quality_))
+    LOG(ERROR) << "Unknown scaling quality: " << FLAGS_scaling_quality;
   memset(fg_colour_mem_, 0, sizeof(fg_colour_mem_));
   memset(bg_colour_mem_, 0, sizeof(bg_colour_mem_));
   memset(video_ram_, 0, sizeof(video_ram_));
@@ -118,9 +137,8 @@ void Vicky::InitPages(Page *vicky_page_start) {
 }
 
 GLFWwindow *Vicky::Start() {
-  window_ =
-      glfwCreateWindow(kVickyBitmapWidth * scale_, kVickyBitmapHeight * scale_,
-                       "Vicky", nullptr, nullptr);
+  window_ = glfwCreateWindow(frame_width() * scale_, frame_height() * scale_,
+                             "Vicky", nullptr, nullptr);
   CHECK(window_);
   glfwMakeContextCurrent(window_);
   CHECK_GL;
@@ -131,8 +149,10 @@ GLFWwindow *Vicky::Start() {
   glBindTexture(GL_TEXTURE_2D, texture_id_);
   CHECK_GL;
 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kVickyBitmapWidth, kVickyBitmapHeight,
-               0, GL_BGRA_EXT, GL_UNSIGNED_BYTE, frame_buffer_);
+  texture_width_ = frame_width();
+  texture_height_ = frame_height();
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width_, texture_height_, 0,
+               GL_BGRA_EXT, GL_UNSIGNED_BYTE, frame_buffer_);
   CHECK_GL;
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -152,8 +172,54 @@ Vicky::~Vicky() {
   }
 }
 
+uint64_t Vicky::HashState(uint64_t seed) const {
+  seed = HashRegisters(registers_, seed);
+  seed = HashBytes(lut_, sizeof(lut_), seed);
+  seed = HashBytes(&gamma_, sizeof(gamma_), seed);
+  seed = HashBytes(font_bank_, sizeof(font_bank_), seed);
+  seed = HashBytes(text_mem_, sizeof(text_mem_), seed);
+  seed = HashBytes(text_colour_mem_, sizeof(text_colour_mem_), seed);
+  seed = HashBytes(fg_colour_mem_, sizeof(fg_colour_mem_), seed);
+  seed = HashBytes(bg_colour_mem_, sizeof(bg_colour_mem_), seed);
+  seed = HashBytes(mouse_cursor_0_, sizeof(mouse_cursor_0_), seed);
+  seed = HashBytes(mouse_cursor_1_, sizeof(mouse_cursor_1_), seed);
+  seed = HashBytes(tile_mem_, sizeof(tile_mem_), seed);
+  // Registers decoded into flags and structs aren't covered by registers_.
+  const uint32_t decoded[] = {mode_,
+                              cursor_x_,
+                              cursor_y_,
+                              mouse_cursor_enable_,
+                              mouse_cursor_select_,
+                              bitmap_enabled_,
+                              bitmap_lut_,
+                              bitmap_addr_offset_,
+                              border_enabled_,
+                              border_colour_.v,
+                              raster_y_,
+                              raster_.row(),
+                              raster_.irq_ctrl(),
+                              raster_.compare(0),
+                              raster_.compare(1),
+                              sprite_collisions_,
+                              tile_collisions_};
+  return HashBytes(decoded, sizeof(decoded), seed);
+}
+
 uint8_t Vicky::ReadByte(uint32_t addr) {
   uint8_t v;
+  if (addr >= kRasterColumn && addr < kRasterColumn + 2)
+    return raster_.Column() >> ((addr - kRasterColumn) * 8);
+  if (addr >= kRasterRow && addr < kRasterRow + 2)
+    return raster_.row() >> ((addr - kRasterRow) * 8);
+  if (addr >= kSpriteCollisionReg && addr < kSpriteCollisionReg + 4)
+    return sprite_collisions_ >> ((addr - kSpriteCollisionReg) * 8);
+  if (addr >= kTileCollisionReg && addr < kTileCollisionReg + 4)
+    return tile_collisions_ >> ((addr - kTileCollisionReg) * 8);
+  if (addr >= kLineCompare0 && addr < kLineCompare1 + 2) {
+    uint16_t compare = raster_.compare((addr - kLineCompare0) / 2);
+    return compare >> (((addr - kLineCompare0) % 2) * 8);
+  }
+
   if (ReadRegister(addr, registers_, &v)) {
     return v;
   }
@@ -266,8 +332,31 @@ uint8_t Vicky::ReadByte(uint32_t addr) {
 }
 
 void Vicky::StoreByte(uint32_t addr, uint8_t v) {
-  if (StoreRegister(addr, v, registers_))
+  if (StoreRegister(addr, v, registers_)) {
+    if (addr == kMasterCtrlReg || addr == kMasterCtrlReg + 1)
+      UpdateLineFeatures();
+    return;
+  }
+
+  if (addr >= kSpriteCollisionReg && addr < kSpriteCollisionReg + 4) {
+    sprite_collisions_ &= ~(uint32_t(v) << ((addr - kSpriteCollisionReg) * 8));
+    return;
+  }
+  if (addr >= kTileCollisionReg && addr < kTileCollisionReg + 4) {
+    tile_collisions_ &= ~(uint32_t(v) << ((addr - kTileCollisionReg) * 8));
+    return;
+  }
+  if (addr == kLineIrqCtrlReg) {
+    raster_.set_irq_ctrl(v);
     return;
+  }
+  if (addr >= kLineCompare0 && addr < kLineCompare1 + 2) {
+    int index = (addr - kLineCompare0) / 2;
+    uint16_t compare = raster_.compare(index);
+    Set16(addr, kLineCompare0 + index * 2, &compare, v);
+    raster_.set_compare(index, compare & 0x0FFF);
+    return;
+  }
 
   if (addr >= kTextFgColourLUT && addr < kTextBgColourLUT) {
     memcpy((uint8_t *)fg_colour_mem_ + addr - kTextFgColourLUT, &v, 1);
@@ -293,6 +382,7 @@ void Vicky::StoreByte(uint32_t addr, uint8_t v) {
   if (addr == kBitmapCtrlReg) {
     bitmap_enabled_ = v & 0x01;
     bitmap_lut_ = (v & 0b01110000) >> 4;
+    UpdateLineFeatures();
     return;
   }
 
@@ -307,6 +397,7 @@ void Vicky::StoreByte(uint32_t addr, uint8_t v) {
       tile_set.tiled_sheet = (v & TILESHEET_256x256_En);
       tile_set.scroll_x_enable = (v & TILE_Scroll_X_Enable);
       tile_set.scroll_y_enable = (v & TILE_Scroll_Y_Enable);
+      UpdateLineFeatures();
     } else if (register_num == 1) {
       tile_set.start_addr = (tile_set.start_addr & 0x00ffff00) | v;
     } else if (register_num == 2) {
@@ -358,23 +449,169 @@ void Vicky::StoreByte(uint32_t addr, uint8_t v) {
   if (addr == kMousePtrCtrlReg) {
     mouse_cursor_enable_ = v & 0x01;
     mouse_cursor_select_ = v & 0x02;
+    UpdateLineFeatures();
     return;
   }
   if (addr == kBorderCtrlReg) {
     border_enabled_ = v & Border_Ctrl_Enable;
+    UpdateLineFeatures();
     return;
   }
   LOG(INFO) << "Unknown Vicky register: " << std::hex << addr;
 }
 
+void Vicky::ScaledSize(int *width, int *height) const {
+  *width = std::max(1, int(frame_width() * scale_ + 0.5f));
+  *height = std::max(1, int(frame_height() * scale_ + 0.5f));
+}
+
+void Vicky::FinishFrame() {
+  frames_finished_++;
+  if (frame_export_.is_open()) {
+    frame_export_.Publish(frames_finished_, frame_buffer_, frame_width(),
+                          frame_height());
+  }
+
+  // Headless runs have no window to present to.
+  if (window_) {
+    PresentFrame();
+    return;
+  }
+  int width, height;
+  ScaledSize(&width, &height);
+  if (scaled_output_ && (width != frame_width() || height != frame_height()))
+    ScaleFrame(width, height);
+}
+
+void Vicky::ScaleFrame(int width, int height) {
+  scaler_->Scale(frame_buffer_, frame_width(), frame_height(), width, height,
+                 scaling_quality_);
+  scaled_frame_ = frames_finished_;
+}
+
+bool Vicky::StartFrameExport(const std::string &name) {
+  static_assert(kVickyMaxWidth <= kFrameExportMaxWidth &&
+                    kVickyMaxHeight <= kFrameExportMaxHeight,
+                "Exported frames must fit Vicky's largest mode");
+  return frame_export_.Open(name);
+}
+
+const uint32_t *Vicky::ScaledFrame(int *width, int *height) {
+  int scaled_width, scaled_height;
+  ScaledSize(&scaled_width, &scaled_height);
+  if (scaled_width == frame_width() && scaled_height == frame_height()) {
+    *width = scaled_width;
+    *height = scaled_height;
+    return frame_buffer_;
+  }
+  // Use this frame's scaled copy if it was already made (or is under way)
+  // at the current size; otherwise scale it now.
+  if (scaled_frame_ == frames_finished_) {
+    const uint32_t *pixels = scaler_->Wait(width, height);
+    if (*width == scaled_width && *height == scaled_height)
+      return pixels;
+  }
+  ScaleFrame(scaled_width, scaled_height);
+  return scaler_->Wait(width, height);
+}
+
+void Vicky::PresentFrame() {
+  int width = frame_width();
+  int height = frame_height();
+  const uint32_t *pixels = frame_buffer_;
+  int scaled_width, scaled_height;
+  ScaledSize(&scaled_width, &scaled_height);
+  bool scale_after = false;
+  if (scaled_width != width || scaled_height != height) {
+    if (scaler_->threaded()) {
+      // Show the previous frame, and scale this one while the next is
+      // emulated. Unless the size changed, when there's nothing to show.
+      pixels = scaler_->Wait(&width, &height);
+      scale_after = true;
+    }
+    if (width != scaled_width || height != scaled_height) {
+      ScaleFrame(scaled_width, scaled_height);
+      pixels = scaler_->Wait(&width, &height);
+      scale_after = false;
+    }
+  }
+
+  int display_w, display_h;
+  glfwMakeContextCurrent(window_);
+  glfwGetFramebufferSize(window_, &display_w, &display_h);
+  glViewport(0, 0, display_w, display_h);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  glBindTexture(GL_TEXTURE_2D, texture_id_);
+  CHECK_GL;
+
+  glEnable(GL_TEXTURE_2D);
+  if (texture_width_ != width || texture_height_ != height) {
+    // The resolution or scale changed.
+    texture_width_ = width;
+    texture_height_ = height;
+    glfwSetWindowSize(window_, scaled_width, scaled_height);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width_, texture_height_, 0,
+                 GL_BGRA_EXT, GL_UNSIGNED_BYTE, pixels);
+  } else {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texture_width_, texture_height_,
+                    GL_BGRA_EXT, GL_UNSIGNED_BYTE, pixels);
+  }
+  // The frame is already scaled to the window; only a high DPI display
+  // leaves anything for GL to filter.
+  GLint filter =
+      scaling_quality_ == ScalingQuality::NEAREST ? GL_NEAREST : GL_LINEAR;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  CHECK_GL;
+
+  glBegin(GL_QUADS);
+  glTexCoord2f(0, 1);
+  glVertex3f(-1, -1, 0);
+  glTexCoord2f(1, 1);
+  glVertex3f(1, -1, 0);
+  glTexCoord2f(1, 0);
+  glVertex3f(1, 1, 0);
+  glTexCoord2f(0, 0);
+  glVertex3f(-1, 1, 0);
+  glEnd();
+  CHECK_GL;
+  glDisable(GL_TEXTURE_2D);
+  CHECK_GL;
+
+  glfwSwapBuffers(window_);
+  CHECK_GL;
+  glBindTexture(GL_TEXTURE_2D, 0);
+  CHECK_GL;
+
+  if (scale_after)
+    ScaleFrame(scaled_width, scaled_height);
+}
+
 void Vicky::RenderLine() {
-  glfwPollEvents();
+  if (window_)
+    glfwPollEvents();
 
-  if (vblank_cnt_ < kVickyVBlankLines) {
-    vblank_cnt_++;
+  uint16_t display_line = raster_.NextLine();
+
+  if (display_line >= video_mode_.height) {
+    // Vertical blanking. Resolution changes take effect before the next
+    // frame.
+    if (display_line == video_mode_.total_lines - 1)
+      LatchVideoMode();
     return;
   }
 
+  uint32_t *row_pixels = &frame_buffer_[video_mode_.width * display_line];
+  if (pixel_doubling_ && (display_line & 1)) {
+    memcpy(row_pixels, row_pixels - video_mode_.width,
+           video_mode_.width * sizeof(uint32_t));
+    if (is_vertical_end())
+      FinishFrame();
+    return;
+  }
+  raster_y_ = display_line >> pixel_doubling_;
+
   //  if (mode_ & Mstr_Ctrl_Disable_Vid)
   //    return;
 
@@ -406,121 +643,135 @@ void Vicky::RenderLine() {
     }
   }
 
-  uint32_t *row_pixels = &frame_buffer_[kVickyBitmapWidth * raster_y_];
-
   // Calculate sprites valid for this row before scanning.
   uint32_t sprite_masks[4]{0, 0, 0, 0};
   if (mode_ & Mstr_Ctrl_Sprite_En) {
+    bool any_sprites = false;
     for (uint8_t sprite_num = 0; sprite_num < 32; sprite_num++) {
       Sprite &sprite = sprites_[sprite_num];
-      if (!sprite.enabled || sprite.y < raster_y_ ||
-          sprite.y > raster_y_ + kSpriteSize || sprite.x > 479)
+      if (!sprite.enabled || raster_y_ < sprite.y ||
+          raster_y_ >= sprite.y + kSpriteSize ||
+          sprite.x >= width_)
         continue;
-      Set32(&sprite_masks[sprite.layer], sprite_num);
+      Set32(&sprite_masks[sprite.layer & (kNumLayers - 1)], sprite_num);
+      any_sprites = true;
     }
+    if (any_sprites)
+      DetectCollisions(sprite_masks);
   }
 
-  for (uint16_t raster_x = 0; raster_x < kVickyBitmapWidth; raster_x++) {
-    CHECK(raster_x < 640);
-    uint32_t *row_pixel = &row_pixels[raster_x];
+  uint8_t features = line_features_;
+  if (sprite_masks[0] | sprite_masks[1] | sprite_masks[2] | sprite_masks[3])
+    features |= kLineSprites;
+  (this->*kLineCompositors[features])(row_pixels, sprite_masks);
 
-    // Background colour
-    row_pixels[raster_x] = ColourCorrect(background_bgr_.v);
+  if (pixel_doubling_) {
+    // Spread the composed half line over the whole row, from the right so
+    // nothing is overwritten before it's read.
+    for (int x = width_; x-- > 0;)
+      row_pixels[x * 2] = row_pixels[x * 2 + 1] = row_pixels[x];
+  }
 
-    // Bitmap
-    if (mode_ & Mstr_Ctrl_Bitmap_En && bitmap_enabled_)
-      RenderBitmap(raster_x, row_pixel);
+  if (is_vertical_end())
+    FinishFrame();
+}
 
-    // Layers back to front, sprites first, tiles next
-    for (uint8_t layer = kNumLayers; layer-- > 0;) {
-      // Sprites
-      if (sprite_masks[layer]) {
-        RenderSprites(raster_x, layer, sprite_masks[layer], row_pixel);
-      }
+void Vicky::LatchVideoMode() {
+  const VickyVideoMode &video_mode =
+      mode_ & Mstr_Ctrl_Video_Mode0 ? kVicky800x600 : kVicky640x480;
+  bool pixel_doubling = mode_ & Mstr_Ctrl_Video_Mode1;
+  if (video_mode.width == video_mode_.width &&
+      pixel_doubling == pixel_doubling_)
+    return;
 
-      if (mode_ & Mstr_Ctrl_TileMap_En) {
-        RenderTileMap(raster_x, layer, row_pixel);
-      }
+  bool retimed = video_mode.total_lines != video_mode_.total_lines;
+  video_mode_ = video_mode;
+  pixel_doubling_ = pixel_doubling;
+  width_ = video_mode_.width >> pixel_doubling_;
+  height_ = video_mode_.height >> pixel_doubling_;
+  // Still the last line of the frame, whatever its number is now.
+  raster_.SetMode(video_mode_.total_lines, video_mode_.line_dots);
+  if (retimed) {
+    sys_->SetLinesPerFrame(video_mode_.total_lines);
+    raster_.Reschedule();
+  }
+}
+
+void Vicky::UpdateLineFeatures() {
+  uint8_t features = 0;
+  if (mode_ & Mstr_Ctrl_Bitmap_En && bitmap_enabled_)
+    features |= kLineBitmap;
+  if (mode_ & Mstr_Ctrl_TileMap_En) {
+    for (const TileSet &tile_set : tile_sets_) {
+      if (tile_set.enabled)
+        features |= kLineTiles;
     }
+  }
+  if (mode_ & Mstr_Ctrl_Text_Mode_En || mode_ & Mstr_Ctrl_Text_Overlay)
+    features |= kLineCharGen;
+  if (mouse_cursor_enable_)
+    features |= kLineMouse;
+  if (border_enabled_)
+    features |= kLineBorder;
+  line_features_ = features;
+}
 
-    // Characters
-    if (run_char_gen) {
-      RenderCharacterGenerator(raster_x, row_pixel);
+template <size_t kFeatures>
+void Vicky::ComposeLine(uint32_t *row_pixels, const uint32_t *sprite_masks) {
+  uint16_t begin = 0;
+  uint16_t end = width_;
+  if (kFeatures & kLineBorder) {
+    uint32_t border_colour = ColourCorrect(border_colour_.v);
+    if (raster_y_ < kBorderHeight || raster_y_ > height_ - kBorderHeight) {
+      std::fill(row_pixels, row_pixels + width_, border_colour);
+      return;
     }
+    // The right border starts one dot short of its width.
+    end = width_ - kBorderWidth + 1;
+    std::fill(row_pixels, row_pixels + kBorderWidth, border_colour);
+    std::fill(row_pixels + end, row_pixels + width_, border_colour);
+    begin = kBorderWidth;
+  }
 
-    // Mouse
-    if (mouse_cursor_enable_)
-      RenderMouseCursor(raster_x, row_pixel);
+  uint32_t background = ColourCorrect(background_bgr_.v);
+  for (uint16_t raster_x = begin; raster_x < end; raster_x++) {
+    uint32_t *row_pixel = &row_pixels[raster_x];
+    *row_pixel = background;
 
-    if (border_enabled_) {
-      uint32_t border_colour = ColourCorrect(border_colour_.v);
-      if (raster_x < kBorderWidth) {
-        *row_pixel = border_colour;
-        continue;
-      }
-      if (raster_x > kVickyBitmapWidth - kBorderWidth) {
-        *row_pixel = border_colour;
+    if (kFeatures & kLineBitmap)
+      RenderBitmap(raster_x, row_pixel);
 
-        continue;
+    // Layers back to front, sprites first, tiles next
+    if (kFeatures & (kLineSprites | kLineTiles)) {
+      for (uint8_t layer = kNumLayers; layer-- > 0;) {
+        if (kFeatures & kLineSprites && sprite_masks[layer])
+          RenderSprites(raster_x, layer, sprite_masks[layer], row_pixel);
+        if (kFeatures & kLineTiles)
+          RenderTileMap(raster_x, layer, row_pixel);
       }
-      if (raster_y_ < kBorderHeight) {
-        *row_pixel = border_colour;
+    }
 
-        continue;
-      }
-      if (raster_y_ > kVickyBitmapHeight - kBorderHeight) {
-        *row_pixel = border_colour;
+    if (kFeatures & kLineCharGen)
+      RenderCharacterGenerator(raster_x, row_pixel);
 
-        continue;
-      }
-    }
+    if (kFeatures & kLineMouse)
+      RenderMouseCursor(raster_x, row_pixel);
   }
+}
 
-  // TODO line interrupt
-  raster_y_++;
-  if (raster_y_ == kVickyBitmapHeight) {
-    int display_w, display_h;
-    glfwMakeContextCurrent(window_);
-    glfwGetFramebufferSize(window_, &display_w, &display_h);
-    glViewport(0, 0, display_w, display_h);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glBindTexture(GL_TEXTURE_2D, texture_id_);
-    CHECK_GL;
-
-    glEnable(GL_TEXTURE_2D);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, kVickyBitmapWidth,
-                    kVickyBitmapHeight, GL_BGRA_EXT, GL_UNSIGNED_BYTE,
-                    frame_buffer_);
-    CHECK_GL;
-
-    glBegin(GL_QUADS);
-    glTexCoord2f(0, 1);
-    glVertex3f(-1, -1, 0);
-    glTexCoord2f(1, 1);
-    glVertex3f(1, -1, 0);
-    glTexCoord2f(1, 0);
-    glVertex3f(1, 1, 0);
-    glTexCoord2f(0, 0);
-    glVertex3f(-1, 1, 0);
-    glEnd();
-    CHECK_GL;
-    glDisable(GL_TEXTURE_2D);
-    CHECK_GL;
-
-    glfwSwapBuffers(window_);
-    CHECK_GL;
-    glBindTexture(GL_TEXTURE_2D, 0);
-    CHECK_GL;
-
-    vblank_cnt_ = 0;
-    raster_y_ = 0;
-  }
+template <size_t... kFeatures>
+constexpr std::array<Vicky::LineCompositor, sizeof...(kFeatures)>
+Vicky::MakeLineCompositors(std::index_sequence<kFeatures...>) {
+  return {{&Vicky::ComposeLine<kFeatures>...}};
 }
 
+const std::array<Vicky::LineCompositor, Vicky::kLineFeatureSets>
+    Vicky::kLineCompositors =
+        MakeLineCompositors(std::make_index_sequence<kLineFeatureSets>());
+
 bool Vicky::RenderBitmap(uint16_t raster_x, uint32_t *row_pixel) {
   uint8_t *indexed_row =
-      video_ram_ + bitmap_addr_offset_ + (raster_y_ * kVickyBitmapWidth);
+      video_ram_ + bitmap_addr_offset_ + (raster_y_ * width_);
   uint8_t colour_index = indexed_row[raster_x];
   if (colour_index == 0)
     return false;
@@ -553,61 +804,166 @@ bool Vicky::RenderSprites(uint16_t raster_x, uint8_t layer,
   return false;
 }
 
-bool Vicky::RenderTileMap(uint16_t raster_x, uint8_t layer,
-                          uint32_t *row_pixel) {
-  if (tile_sets_[layer].enabled) {
-    // TODO support for linear tile sheets.  this assumes a 256x256 sheet
-    // of 16x16 tiles for now.
-    const auto &tile_set = tile_sets_[layer];
-
-    uint16_t adjusted_x = raster_x;
-    uint16_t adjusted_y = raster_y_;
-
-    // Try to take account of the horizontal and vertical scroll.
-    // TODO: this is untested.
-    if (tile_set.scroll_x_enable) {
-      adjusted_x -= (tile_set.offset_x & 0x0f);
+void Vicky::DetectCollisions(const uint32_t sprite_masks[kNumLayers]) {
+  // Each sprite's opaque pixels on this line, as two words of the line's
+  // bitmask starting at 'word'; 32 dots span at most two.
+  struct SpriteRow {
+    uint8_t sprite;
+    uint8_t word;
+    uint64_t bits[2];
+  };
+  SpriteRow rows[32];
+  int num_rows = 0;
+  uint64_t covered[kLineWords + 1]{};
+  uint64_t overlap[kLineWords + 1]{};
+
+  uint32_t on_line = sprite_masks[0] | sprite_masks[1] | sprite_masks[2] |
+                     sprite_masks[3];
+  for (int sprite_num = 0; on_line; sprite_num++, on_line >>= 1) {
+    if (!(on_line & 1))
+      continue;
+    const Sprite &sprite = sprites_[sprite_num];
+    uint32_t row_addr =
+        sprite.start_addr + (raster_y_ - sprite.y) * kSpriteSize;
+    if (row_addr + kSpriteSize > sizeof(video_ram_))
+      continue;
+    const uint8_t *pixels = video_ram_ + row_addr;
+    uint64_t bits = 0;
+    for (int i = 0; i < kSpriteSize; i++)
+      bits |= uint64_t(pixels[i] != 0) << i;
+    if (!bits)
+      continue;
+
+    SpriteRow &row = rows[num_rows++];
+    row.sprite = sprite_num;
+    row.word = sprite.x / 64;
+    int shift = sprite.x % 64;
+    row.bits[0] = bits << shift;
+    row.bits[1] = shift ? bits >> (64 - shift) : 0;
+    // Drop anything past the right edge. The array's spare last word takes
+    // what spills out of the widest mode.
+    for (int i = 0; i < 2; i++) {
+      int edge = width_ - (row.word + i) * 64;
+      if (edge <= 0)
+        row.bits[i] = 0;
+      else if (edge < 64)
+        row.bits[i] &= (uint64_t(1) << edge) - 1;
     }
-    if (tile_set.scroll_y_enable) {
-      adjusted_y -= (tile_set.offset_y & 0x0f);
+    for (int i = 0; i < 2; i++) {
+      overlap[row.word + i] |= covered[row.word + i] & row.bits[i];
+      covered[row.word + i] |= row.bits[i];
     }
+  }
 
-    if (adjusted_x > kVickyBitmapWidth || adjusted_y > kVickyBitmapHeight)
-      return false;
+  uint32_t sprite_hits = 0;
+  for (int r = 0; r < num_rows; r++) {
+    const SpriteRow &row = rows[r];
+    if ((overlap[row.word] & row.bits[0]) |
+        (overlap[row.word + 1] & row.bits[1]))
+      sprite_hits |= 1u << row.sprite;
+  }
 
-    uint8_t screen_tile_row = adjusted_y / kTileSize;
-    uint8_t screen_tile_sub_row = adjusted_y % kTileSize;
+  // Tile layers are only sampled under the sprites, a word at a time.
+  uint32_t tile_hits = 0;
+  if (mode_ & Mstr_Ctrl_TileMap_En) {
+    uint64_t tiles[kLineWords]{};
+    uint16_t sampled = 0;
+    for (int r = 0; r < num_rows; r++) {
+      const SpriteRow &row = rows[r];
+      for (int i = 0; i < 2; i++) {
+        int word = row.word + i;
+        if (word >= kLineWords || !row.bits[i])
+          continue;
+        if (!(sampled & (1 << word))) {
+          sampled |= 1 << word;
+          for (uint8_t layer = 0; layer < kNumLayers; layer++) {
+            if (!tile_sets_[layer].enabled)
+              continue;
+            for (int x = 0; x < 64; x++) {
+              if (TileColourIndex(word * 64 + x, layer))
+                tiles[word] |= uint64_t(1) << x;
+            }
+          }
+        }
+        if (tiles[word] & row.bits[i])
+          tile_hits |= 1u << row.sprite;
+      }
+    }
+  }
 
-    uint8_t screen_tile_col = adjusted_x / kTileSize;
-    uint8_t screen_tile_sub_col = adjusted_x % kTileSize;
+  // Interrupt only on collisions the guest hasn't seen yet, not on every
+  // line of an ongoing one.
+  uint32_t new_sprite_hits = sprite_hits & ~sprite_collisions_;
+  uint32_t new_tile_hits = tile_hits & ~tile_collisions_;
+  sprite_collisions_ |= sprite_hits;
+  tile_collisions_ |= tile_hits;
+  if (new_sprite_hits)
+    int_controller_->SetSpriteCollision(true);
+  if (new_tile_hits)
+    int_controller_->SetTileCollision(true);
+}
 
-    TileMem *tile_mem = &tile_mem_[layer];
-    uint8_t tile_num = tile_mem->map[screen_tile_row][screen_tile_col];
-    uint8_t *tile_sheet_bitmap = &video_ram_[tile_set.start_addr];
+uint8_t Vicky::TileColourIndex(uint16_t raster_x, uint8_t layer) {
+  // TODO support for linear tile sheets.  this assumes a 256x256 sheet
+  // of 16x16 tiles for now.
+  const auto &tile_set = tile_sets_[layer];
 
-    uint8_t tile_sheet_column =
-        tile_num % kTileSize; // the column in the tile sheet
-    uint8_t tile_sheet_row = tile_num / kTileSize; // the row in the tile sheet
+  uint16_t adjusted_x = raster_x;
+  uint16_t adjusted_y = raster_y_;
 
-    // the physical memory location of the row in the sheet our tile is
-    // in
-    uint8_t *tile_bitmap_row =
-        &tile_sheet_bitmap[(tile_sheet_row * kTileSize + screen_tile_sub_row) *
-                           kTileSetStride];
+  // Try to take account of the horizontal and vertical scroll.
+  // TODO: this is untested.
+  if (tile_set.scroll_x_enable) {
+    adjusted_x -= (tile_set.offset_x & 0x0f);
+  }
+  if (tile_set.scroll_y_enable) {
+    adjusted_y -= (tile_set.offset_y & 0x0f);
+  }
 
-    // the physical memory location of the column in the sheet our tile
-    // is in
-    uint8_t *tile_bitmap_column =
-        &tile_bitmap_row[tile_sheet_column * kTileSize];
+  if (adjusted_x > width_ || adjusted_y > height_)
+    return 0;
 
-    uint8_t colour_index = tile_bitmap_column[screen_tile_sub_col];
-    if (colour_index == 0)
-      return false;
+  uint8_t screen_tile_row = adjusted_y / kTileSize;
+  uint8_t screen_tile_sub_row = adjusted_y % kTileSize;
 
-    *row_pixel = ColourCorrect(lut_[tile_set.lut][colour_index].v);
-    return true;
-  }
-  return false;
+  uint8_t screen_tile_col = adjusted_x / kTileSize;
+  uint8_t screen_tile_sub_col = adjusted_x % kTileSize;
+
+  // 800x600 has more rows than the tile map.
+  if (screen_tile_row >= 32)
+    return 0;
+
+  TileMem *tile_mem = &tile_mem_[layer];
+  uint8_t tile_num = tile_mem->map[screen_tile_row][screen_tile_col];
+  uint8_t *tile_sheet_bitmap = &video_ram_[tile_set.start_addr];
+
+  uint8_t tile_sheet_column =
+      tile_num % kTileSize; // the column in the tile sheet
+  uint8_t tile_sheet_row = tile_num / kTileSize; // the row in the tile sheet
+
+  // the physical memory location of the row in the sheet our tile is
+  // in
+  uint8_t *tile_bitmap_row =
+      &tile_sheet_bitmap[(tile_sheet_row * kTileSize + screen_tile_sub_row) *
+                         kTileSetStride];
+
+  // the physical memory location of the column in the sheet our tile
+  // is in
+  uint8_t *tile_bitmap_column =
+      &tile_bitmap_row[tile_sheet_column * kTileSize];
+
+  return tile_bitmap_column[screen_tile_sub_col];
+}
+
+bool Vicky::RenderTileMap(uint16_t raster_x, uint8_t layer,
+                          uint32_t *row_pixel) {
+  if (!tile_sets_[layer].enabled)
+    return false;
+  uint8_t colour_index = TileColourIndex(raster_x, layer);
+  if (colour_index == 0)
+    return false;
+  *row_pixel = ColourCorrect(lut_[tile_sets_[layer].lut][colour_index].v);
+  return true;
 }
 
 bool Vicky::RenderMouseCursor(uint16_t raster_x, uint32_t *row_pixel) {
@@ -646,6 +1002,10 @@ bool Vicky::RenderCharacterGenerator(uint16_t raster_x, uint32_t *row_pixel) {
   uint8_t column = bitmap_x / 8;
   uint8_t sub_column = bitmap_x % 8;
 
+  // 800x600 has more rows than text memory holds.
+  if (column + row * kColsPerLine >= int(kTextMemorySize))
+    return false;
+
   uint8_t character = text_mem_[column + (row * kColsPerLine)];
   uint8_t colour = text_colour_mem_[column + (row * kColsPerLine)];
   uint8_t fg_colour_num = (uint8_t)((colour & 0xf0) >> 4);
@@ -694,6 +1054,6 @@ uint32_t Vicky::ColourCorrect(uint32_t colour_val) {
 
 void Vicky::set_scale(float scale) {
   scale_ = scale;
-  glfwSetWindowSize(window_, kVickyBitmapWidth * scale,
-                    kVickyBitmapHeight * scale);
+  if (window_)
+    glfwSetWindowSize(window_, frame_width() * scale, frame_height() * scale);
 }
@@ -3,13 +3,19 @@
 #include <GLFW/glfw3.h>
 #include <glog/logging.h>
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <utility>
 
+#include "bus/frame_export.h"
+#include "bus/raster.h"
 #include "bus/register_utils.h"
+#include "bus/scaler.h"
 #include "cpu.h"
 
 class System;
@@ -18,11 +24,19 @@ class InterruptController;
 constexpr uint8_t kBorderWidth = 16;
 constexpr uint8_t kBorderHeight = 16;
 
-constexpr uint16_t kVickyBitmapWidth = 640;
-constexpr uint16_t kVickyBitmapHeight = 480;
-constexpr uint16_t kVickyVBlankLines = 45;
+// A displayed resolution and its timing.
+struct VickyVideoMode {
+  uint16_t width;
+  uint16_t height;
+  uint16_t total_lines;  // Including vertical blanking.
+  uint16_t line_dots;    // Including horizontal blanking.
+};
+constexpr VickyVideoMode kVicky640x480 = {640, 480, 525, 800};
+constexpr VickyVideoMode kVicky800x600 = {800, 600, 628, 1056};
 
-constexpr uint32_t kRasterSize = kVickyBitmapWidth * kVickyBitmapHeight;
+constexpr uint16_t kVickyMaxWidth = 800;
+constexpr uint16_t kVickyMaxHeight = 600;
+constexpr uint32_t kRasterSize = kVickyMaxWidth * kVickyMaxHeight;
 
 constexpr uint8_t kNumLayers = 4;
 
@@ -37,7 +51,8 @@ class Vicky {
   // Initialize.
   GLFWwindow *Start();
 
-  // Render a single scan line and advance to the next.
+  // Render a single scan line and advance to the next. With pixel doubling,
+  // every other line is a copy of the one before.
   void RenderLine();
 
   void StoreByte(uint32_t addr, uint8_t v);
@@ -45,23 +60,100 @@ class Vicky {
 
   void InitPages(Page* vicky_page_start);
 
-  inline bool is_vertical_end() { return raster_y_ == 479; }
+  inline bool is_vertical_end() {
+    return raster_.row() == video_mode_.height - 1;
+  }
   inline int current_scanline() { return raster_y_; }
-  inline int max_scanline() { return kVickyBitmapHeight; }
+  inline int max_scanline() { return height_; }
+
+  // Lines per frame, including vertical blanking, for the current mode.
+  uint16_t total_lines() const { return video_mode_.total_lines; }
+
+  // The line the beam is on, counting vertical blanking lines after the
+  // visible ones, and its dot position within it.
+  uint16_t raster_row() const { return raster_.row(); }
+  uint16_t RasterColumn() const { return raster_.Column(); }
 
   uint8_t* vram() { return video_ram_; }
+  size_t vram_size() const { return sizeof(video_ram_); }
+
+  // The last rendered frame, as 32-bit BGRA pixels, frame_width() to a row.
+  // Doubled pixels are stored doubled.
+  uint32_t* frame_buffer() { return frame_buffer_; }
+  uint16_t frame_width() const { return video_mode_.width; }
+  uint16_t frame_height() const { return video_mode_.height; }
+
+  // Hash of the register state and on-chip memories (LUTs, fonts, text and
+  // tile maps), but not video RAM.
+  uint64_t HashState(uint64_t seed) const;
 
   //  unsigned int window_id() const;
 
+  // Frames are scaled by 'scale' on the CPU, with 'scaling_quality', for
+  // the window and ScaledFrame(). They start out as -scale and
+  // -scaling_quality.
   void set_scale(float scale);
   float scale() const { return scale_; }
 
-  enum class ScalingQuality { NEAREST, LINEAR, BEST };
+  using ScalingQuality = ::ScalingQuality;
+  void set_scaling_quality(ScalingQuality quality) {
+    scaling_quality_ = quality;
+  }
+  ScalingQuality scaling_quality() const { return scaling_quality_; }
+
+  // Scale every frame even without a window, ahead of ScaledFrame(); with a
+  // scaler thread, that happens while the next frame is emulated.
+  void set_scaled_output(bool scaled_output) { scaled_output_ = scaled_output; }
+
+  // The last frame, scaled, and its size. The frame is scaled now unless
+  // that was already done or under way, in which case this may wait for it.
+  // Valid until the end of the next frame. Call on the CPU thread.
+  const uint32_t* ScaledFrame(int* width, int* height);
+
+  // Publish every completed frame, unscaled, to the shared memory segment
+  // 'name' from now on; see FrameExport. Call before Run().
+  bool StartFrameExport(const std::string& name);
 
   void set_gamma_override(bool override) { gamma_override_ = override; }
   bool gamma_override() const { return gamma_override_; }
 
  private:
+  // The features a line is composed from. Every combination has its own
+  // compositor, instantiated from ComposeLine, so the per-pixel loop has no
+  // tests for features that are off.
+  enum LineFeature : uint8_t {
+    kLineBitmap = 1 << 0,
+    kLineTiles = 1 << 1,
+    kLineSprites = 1 << 2,  // Set per line, when sprites cover it.
+    kLineCharGen = 1 << 3,
+    kLineMouse = 1 << 4,
+    kLineBorder = 1 << 5,
+  };
+  static constexpr size_t kLineFeatureSets = 1 << 6;
+
+  using LineCompositor = void (Vicky::*)(uint32_t* row_pixels,
+                                         const uint32_t* sprite_masks);
+  template <size_t kFeatures>
+  void ComposeLine(uint32_t* row_pixels, const uint32_t* sprite_masks);
+  template <size_t... kFeatures>
+  static constexpr std::array<LineCompositor, sizeof...(kFeatures)>
+  MakeLineCompositors(std::index_sequence<kFeatures...>);
+  static const std::array<LineCompositor, kLineFeatureSets> kLineCompositors;
+
+  // Recomputes line_features_; called when the mode or an enable changes.
+  void UpdateLineFeatures();
+
+  // Switches to the resolution selected in the master control register.
+  // Only done between frames.
+  void LatchVideoMode();
+
+  // Hands the finished frame to the window and/or the scaler.
+  void FinishFrame();
+  // Starts scaling the finished frame to 'width' x 'height'.
+  void ScaleFrame(int width, int height);
+  void ScaledSize(int* width, int* height) const;
+  // Uploads the finished frame to the window's texture and swaps buffers.
+  void PresentFrame();
   bool RenderBitmap(uint16_t raster_x, uint32_t* pixel);
   bool RenderCharacterGenerator(uint16_t raster_x, uint32_t* pixel);
   bool RenderMouseCursor(uint16_t raster_x, uint32_t* pixel);
@@ -71,6 +163,14 @@ class Vicky {
                      uint32_t sprite_mask,
                      uint32_t* pixel);
 
+  // The tile layer's colour index at 'raster_x' on this line; 0 is
+  // transparent.
+  uint8_t TileColourIndex(uint16_t raster_x, uint8_t layer);
+
+  // Checks the sprites on this line, in 'sprite_masks' by layer, against
+  // each other and the tile layers, and latches and raises any collisions.
+  void DetectCollisions(const uint32_t sprite_masks[kNumLayers]);
+
   uint32_t ColourCorrect(uint32_t colour_val);
 
   System* sys_;
@@ -78,11 +178,18 @@ class Vicky {
 
   float scale_ = 1.0;
   ScalingQuality scaling_quality_ = ScalingQuality::NEAREST;
+  bool scaled_output_ = false;
+  std::unique_ptr<FrameScaler> scaler_;
+  FrameExport frame_export_;
+  // Frames completed since power on.
+  uint64_t frames_finished_ = 0;
+  // The frames_finished_ of the frame last handed to the scaler.
+  uint64_t scaled_frame_ = UINT64_MAX;
 
   // Enable gamma correction even if the video mode doesn't say so.
   bool gamma_override_ = true;
 
-  GLFWwindow *window_;
+  GLFWwindow *window_ = nullptr;
 
   union BGRAColour {
     uint32_t v;
@@ -165,13 +272,31 @@ class Vicky {
   };
   Sprite sprites_[32];
 
+  uint32_t sprite_collisions_ = 0;
+  uint32_t tile_collisions_ = 0;
+
   bool border_enabled_{};
   BGRAColour border_colour_;
 
-  uint8_t vblank_cnt_ = 0;
+  // The features in use for every line; all but kLineSprites.
+  uint8_t line_features_ = 0;
+
+  VickyVideoMode video_mode_ = kVicky640x480;
+  bool pixel_doubling_ = false;
+  // The composed resolution; half the displayed one when doubling.
+  uint16_t width_ = kVicky640x480.width;
+  uint16_t height_ = kVicky640x480.height;
+
+  // The composed line the renderers are working on.
   uint16_t raster_y_ = 0;
 
+  // Frames start with vertical blanking, so the line before the first is
+  // the last visible one.
+  Raster raster_;
+
   // Our physical frame buffer
   uint32_t frame_buffer_[kRasterSize];
   GLuint texture_id_;
+  uint16_t texture_width_ = 0;
+  uint16_t texture_height_ = 0;
 };
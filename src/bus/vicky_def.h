@@ -14,6 +14,10 @@ constexpr uint8_t Mstr_Ctrl_Sprite_En = 0x20;
 constexpr uint8_t Mstr_Ctrl_GAMMA_En = 0x40;
 constexpr uint8_t Mstr_Ctrl_Disable_Vid = 0x80;
 
+// Control bits in the high byte, as part of the 16-bit mode.
+constexpr uint16_t Mstr_Ctrl_Video_Mode0 = 0x0100;  // 0 = 640x480, 1 = 800x600
+constexpr uint16_t Mstr_Ctrl_Video_Mode1 = 0x0200;  // Pixel doubling
+
 // Reserved - TBD
 constexpr uint32_t VKY_RESERVED_00(0x0002);
 constexpr uint32_t VKY_RESERVED_01(0x0003);
@@ -35,6 +39,21 @@ constexpr uint32_t kCursorColour(0x0013);
 constexpr uint32_t kCursorX(0x0014);
 constexpr uint32_t kCursorY(0x0016);
 
+// Read only: the beam position. The column counts dots across the whole
+// line, including horizontal blanking; the row counts from the first
+// visible line, with the vertical blanking lines numbered after the last.
+constexpr uint32_t kRasterColumn(0x0018);
+constexpr uint32_t kRasterRow(0x001A);
+
+// Write only (reads give the raster row). Raise the line interrupt when the
+// beam reaches the start of line compare 0 or 1.
+constexpr uint32_t kLineIrqCtrlReg(0x001B);
+constexpr uint8_t Line_Irq_Enable0 = 0x01;
+constexpr uint8_t Line_Irq_Enable1 = 0x02;
+constexpr uint32_t kLineCompare0(0x001C);
+constexpr uint32_t kLineCompare1(0x001E);
+
+// On hardware these overlap the line compare registers when read.
 constexpr uint32_t VKY_INFO_CHIP_NUM_L(0x001C);
 constexpr uint32_t VKY_INFO_CHIP_NUM_H(0x001D);
 constexpr uint32_t VKY_INFO_CHIP_VER_L(0x001E);
@@ -87,6 +106,12 @@ constexpr uint32_t kSpriteRegistersBegin(0x0200);
 constexpr uint32_t kSpriteRegistersEnd(0x02F8);
 constexpr uint8_t kNumSpriteRegisters(0x08);
 
+// Collision flags, one bit per sprite; write 1 to clear. Sprites that
+// overlapped another sprite, and sprites that overlapped a tile layer, on
+// non-transparent pixels.
+constexpr uint32_t kSpriteCollisionReg(0x0300);
+constexpr uint32_t kTileCollisionReg(0x0304);
+
 // DMA Controller 0xAF0400 - 0xAF04FF
 constexpr uint32_t VDMA_CONTROL_REG(0x0400);
 constexpr uint32_t VDMA_COUNT_REG_L(0x0401);
@@ -0,0 +1,241 @@
+#include "bus/video_recorder.h"
+
+#include <glog/logging.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstring>
+
+#include "bus/hash.h"
+
+namespace {
+
+// Frames the writer can fall behind by before the CPU thread waits.
+constexpr int kQueueFrames = 8;
+
+constexpr int kFrameRate = 60;
+
+inline uint8_t LumaOf(int r, int g, int b) {
+  return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+}  // namespace
+
+void BgraToI420(const uint32_t* bgra, int width, int height, uint8_t* y,
+                uint8_t* u, uint8_t* v) {
+  int chroma_width = (width + 1) / 2;
+  for (int row = 0; row < height; row += 2) {
+    const uint32_t* top = bgra + row * width;
+    // An odd last row pairs with itself.
+    const uint32_t* bottom = row + 1 < height ? top + width : top;
+    uint8_t* y_top = y + row * width;
+    uint8_t* y_bottom = row + 1 < height ? y_top + width : y_top;
+    uint8_t* u_row = u + (row / 2) * chroma_width;
+    uint8_t* v_row = v + (row / 2) * chroma_width;
+    for (int col = 0; col < width; col += 2) {
+      int next = col + 1 < width ? col + 1 : col;
+      const uint32_t quad[4] = {top[col], top[next], bottom[col],
+                                bottom[next]};
+      int r = 0, g = 0, b = 0;
+      for (uint32_t pixel : quad) {
+        r += (pixel >> 16) & 0xFF;
+        g += (pixel >> 8) & 0xFF;
+        b += pixel & 0xFF;
+      }
+      y_top[col] = LumaOf((quad[0] >> 16) & 0xFF, (quad[0] >> 8) & 0xFF,
+                          quad[0] & 0xFF);
+      y_top[next] = LumaOf((quad[1] >> 16) & 0xFF, (quad[1] >> 8) & 0xFF,
+                           quad[1] & 0xFF);
+      y_bottom[col] = LumaOf((quad[2] >> 16) & 0xFF, (quad[2] >> 8) & 0xFF,
+                             quad[2] & 0xFF);
+      y_bottom[next] = LumaOf((quad[3] >> 16) & 0xFF, (quad[3] >> 8) & 0xFF,
+                              quad[3] & 0xFF);
+      // The block's average colour; the sums are 4x, so shift 2 further.
+      u_row[col / 2] = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+      v_row[col / 2] = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+    }
+  }
+}
+
+VideoRecorder::~VideoRecorder() { Stop(); }
+
+// static
+bool VideoRecorder::ParseFormat(const std::string& name, Format* format) {
+  if (name == "y4m") {
+    *format = Format::kY4M;
+    return true;
+  }
+  if (name == "bgra") {
+    *format = Format::kBGRA;
+    return true;
+  }
+  return false;
+}
+
+bool VideoRecorder::Start(const std::string& path, const Options& options) {
+  Stop();
+  bool to_pipe = !path.empty() && path[0] == '|';
+  if (path == "-" || to_pipe) {
+    // Otherwise a reader that exits early kills the emulator; writes fail
+    // with EPIPE instead, and recording stops.
+    signal(SIGPIPE, SIG_IGN);
+  }
+  if (path == "-") {
+    file_ = stdout;
+  } else if (to_pipe) {
+    file_ = popen(path.c_str() + 1, "w");
+    pipe_ = true;
+  } else {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_) {
+      std::string timestamps_path = path + ".timestamps";
+      timestamps_ = fopen(timestamps_path.c_str(), "w");
+      if (!timestamps_)
+        LOG(ERROR) << "Unable to create video timestamps: " << timestamps_path;
+    }
+  }
+  if (!file_) {
+    pipe_ = false;
+    LOG(ERROR) << "Unable to open video output: " << path;
+    return false;
+  }
+
+  options_ = options;
+  if (options_.every < 1)
+    options_.every = 1;
+  width_ = height_ = 0;
+  frames_seen_ = 0;
+  size_warned_ = false;
+  header_written_ = false;
+  failed_ = false;
+  frames_.resize(kQueueFrames);
+  for (Frame& frame : frames_)
+    free_.push_back(&frame);
+  stopping_ = false;
+  writer_ = std::thread(&VideoRecorder::WriterThread, this);
+  LOG(INFO) << "Recording video to " << path;
+  return true;
+}
+
+void VideoRecorder::Stop() {
+  if (!file_)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  writer_.join();
+
+  if (pipe_)
+    pclose(file_);
+  else if (file_ == stdout)
+    fflush(file_);
+  else
+    fclose(file_);
+  file_ = nullptr;
+  pipe_ = false;
+  if (timestamps_)
+    fclose(timestamps_);
+  timestamps_ = nullptr;
+  free_.clear();
+  frames_.clear();
+}
+
+void VideoRecorder::OnFrame(uint64_t frame, uint64_t time_us,
+                            const uint32_t* pixels, int width, int height) {
+  if (failed_ || frames_seen_++ % options_.every != 0)
+    return;
+  bool first = width_ == 0;
+  if (first) {
+    width_ = width;
+    height_ = height;
+  } else if (width != width_ || height != height_) {
+    if (!size_warned_) {
+      LOG(WARNING) << "Video resolution changed to " << width << "x" << height
+                   << "; not recording frames that aren't " << width_ << "x"
+                   << height_;
+      size_warned_ = true;
+    }
+    return;
+  }
+
+  size_t size = size_t(width) * height;
+  if (options_.changed_only) {
+    uint64_t hash = HashBytes(pixels, size * sizeof(uint32_t));
+    if (hash == last_hash_ && !first)
+      return;
+    last_hash_ = hash;
+  }
+
+  Frame* buffer;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return failed_ || !free_.empty(); });
+    if (failed_)
+      return;
+    buffer = free_.back();
+    free_.pop_back();
+  }
+  buffer->frame = frame;
+  buffer->time_us = time_us;
+  buffer->pixels.assign(pixels, pixels + size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(buffer);
+  }
+  cv_.notify_all();
+}
+
+void VideoRecorder::WriterThread() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty())
+      return;
+    Frame* frame = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+    // After a failure, queued frames are only recycled.
+    if (!failed_ && !WriteFrame(*frame)) {
+      LOG(ERROR) << "Unable to write video, stopping recording: "
+                 << strerror(errno);
+      failed_ = true;
+    }
+    lock.lock();
+    free_.push_back(frame);
+    cv_.notify_all();
+  }
+}
+
+bool VideoRecorder::WriteFrame(const Frame& frame) {
+  if (timestamps_ && fprintf(timestamps_, "%" PRIu64 " %" PRIu64 "\n",
+                             frame.frame, frame.time_us) < 0) {
+    return false;
+  }
+  if (options_.format == Format::kBGRA) {
+    return fwrite(frame.pixels.data(), sizeof(uint32_t), frame.pixels.size(),
+                  file_) == frame.pixels.size();
+  }
+
+  if (!header_written_) {
+    // Only the rate of a fixed stride is known up front; with changed_only,
+    // the timestamps have the real times.
+    if (fprintf(file_, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width_,
+                height_, kFrameRate, options_.every) < 0) {
+      return false;
+    }
+    header_written_ = true;
+  }
+
+  size_t luma_size = size_t(width_) * height_;
+  size_t chroma_size = ((width_ + 1) / 2) * ((height_ + 1) / 2);
+  planes_.resize(luma_size + 2 * chroma_size);
+  uint8_t* y = planes_.data();
+  BgraToI420(frame.pixels.data(), width_, height_, y, y + luma_size,
+             y + luma_size + chroma_size);
+  return fprintf(file_, "FRAME Xframe=%" PRIu64 " Xtime_us=%" PRIu64 "\n",
+                 frame.frame, frame.time_us) >= 0 &&
+         fwrite(planes_.data(), 1, planes_.size(), file_) == planes_.size();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Converts 32-bit BGRA pixels to I420 (BT.601, studio range): a full size
+// 'y' plane and 'u' and 'v' planes subsampled 2x2, each ((width + 1) / 2) by
+// ((height + 1) / 2).
+void BgraToI420(const uint32_t* bgra, int width, int height, uint8_t* y,
+                uint8_t* u, uint8_t* v);
+
+// Records presented frames to a Y4M (I420) or raw BGRA video stream.
+//
+// On the CPU thread a frame costs a copy into one of a few preallocated
+// buffers (and a hash, to skip unchanged frames); a writer thread does the
+// colour conversion and the writing. If the writer falls more than the
+// queue behind, the CPU thread waits for it rather than dropping frames.
+// If a write fails (a full disk, or a pipe whose reader has gone), the
+// error is logged and recording stops.
+class VideoRecorder {
+ public:
+  enum class Format { kY4M, kBGRA };
+  struct Options {
+    Format format = Format::kY4M;
+    // Record every Nth frame.
+    int every = 1;
+    // Skip frames identical to the last one recorded.
+    bool changed_only = false;
+  };
+
+  ~VideoRecorder();
+
+  // 'path' is a file, "-" for stdout, or "|command" to pipe to a command.
+  // For a file, each frame's number and emulated time in microseconds go
+  // to '<path>.timestamps' too; Y4M streams also carry them in each frame
+  // header.
+  bool Start(const std::string& path, const Options& options);
+  // Writes out the queued frames and closes the stream.
+  void Stop();
+
+  // False once Stop() is called, or once a write has failed.
+  bool recording() const { return file_ != nullptr && !failed_; }
+
+  // Called on the CPU thread for every presented frame. The stream's size
+  // is set by the first frame recorded; frames of other sizes are skipped.
+  void OnFrame(uint64_t frame, uint64_t time_us, const uint32_t* pixels,
+               int width, int height);
+
+  // "y4m" or "bgra".
+  static bool ParseFormat(const std::string& name, Format* format);
+
+ private:
+  struct Frame {
+    uint64_t frame;
+    uint64_t time_us;
+    std::vector<uint32_t> pixels;
+  };
+
+  void WriterThread();
+  // Returns false if anything couldn't be written.
+  bool WriteFrame(const Frame& frame);
+
+  Options options_;
+  FILE* file_ = nullptr;
+  bool pipe_ = false;
+  FILE* timestamps_ = nullptr;
+
+  int width_ = 0;
+  int height_ = 0;
+  uint64_t frames_seen_ = 0;
+  uint64_t last_hash_ = 0;
+  bool size_warned_ = false;
+
+  // Buffers cycle from free_ to queue_ (under mutex_) and back.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Frame*> free_;
+  std::deque<Frame*> queue_;
+  std::vector<Frame> frames_;
+  bool stopping_ = false;
+  // Set by the writer thread when a write fails.
+  std::atomic_bool failed_{false};
+  std::thread writer_;
+
+  // Used only by the writer thread.
+  bool header_written_ = false;
+  std::vector<uint8_t> planes_;
+};
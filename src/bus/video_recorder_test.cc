@@ -0,0 +1,84 @@
+#include "bus/video_recorder.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+}  // namespace
+
+TEST(VideoRecorderTest, BgraToI420) {
+  // Two columns of white over black, and a 3x3 frame's odd edges.
+  const uint32_t bgra[] = {0xFFFFFFFF, 0xFFFFFFFF, 0xFF000000,  //
+                           0xFFFFFFFF, 0xFFFFFFFF, 0xFF000000,  //
+                           0xFF000000, 0xFF000000, 0xFF0000FF};
+  uint8_t y[9], u[4], v[4];
+  BgraToI420(bgra, 3, 3, y, u, v);
+  EXPECT_EQ(y[0], 235);
+  EXPECT_EQ(y[2], 16);
+  EXPECT_EQ(y[8], 41);
+  EXPECT_EQ(u[0], 128);
+  EXPECT_EQ(v[0], 128);
+  // Pure blue.
+  EXPECT_EQ(u[3], 240);
+  EXPECT_EQ(v[3], 110);
+}
+
+TEST(VideoRecorderTest, RecordsChangedFrames) {
+  std::string path = testing::TempDir() + "video_recorder_test.y4m";
+  VideoRecorder recorder;
+  VideoRecorder::Options options;
+  options.changed_only = true;
+  ASSERT_TRUE(recorder.Start(path, options));
+
+  std::vector<uint32_t> frame(4 * 2, 0xFF000000);
+  recorder.OnFrame(0, 0, frame.data(), 4, 2);
+  recorder.OnFrame(1, 16667, frame.data(), 4, 2);
+  frame[0] = 0xFFFFFFFF;
+  recorder.OnFrame(2, 33333, frame.data(), 4, 2);
+  // Other sizes are skipped.
+  recorder.OnFrame(3, 50000, frame.data(), 2, 2);
+  recorder.Stop();
+  EXPECT_FALSE(recorder.recording());
+
+  const std::string header = "YUV4MPEG2 W4 H2 F60:1 Ip A1:1 C420jpeg\n";
+  const size_t frame_size = 4 * 2 + 2 * 2 * 1;
+  std::string video = ReadFile(path);
+  ASSERT_EQ(video.size(), header.size() +
+                              sizeof("FRAME Xframe=0 Xtime_us=0\n") - 1 +
+                              sizeof("FRAME Xframe=2 Xtime_us=33333\n") - 1 +
+                              2 * frame_size);
+  EXPECT_EQ(video.substr(0, header.size()), header);
+  EXPECT_EQ(ReadFile(path + ".timestamps"), "0 0\n2 33333\n");
+}
+
+TEST(VideoRecorderTest, StopsWhenThePipeCloses) {
+  VideoRecorder recorder;
+  ASSERT_TRUE(recorder.Start("|true", VideoRecorder::Options()));
+
+  // Frames bigger than the pipe's buffer, so writes fail once 'true' exits.
+  std::vector<uint32_t> frame(640 * 480);
+  for (int i = 0; i < 1000 && recorder.recording(); i++)
+    recorder.OnFrame(i, i * 16667, frame.data(), 640, 480);
+  EXPECT_FALSE(recorder.recording());
+  recorder.Stop();
+}
+
+TEST(VideoRecorderTest, ParseFormat) {
+  VideoRecorder::Format format;
+  EXPECT_TRUE(VideoRecorder::ParseFormat("bgra", &format));
+  EXPECT_EQ(format, VideoRecorder::Format::kBGRA);
+  EXPECT_TRUE(VideoRecorder::ParseFormat("y4m", &format));
+  EXPECT_EQ(format, VideoRecorder::Format::kY4M);
+  EXPECT_FALSE(VideoRecorder::ParseFormat("avi", &format));
+}
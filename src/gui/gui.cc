@@ -251,6 +251,11 @@ void GUI::DrawVickySettings() const {
     if (ImGui::InputFloat("Screen scale", &scale, 0.1)) {
       system_->vicky()->set_scale(scale);
     }
+    int quality = static_cast<int>(system_->vicky()->scaling_quality());
+    if (ImGui::Combo("Scaling quality", &quality, kScalingQualitiesLabels,
+                     IM_ARRAYSIZE(kScalingQualitiesLabels))) {
+      system_->vicky()->set_scaling_quality(kScalingQualities[quality]);
+    }
     bool gamma_overide = system_->vicky()->gamma_override();
     if (ImGui::Checkbox("Gamma override", &gamma_overide)) {
       system_->vicky()->set_gamma_override(gamma_overide);
@@ -269,7 +274,8 @@ void GUI::DrawDisassembler() {
     return ImGui::End();
   }
   Disassembler *disassembler = system_->cpu()->GetDisassembler();
-  ImGui::Columns(3);
+  const SymbolTable *symbols = system_->symbols();
+  ImGui::Columns(4);
   ImVec4 yellow{0xff, 0xd3, 0x00, 0xff};
   ImVec4 red{0xde, 0x17, 0x38, 0xff};
   ImVec4 blue{0x00, 0xb2, 0xff, 0xff};
@@ -293,6 +299,8 @@ void GUI::DrawDisassembler() {
       cpuaddr_t address = instruction.canonical_address;
       ImGui::TextColored(red, "%s", Addr(address).c_str());
       ImGui::NextColumn();
+      ImGui::TextColored(red, "%s", symbols->Describe(address).c_str());
+      ImGui::NextColumn();
       ImGui::TextColored(yellow, "%s",
                          instruction.asm_string.substr(8, 12).c_str());
       ImGui::NextColumn();
@@ -320,6 +328,9 @@ void GUI::DrawDisassembler() {
       }
     }
 
+    ImGui::NextColumn();
+    ImGui::TextColored(is_first ? blue : white, "%s",
+                       symbols->Describe(address).c_str());
     ImGui::NextColumn();
     ImGui::TextColored(is_first ? blue : white, "%s",
                        instruction.asm_string.substr(8, 12).c_str());
@@ -419,10 +430,14 @@ void GUI::DrawBreakpoints() {
     auto it = breakpoints.begin();
     while (it != breakpoints.end()) {
       cpuaddr_t breakpoint = it->address;
-      ImGui::Columns(2);
+      ImGui::Columns(3);
       uint8_t bank = breakpoint >> 16;
       uint16_t addr = breakpoint & 0x0000ffff;
-      ImGui::LabelText("Address", "%02x:%04x", bank, addr);
+      ImGui::LabelText("Address", "%02x:%04x %s", bank, addr,
+                       system_->symbols()->Describe(breakpoint).c_str());
+      ImGui::NextColumn();
+      ImGui::LabelText("Hits", "%llu %s", (unsigned long long)it->hit_count,
+                       it->condition.c_str());
       ImGui::NextColumn();
       if (ImGui::Button("Delete")) {
         system_->automation()->ClearBreakpoint(it->address);
@@ -433,13 +448,23 @@ void GUI::DrawBreakpoints() {
     }
     ImGui::Columns(1);
     if (adding_breakpoint) {
-      ImGui::Columns(3);
+      ImGui::Columns(5);
       static cpuaddr_t addr = 0;
+      static char symbol[64] = "";
+      static char condition[128] = "";
       ImGui::InputScalar("Addr", ImGuiDataType_U32, &addr, nullptr, nullptr,
                          "%06X", ImGuiInputTextFlags_CharsHexadecimal);
       ImGui::NextColumn();
-      if (ImGui::Button("OK")) {
-        system_->automation()->AddBreakpoint(addr, "");
+      if (ImGui::InputText("Symbol", symbol, sizeof(symbol))) {
+        auto found = system_->symbols()->Lookup(symbol);
+        if (found)
+          addr = *found;
+      }
+      ImGui::NextColumn();
+      ImGui::InputText("Condition", condition, sizeof(condition));
+      ImGui::NextColumn();
+      if (ImGui::Button("OK") &&
+          system_->automation()->AddBreakpoint(addr, "", condition)) {
         adding_breakpoint = false;
       }
       ImGui::NextColumn();
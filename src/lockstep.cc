@@ -0,0 +1,246 @@
+#include "lockstep.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include "bus/c256_system_bus.h"
+#include "bus/hash.h"
+#include "bus/sdma.h"
+#include "bus/timer.h"
+#include "bus/vdma.h"
+#include "bus/vicky.h"
+#include "system.h"
+
+namespace {
+
+constexpr cpuaddr_t kVramBase = 0xB00000;
+
+struct DeviceHash {
+  const char* name;
+  uint64_t hash;
+};
+
+// Per-device hashes, in a fixed order. The math coprocessor and interrupt
+// controller registers have no read side effects, so they're read through
+// the bus.
+std::vector<DeviceHash> HashDevices(System* system) {
+  C256SystemBus* bus = system->system_bus();
+  uint8_t math[0x30];
+  uint8_t interrupts[0x10];
+  bus->PeekBlock(0x100, math, sizeof(math));
+  bus->PeekBlock(0x140, interrupts, sizeof(interrupts));
+  return {{"vicky", system->vicky()->HashState(0)},
+          {"vdma", bus->vdma()->HashState(0)},
+          {"sdma", bus->sdma()->HashState(0)},
+          {"timer 0", bus->timer(0)->HashState(0)},
+          {"timer 1", bus->timer(1)->HashState(0)},
+          {"timer 2", bus->timer(2)->HashState(0)},
+          {"math coprocessor", HashBytes(math, sizeof(math))},
+          {"interrupt controller", HashBytes(interrupts, sizeof(interrupts))}};
+}
+
+uint64_t HashCpu(System* system) {
+  WDC65C816* cpu = system->cpu();
+  const auto& state = cpu->cpu_state;
+  const uint32_t registers[] = {state.regs.a.u16,
+                                state.regs.x.u16,
+                                state.regs.y.u16,
+                                state.regs.sp.u16,
+                                state.regs.d.u16,
+                                cpu->program_address(),
+                                state.is_carry(),
+                                state.is_zero(),
+                                state.interrupts_enabled(),
+                                state.is_decimal(),
+                                state.is_overflow(),
+                                state.is_negative(),
+                                cpu->mode_long_a,
+                                cpu->mode_long_xy,
+                                cpu->mode_emulation};
+  return HashBytes(registers, sizeof(registers));
+}
+
+// Logs the first offset at which 'a' and 'b' differ, if any.
+void ReportFirstDifference(const char* what, cpuaddr_t base,
+                           const uint8_t* a, const uint8_t* b, size_t size) {
+  auto mismatch = std::mismatch(a, a + size, b);
+  if (mismatch.first == a + size)
+    return;
+  size_t offset = mismatch.first - a;
+  LOG(ERROR) << what << " first differs at $" << std::hex << std::uppercase
+             << base + offset << ": " << (int)*mismatch.first << " vs "
+             << (int)*mismatch.second;
+}
+
+void ReportCpu(const char* label, System* system) {
+  WDC65C816* cpu = system->cpu();
+  const auto& regs = cpu->cpu_state.regs;
+  LOG(ERROR) << label << ": pc=$" << std::hex << std::uppercase
+             << cpu->program_address() << " a=$" << regs.a.u16 << " x=$"
+             << regs.x.u16 << " y=$" << regs.y.u16 << " sp=$" << regs.sp.u16
+             << " d=$" << regs.d.u16;
+}
+
+}  // namespace
+
+std::string StateHash::Diff(const StateHash& other) const {
+  std::string diff;
+  auto check = [&diff](const char* name, uint64_t a, uint64_t b) {
+    if (a == b)
+      return;
+    if (!diff.empty())
+      diff += " ";
+    diff += name;
+  };
+  check("cycle", cycle, other.cycle);
+  check("cpu", cpu, other.cpu);
+  check("ram", ram, other.ram);
+  check("vram", vram, other.vram);
+  check("devices", devices, other.devices);
+  return diff;
+}
+
+StateHash HashSystemState(System* system, uint64_t frame) {
+  StateHash hash;
+  hash.frame = frame;
+  hash.cycle = system->cpu()->cpu_state.cycle;
+  hash.cpu = HashCpu(system);
+  hash.ram = HashBytes(system->system_bus()->ram(), C256SystemBus::kRamSize);
+  hash.vram =
+      HashBytes(system->vicky()->vram(), system->vicky()->vram_size());
+  for (const DeviceHash& device : HashDevices(system))
+    hash.devices = HashBytes(&device.hash, sizeof(device.hash), hash.devices);
+  return hash;
+}
+
+StateHashStream::~StateHashStream() {
+  if (file_)
+    fclose(file_);
+}
+
+bool StateHashStream::StartWriting(const std::string& path) {
+  file_ = fopen(path.c_str(), "w");
+  if (!file_) {
+    LOG(ERROR) << "Unable to create state hash stream: " << path;
+    return false;
+  }
+  comparing_ = false;
+  return true;
+}
+
+bool StateHashStream::StartComparing(const std::string& path) {
+  file_ = fopen(path.c_str(), "r");
+  if (!file_) {
+    LOG(ERROR) << "Unable to open state hash stream: " << path;
+    return false;
+  }
+  comparing_ = true;
+  return true;
+}
+
+bool StateHashStream::OnFrame(const StateHash& hash) {
+  if (!file_)
+    return true;
+  if (!comparing_) {
+    fprintf(file_,
+            "%" PRIu64 " %" PRIu64 " %016" PRIx64 " %016" PRIx64
+            " %016" PRIx64 " %016" PRIx64 "\n",
+            hash.frame, hash.cycle, hash.cpu, hash.ram, hash.vram,
+            hash.devices);
+    return true;
+  }
+
+  StateHash expected;
+  if (fscanf(file_,
+             "%" SCNu64 " %" SCNu64 " %" SCNx64 " %" SCNx64 " %" SCNx64
+             " %" SCNx64,
+             &expected.frame, &expected.cycle, &expected.cpu, &expected.ram,
+             &expected.vram, &expected.devices) != 6) {
+    LOG(INFO) << "State hash stream ended at frame " << hash.frame
+              << " without diverging";
+    fclose(file_);
+    file_ = nullptr;
+    return true;
+  }
+  std::string diff = hash.Diff(expected);
+  if (expected.frame != hash.frame || !diff.empty()) {
+    LOG(ERROR) << "Diverged at frame " << hash.frame << " (cycle "
+               << hash.cycle << ", recorded frame " << expected.frame
+               << " cycle " << expected.cycle << "): " << diff;
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+Lockstep::Lockstep(System* a, System* b) : systems_{a, b} {}
+
+void Lockstep::OnFrame(int index, uint64_t frame) {
+  // Hash outside the lock; the other system may still be running.
+  StateHash hash = HashSystemState(systems_[index], frame);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (finished_)
+    return;
+  hashes_[index] = hash;
+  if (++arrived_ == 2) {
+    // Both systems are now parked at the same frame boundary.
+    Compare();
+    arrived_ = 0;
+    generation_++;
+    arrived_cv_.notify_all();
+    return;
+  }
+  uint64_t generation = generation_;
+  arrived_cv_.wait(lock, [this, generation]() {
+    return generation_ != generation || finished_;
+  });
+}
+
+void Lockstep::Finish(int index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  finished_ = true;
+  systems_[1 - index]->SetStop();
+  arrived_cv_.notify_all();
+}
+
+void Lockstep::Compare() {
+  const StateHash& a = hashes_[0];
+  const StateHash& b = hashes_[1];
+  std::string diff = a.Diff(b);
+  if (diff.empty())
+    return;
+
+  diverged_ = true;
+  LOG(ERROR) << "Lockstep diverged at frame " << a.frame << " (cycle "
+             << a.cycle << "): " << diff;
+  if (a.cpu != b.cpu) {
+    ReportCpu("system 0", systems_[0]);
+    ReportCpu("system 1", systems_[1]);
+  }
+  if (a.ram != b.ram) {
+    ReportFirstDifference("RAM", 0, systems_[0]->system_bus()->ram(),
+                          systems_[1]->system_bus()->ram(),
+                          C256SystemBus::kRamSize);
+  }
+  if (a.vram != b.vram) {
+    ReportFirstDifference("VRAM", kVramBase, systems_[0]->vicky()->vram(),
+                          systems_[1]->vicky()->vram(),
+                          systems_[0]->vicky()->vram_size());
+  }
+  if (a.devices != b.devices) {
+    auto devices_a = HashDevices(systems_[0]);
+    auto devices_b = HashDevices(systems_[1]);
+    for (size_t i = 0; i < devices_a.size(); i++) {
+      if (devices_a[i].hash != devices_b[i].hash)
+        LOG(ERROR) << devices_a[i].name << " state differs";
+    }
+  }
+  finished_ = true;
+  systems_[0]->SetStop();
+  systems_[1]->SetStop();
+}
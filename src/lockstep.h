@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+class System;
+
+// Hashes of the machine state at a frame boundary, split by component so a
+// mismatch says where to look.
+struct StateHash {
+  uint64_t frame = 0;
+  uint64_t cycle = 0;
+  uint64_t cpu = 0;
+  uint64_t ram = 0;
+  uint64_t vram = 0;
+  uint64_t devices = 0;
+
+  // Names the components that differ, e.g. "ram vram"; empty if none do.
+  std::string Diff(const StateHash& other) const;
+};
+
+StateHash HashSystemState(System* system, uint64_t frame);
+
+// A per-frame stream of state hashes in a text file, one frame per line, so
+// that runs in separate processes (e.g. two emulator builds) can be compared.
+class StateHashStream {
+ public:
+  ~StateHashStream();
+
+  bool StartWriting(const std::string& path);
+  // Compares each frame against a stream written by an earlier run.
+  bool StartComparing(const std::string& path);
+
+  // Writes or checks 'hash'. Returns false once the run has diverged from
+  // the stream being compared against.
+  bool OnFrame(const StateHash& hash);
+
+ private:
+  FILE* file_ = nullptr;
+  bool comparing_ = false;
+};
+
+// Runs two systems in lockstep, one frame at a time, and stops both at the
+// first frame whose state differs, reporting the first differing address.
+// Each system calls OnFrame() from its own CPU thread at every frame end.
+class Lockstep {
+ public:
+  Lockstep(System* a, System* b);
+
+  void OnFrame(int index, uint64_t frame);
+  // Releases the other system when one stops running.
+  void Finish(int index);
+
+  bool diverged() const { return diverged_; }
+
+ private:
+  void Compare();
+
+  System* systems_[2];
+  StateHash hashes_[2];
+
+  std::mutex mutex_;
+  std::condition_variable arrived_cv_;
+  int arrived_ = 0;
+  uint64_t generation_ = 0;
+  bool finished_ = false;
+  bool diverged_ = false;
+};
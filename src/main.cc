@@ -2,17 +2,104 @@
 #include <glog/logging.h>
 
 #include <iostream>
+#include <sstream>
 #include <thread>
 
 #include "automation/automation.h"
 #include "bus/loader.h"
+#include "bus/vicky.h"
+#include "lockstep.h"
 #include "system.h"
 
+DECLARE_bool(headless);
+DECLARE_bool(sd_inotify);
+DECLARE_bool(sd_wait_for_host);
+DECLARE_bool(throttle);
+
 DEFINE_bool(interpreter, false, "enable Lua command read prompt loop");
 DEFINE_string(kernel_hex, "", "Location of kernel .hex file");
 DEFINE_string(kernel_bin, "", "Location of kernel .bin file");
 DEFINE_string(script, "", "Lua script to run on start (automation only)");
 DEFINE_string(program_hex, "", "Program HEX file to load (optional)");
+DEFINE_string(test_script, "",
+              "Lua test to run; the exit status reports whether it passed");
+DEFINE_string(input_text, "", "Text to type into the keyboard after boot");
+DEFINE_string(input_events, "",
+              "File of timestamped key and mouse events to inject after boot");
+DEFINE_string(record_input, "",
+              "Record host input and device reads to this journal file");
+DEFINE_string(replay_input, "",
+              "Replay a journal recorded with -record_input, at full speed");
+DEFINE_string(record_video, "",
+              "Record frames, at -scale, to this file, \"-\" for stdout, or "
+              "\"|command\" to pipe them to a command");
+DEFINE_string(record_video_format, "y4m",
+              "Format for -record_video: y4m (I420) or bgra (raw frames)");
+DEFINE_int32(record_video_every, 1, "Record every Nth frame");
+DEFINE_bool(record_video_changed_only, false,
+            "Only record frames that differ from the last one recorded");
+DEFINE_string(frame_export, "",
+              "Publish completed frames to this POSIX shared memory segment "
+              "(e.g. /c256emu) for external viewers");
+DEFINE_bool(lockstep, false,
+            "Run a second, headless system in lockstep with the first and "
+            "stop at the first frame where their states differ");
+DEFINE_string(lockstep_kernel_hex, "",
+              "Kernel .hex for the lockstep system (defaults to -kernel_hex)");
+DEFINE_string(lockstep_kernel_bin, "",
+              "Kernel .bin for the lockstep system (defaults to -kernel_bin)");
+DEFINE_string(lockstep_program_hex, "",
+              "Program HEX for the lockstep system (defaults to -program_hex)");
+DEFINE_string(state_hash_out, "",
+              "Write a per-frame machine state hash stream to this file");
+DEFINE_string(state_hash_compare, "",
+              "Compare each frame against a stream from -state_hash_out and "
+              "stop at the first divergence");
+DEFINE_string(symbols, "",
+              "Comma separated symbol files to load (ld65 .map or .dbg, or "
+              "VICE labels)");
+
+namespace {
+
+bool LoadImages(System* system, const std::string& kernel_hex,
+                const std::string& kernel_bin, const std::string& program_hex) {
+  bool kernel_loaded = false;
+  if (!kernel_hex.empty())
+    kernel_loaded = system->loader()->LoadFromHex(kernel_hex);
+  else if (!kernel_bin.empty())
+    kernel_loaded = system->loader()->LoadFromBin(kernel_bin, 0x180000);
+
+  if (!kernel_loaded) {
+    LOG(ERROR) << "No kernel; pass a valid kernel file with -kernel_hex or -kernel_bin";
+    return false;
+  }
+
+  if (!program_hex.empty() && !system->loader()->LoadFromHex(program_hex)) {
+    LOG(ERROR) << "Invalid kernel hex file: " << program_hex;
+    return false;
+  }
+  return true;
+}
+
+// Input set up on the command line, applied to every system so that
+// lockstep runs see the same input.
+bool SetUpInput(System* system) {
+  if (!FLAGS_replay_input.empty()) {
+    if (!system->input_journal()->StartReplay(FLAGS_replay_input))
+      return false;
+    FLAGS_throttle = false;
+  }
+
+  if (!FLAGS_input_events.empty() &&
+      !system->input_injector()->LoadFile(FLAGS_input_events)) {
+    return false;
+  }
+  if (!FLAGS_input_text.empty())
+    system->input_injector()->QueueText(FLAGS_input_text);
+  return true;
+}
+
+}  // namespace
 
 int main(int argc, char* argv[]) {
   FLAGS_logtostderr = true;
@@ -21,26 +108,115 @@ int main(int argc, char* argv[]) {
 
   LOG(INFO) << "Good morning.";
 
+  // The second system can't share the window, so both run headless.
+  if (FLAGS_lockstep)
+    FLAGS_headless = true;
+  // Runs that are compared must see host directory changes, and SD card
+  // commands complete, at the same points, which inotify's asynchronous
+  // events and host I/O timing can't promise.
+  if (FLAGS_lockstep || !FLAGS_state_hash_out.empty() ||
+      !FLAGS_state_hash_compare.empty()) {
+    FLAGS_sd_inotify = false;
+    FLAGS_sd_wait_for_host = true;
+  }
+
   System system;
+  if (!LoadImages(&system, FLAGS_kernel_hex, FLAGS_kernel_bin,
+                  FLAGS_program_hex)) {
+    return -1;
+  }
 
-  bool kernel_loaded = false;
-  if (!FLAGS_kernel_hex.empty())
-    kernel_loaded = system.loader()->LoadFromHex(FLAGS_kernel_hex);
-  else if (!FLAGS_kernel_bin.empty())
-    kernel_loaded = system.loader()->LoadFromBin(FLAGS_kernel_bin, 0x180000);
-  
-  if (!kernel_loaded) {
-	LOG(ERROR) << "No kernel; pass a valid kernel file with -kernel_hex or -kernel_bin";
-	return -1;
+  std::stringstream symbol_files(FLAGS_symbols);
+  std::string symbol_file;
+  while (std::getline(symbol_files, symbol_file, ',')) {
+    if (!symbol_file.empty() && !system.symbols()->LoadFile(symbol_file))
+      LOG(ERROR) << "Could not load symbols: " << symbol_file;
   }
 
-  if (!FLAGS_program_hex.empty() && !system.loader()->LoadFromHex(FLAGS_program_hex)) {
-	LOG(ERROR) << "Invalid kernel hex file: "<< FLAGS_program_hex;
-	return -1;
+  if (!SetUpInput(&system))
+    return -1;
+  if (FLAGS_replay_input.empty() && !FLAGS_record_input.empty() &&
+      !system.input_journal()->StartRecording(FLAGS_record_input)) {
+    return -1;
   }
-  
+
+  if (!FLAGS_record_video.empty()) {
+    VideoRecorder::Options options;
+    if (!VideoRecorder::ParseFormat(FLAGS_record_video_format,
+                                    &options.format)) {
+      LOG(ERROR) << "Unknown video format: " << FLAGS_record_video_format;
+      return -1;
+    }
+    options.every = FLAGS_record_video_every;
+    options.changed_only = FLAGS_record_video_changed_only;
+    if (!system.StartVideoRecording(FLAGS_record_video, options))
+      return -1;
+  }
+
+  if (!FLAGS_frame_export.empty() &&
+      !system.vicky()->StartFrameExport(FLAGS_frame_export)) {
+    return -1;
+  }
+
+  StateHashStream hash_stream;
+  if (!FLAGS_state_hash_out.empty() &&
+      !hash_stream.StartWriting(FLAGS_state_hash_out)) {
+    return -1;
+  }
+  if (!FLAGS_state_hash_compare.empty() &&
+      !hash_stream.StartComparing(FLAGS_state_hash_compare)) {
+    return -1;
+  }
+  bool hash_stream_diverged = false;
+
+  std::unique_ptr<System> lockstep_system;
+  std::unique_ptr<Lockstep> lockstep;
+  std::thread lockstep_thread;
+  if (FLAGS_lockstep) {
+    auto pick = [](const std::string& lockstep_flag, const std::string& flag) {
+      return lockstep_flag.empty() ? flag : lockstep_flag;
+    };
+    lockstep_system = std::make_unique<System>();
+    bool custom_kernel = !FLAGS_lockstep_kernel_hex.empty() ||
+                         !FLAGS_lockstep_kernel_bin.empty();
+    if (!LoadImages(lockstep_system.get(),
+                    custom_kernel ? FLAGS_lockstep_kernel_hex
+                                  : FLAGS_kernel_hex,
+                    custom_kernel ? FLAGS_lockstep_kernel_bin
+                                  : FLAGS_kernel_bin,
+                    pick(FLAGS_lockstep_program_hex, FLAGS_program_hex)) ||
+        !SetUpInput(lockstep_system.get())) {
+      return -1;
+    }
+    lockstep = std::make_unique<Lockstep>(&system, lockstep_system.get());
+    lockstep_system->set_frame_callback([&lockstep](uint32_t frame) {
+      lockstep->OnFrame(1, frame);
+    });
+  }
+
+  bool hashing =
+      !FLAGS_state_hash_out.empty() || !FLAGS_state_hash_compare.empty();
+  if (hashing || lockstep) {
+    system.set_frame_callback([&, hashing](uint32_t frame) {
+      if (hashing && !hash_stream.OnFrame(HashSystemState(&system, frame))) {
+        hash_stream_diverged = true;
+        system.SetStop();
+      }
+      if (lockstep)
+        lockstep->OnFrame(0, frame);
+    });
+  }
+
+  if (lockstep) {
+    lockstep_thread = std::thread([&lockstep_system, &lockstep]() {
+      lockstep_system->Initialize();
+      lockstep_system->Run();
+      lockstep->Finish(1);
+    });
+  }
+
   Automation* automation = system.automation();
-  std::thread run_thread([&system, automation]() {
+  std::thread run_thread([&system, &lockstep, automation]() {
     system.Initialize();
 
     if (!FLAGS_script.empty()) {
@@ -48,10 +224,26 @@ int main(int argc, char* argv[]) {
         LOG(ERROR) << "Could not load automation file: " << FLAGS_script;
       }
     }
+    if (!FLAGS_test_script.empty() &&
+        !automation->RunTest(FLAGS_test_script)) {
+      LOG(ERROR) << "Could not load test: " << FLAGS_test_script;
+      if (lockstep)
+        lockstep->Finish(0);
+      return;
+    }
     system.Run();
+    if (lockstep)
+      lockstep->Finish(0);
   });
 
   run_thread.join();
+  if (lockstep_thread.joinable())
+    lockstep_thread.join();
+  system.StopVideoRecording();
 
+  if (hash_stream_diverged || (lockstep && lockstep->diverged()))
+    return 1;
+  if (!FLAGS_test_script.empty())
+    return automation->test_result() == Automation::TestResult::kPass ? 0 : 1;
   return 0;
 }
\ No newline at end of file
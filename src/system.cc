@@ -21,11 +21,13 @@ constexpr auto kVickyFrameDelayDuration =
 constexpr auto kVickyFrameDelayDurationNs =
     std::chrono::duration_cast<std::chrono::nanoseconds>(
         kVickyFrameDelayDuration);
-constexpr int kRasterLinesPerSecond =
-    (kVickyBitmapHeight + kVickyVBlankLines) * kVickyTargetFps;
 
 DEFINE_bool(gui, true, "Enable the GUI debugger / profiler");
 DEFINE_double(clock_rate, 14.318, "Target clock rate in Mhz");
+DEFINE_bool(headless, false,
+            "Run without a window or GUI, e.g. for automated tests");
+DEFINE_bool(throttle, true,
+            "Limit emulation to real time; disable to run at full speed");
 
 void key_cb_func(GLFWwindow *window, int key, int scancode, int action,
                  int mods) {
@@ -59,16 +61,32 @@ void window_close_callback(GLFWwindow *window) {
 
 System::System()
     : system_bus_(std::make_unique<C256SystemBus>(this)),
-      loader_(system_bus_.get()),
-      gui_(FLAGS_gui ? std::make_unique<GUI>(this) : nullptr),
+      loader_(system_bus_.get(),
+              [this](const std::vector<LoadSymbol> &exports) {
+                std::vector<SymbolTable::Symbol> symbols;
+                for (const LoadSymbol &symbol : exports)
+                  symbols.push_back({symbol.name, symbol.address, 0});
+                symbols_.Add(symbols);
+              }),
+      input_injector_(this),
+      gui_(FLAGS_gui && !FLAGS_headless ? std::make_unique<GUI>(this)
+                                        : nullptr),
       cpu_(system_bus_.get()), debug_(&cpu_, &events_, system_bus_.get(), true),
       automation_(&cpu_, this, &debug_) {
+  system_bus_->set_input_journal(&input_journal_);
+  lines_per_frame_ = vicky()->total_lines();
 
 }
 
 System::~System() = default;
 
 void System::Initialize() {
+  if (FLAGS_headless) {
+    cpu_.tracing.addrs.resize(16);
+    BootCPU();
+    return;
+  }
+
   glfwInit();
   LOG(INFO) << "Starting Vicky...";
 
@@ -79,7 +97,7 @@ void System::Initialize() {
 
   BootCPU();
 
-  if (FLAGS_gui) {
+  if (gui_) {
     // Fire up the GUI debugger;
     int x, y;
     glfwGetWindowPos(window, &x, &y);
@@ -97,9 +115,9 @@ void System::Initialize() {
 void System::BootCPU(bool hard_boot) {
   // Copy Flash bank 18 to Bank 0
   LOG(INFO) << "Copying flash bank 18 to bank 0...";
-  for (int i = 0; i < 1 << 16; i++) {
-    system_bus_->WriteByte(i, system_bus_->ReadByte(0x180000 + i));
-  }
+  std::vector<uint8_t> bank(1 << 16);
+  system_bus_->ReadBlock(0x180000, bank.data(), bank.size());
+  system_bus_->WriteBlock(0, bank.data(), bank.size());
 
   LOG(INFO) << "PowerOn CPU...";
   // Lower the reset pin.
@@ -116,23 +134,99 @@ void System::Sys(uint32_t address) {
   cpu_.cpu_state.ip = address & 0xFFFF;
 }
 
+void System::ScheduleEvent(uint64_t delay_cycles,
+                           std::function<void()> event) {
+  events_.ScheduleNoLock(cpu_.cpu_state.cycle + delay_cycles,
+                         std::move(event));
+}
+
+void System::RunOnCpuThread(std::function<void()> task) {
+  {
+    // Run() clears cpu_running_ under the lock, so a task queued here is
+    // always picked up by its final RunCpuThreadTasks().
+    std::lock_guard<std::mutex> lock(cpu_thread_tasks_mutex_);
+    if (cpu_running_ && std::this_thread::get_id() != cpu_thread_) {
+      cpu_thread_tasks_.push_back(std::move(task));
+      cpu_thread_tasks_pending_ = true;
+      return;
+    }
+  }
+  task();
+}
+
+void System::RunCpuThreadTasks() {
+  std::vector<std::function<void()>> tasks;
+  {
+    std::lock_guard<std::mutex> lock(cpu_thread_tasks_mutex_);
+    tasks.swap(cpu_thread_tasks_);
+    cpu_thread_tasks_pending_ = false;
+  }
+  for (auto &task : tasks)
+    task();
+}
+
+uint64_t System::ScanlineCycle(uint64_t scanline) const {
+  return scanline_base_cycle_ +
+         (FLAGS_clock_rate * 1000000 * (scanline - scanline_base_)) /
+             (lines_per_frame_ * kVickyTargetFps);
+}
+
+void System::SetLinesPerFrame(uint16_t lines) {
+  scanline_base_cycle_ = ScanlineCycle(total_scanlines_);
+  scanline_base_ = total_scanlines_;
+  lines_per_frame_ = lines;
+}
+
 DebugInterface *System::GetDebugInterface() { return &debug_; }
 
+bool System::StartVideoRecording(const std::string& path,
+                                 const VideoRecorder::Options& options) {
+  std::lock_guard<std::mutex> lock(video_recorder_mutex_);
+  return video_recorder_.Start(path, options);
+}
+
+void System::StopVideoRecording() {
+  std::lock_guard<std::mutex> lock(video_recorder_mutex_);
+  video_recorder_.Stop();
+}
+
 void System::DrawNextLine() {
+  total_scanlines_++;
+  if (cpu_thread_tasks_pending_.load(std::memory_order_relaxed))
+    RunCpuThreadTasks();
   system_bus_->vicky()->RenderLine();
+  input_injector_.Pump();
 
   bool frame_end = system_bus_->vicky()->is_vertical_end();
   if (frame_end) {
     current_frame_++;
     system_bus_->int_controller()->SetFrameStart(true);
-    system_bus_->vdma()->OnFrameStart();
 
     if (live_watches_) {
       PerformWatches();
     }
 
-    auto sleep_time = next_frame_clock - frame_clock;
-    std::this_thread::sleep_for(sleep_time);
+    {
+      std::lock_guard<std::mutex> lock(video_recorder_mutex_);
+      if (video_recorder_.recording()) {
+        // Recorded as displayed, at -scale.
+        int width, height;
+        const uint32_t* pixels =
+            system_bus_->vicky()->ScaledFrame(&width, &height);
+        video_recorder_.OnFrame(current_frame_,
+                                cpu_.cpu_state.cycle / FLAGS_clock_rate,
+                                pixels, width, height);
+      }
+    }
+
+    automation_.OnFrame(current_frame_);
+    if (frame_callback_)
+      frame_callback_(current_frame_);
+
+    if (FLAGS_throttle) {
+      auto sleep_time = next_frame_clock - frame_clock;
+      std::this_thread::sleep_for(sleep_time);
+    }
 
     auto now = std::chrono::high_resolution_clock::now();
     if (current_frame_ % 60 == 0) {
@@ -159,14 +253,15 @@ void System::DrawNextLine() {
 }
 
 void System::ScheduleNextScanline() {
-  total_scanlines_++;
-  events_.ScheduleNoLock((FLAGS_clock_rate * 1000000 * total_scanlines_) /
-                             kRasterLinesPerSecond,
+  events_.ScheduleNoLock(ScanlineCycle(total_scanlines_ + 1),
                          std::bind(&System::DrawNextLine, this));
 }
 
 void System::Run() {
   total_scanlines_ = 0;
+  scanline_base_ = 0;
+  scanline_base_cycle_ = 0;
+  lines_per_frame_ = vicky()->total_lines();
   cpu_.cpu_state.cycle = 0;
   current_frame_ = 0;
   profile_last_cycles = 0;
@@ -176,12 +271,21 @@ void System::Run() {
 
   events_.Start(&cpu_.cpu_state.event_cycle, cpu_.cpu_state.cycle_stop);
   ScheduleNextScanline();
+  if (input_journal_.replaying())
+    ScheduleNextReplayInput();
+  cpu_thread_ = std::this_thread::get_id();
+  cpu_running_ = true;
   cpu_.Emulate(&events_);
+  {
+    std::lock_guard<std::mutex> lock(cpu_thread_tasks_mutex_);
+    cpu_running_ = false;
+  }
+  RunCpuThreadTasks();
 }
 
 uint16_t System::ReadTwoBytes(uint32_t addr) { return cpu_.PeekU16(addr); }
 
-uint16_t System::ReadByte(uint32_t addr) { return system_bus_->ReadByte(addr); }
+uint16_t System::ReadByte(uint32_t addr) { return system_bus_->PeekByte(addr); }
 
 void System::StoreByte(uint32_t addr, uint8_t val) {
   system_bus_->WriteByte(addr, val);
@@ -280,19 +384,77 @@ std::vector<uint8_t> System::direct_page_watch() {
 }
 
 void System::KeyEvent(int key, int scancode, int action, int mods) {
-  system_bus()->keyboard()->kbd()->ps2_keyboard_event(key, scancode, action,
-                                                      mods);
+  InputJournal::Event event{cpu_.cpu_state.cycle,
+                            InputJournal::Event::Type::kKey};
+  event.code = key;
+  event.scancode = scancode;
+  event.action = action;
+  event.mods = mods;
+  HandleInput(event);
 }
 
-
 void System::MouseMoveEvent(double xpos, double ypos) {
-  system_bus()->keyboard()->mouse()->ps2_mouse_move(xpos, ypos);
+  InputJournal::Event event{cpu_.cpu_state.cycle,
+                            InputJournal::Event::Type::kMouseMove};
+  event.x = xpos;
+  event.y = ypos;
+  HandleInput(event);
 }
 
 void System::MouseScrollEvent(double xoffset, double yoffset) {
-  system_bus()->keyboard()->mouse()->ps2_mouse_scroll(xoffset, yoffset);
+  InputJournal::Event event{cpu_.cpu_state.cycle,
+                            InputJournal::Event::Type::kMouseScroll};
+  event.x = xoffset;
+  event.y = yoffset;
+  HandleInput(event);
 }
 
 void System::MouseButtonEvent(int button, int action, int mods) {
-  system_bus()->keyboard()->mouse()->ps2_mouse_button(button, action, mods);
-}
\ No newline at end of file
+  InputJournal::Event event{cpu_.cpu_state.cycle,
+                            InputJournal::Event::Type::kMouseButton};
+  event.code = button;
+  event.action = action;
+  event.mods = mods;
+  HandleInput(event);
+}
+
+void System::HandleInput(InputJournal::Event event) {
+  if (input_journal_.replaying())
+    return;
+  if (input_journal_.recording())
+    input_journal_.RecordInput(event);
+  DeliverInput(event);
+}
+
+void System::DeliverInput(const InputJournal::Event &event) {
+  I8042 *keyboard = system_bus()->keyboard();
+  switch (event.type) {
+  case InputJournal::Event::Type::kKey:
+    keyboard->kbd()->ps2_keyboard_event(event.code, event.scancode,
+                                        event.action, event.mods);
+    break;
+  case InputJournal::Event::Type::kMouseMove:
+    keyboard->mouse()->ps2_mouse_move(event.x, event.y);
+    break;
+  case InputJournal::Event::Type::kMouseScroll:
+    keyboard->mouse()->ps2_mouse_scroll(event.x, event.y);
+    break;
+  case InputJournal::Event::Type::kMouseButton:
+    keyboard->mouse()->ps2_mouse_button(event.code, event.action, event.mods);
+    break;
+  }
+}
+
+void System::ScheduleNextReplayInput() {
+  auto cycle = input_journal_.next_input_cycle();
+  if (!cycle) {
+    LOG(INFO) << "Input journal replay complete";
+    return;
+  }
+  events_.ScheduleNoLock(*cycle, [this]() {
+    InputJournal::Event event;
+    while (input_journal_.NextInput(cpu_.cpu_state.cycle, &event))
+      DeliverInput(event);
+    ScheduleNextReplayInput();
+  });
+}
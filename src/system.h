@@ -1,12 +1,17 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
 
 #include "automation/automation.h"
+#include "automation/input_injector.h"
+#include "automation/symbol_table.h"
+#include "bus/input_journal.h"
 #include "bus/loader.h"
+#include "bus/video_recorder.h"
 #include "cpu/65816/cpu_65c816.h"
 #include "debug_interface.h"
 
@@ -44,6 +49,29 @@ class System {
   // Jump to address.
   void Sys(uint32_t address);
 
+  // Run 'event' on the CPU thread 'delay_cycles' from now. Must be called
+  // from the CPU thread.
+  void ScheduleEvent(uint64_t delay_cycles, std::function<void()> event);
+
+  // Run 'task' on the CPU thread between instructions: now if called from
+  // it or before Run(), otherwise at the start of the next scanline.
+  void RunOnCpuThread(std::function<void()> task);
+
+  // Scanlines are numbered from 1 since Run(); scanline n starts at
+  // ScanlineCycle(n). The one being displayed now, whose drawing has
+  // already happened, is total_scanlines(); it's 0 before the first.
+  uint64_t ScanlineCycle(uint64_t scanline) const;
+  uint64_t total_scanlines() const { return total_scanlines_; }
+  // Changes the line rate for a new video mode, from the current scanline
+  // on. Must be called from the CPU thread.
+  void SetLinesPerFrame(uint16_t lines);
+
+  // Called on the CPU thread at the end of every frame, with the frame
+  // number.
+  void set_frame_callback(std::function<void(uint32_t)> callback) {
+    frame_callback_ = std::move(callback);
+  }
+
   WDC65C816* cpu() { return &cpu_; }
   DebugInterface* GetDebugInterface();
   ProfileInfo profile_info() const { return profile_info_; }
@@ -52,6 +80,15 @@ class System {
   C256SystemBus *system_bus() const { return system_bus_.get(); }
 
   Loader* loader() { return &loader_; }
+  SymbolTable* symbols() { return &symbols_; }
+  InputInjector* input_injector() { return &input_injector_; }
+  InputJournal* input_journal() { return &input_journal_; }
+
+  // Records every completed frame from now on; see VideoRecorder. Safe to
+  // call from any thread.
+  bool StartVideoRecording(const std::string& path,
+                           const VideoRecorder::Options& options);
+  void StopVideoRecording();
 
   void set_live_watches(bool live_watch) { live_watches_ = true; }
   bool live_watches() const { return live_watches_; }
@@ -86,16 +123,27 @@ class System {
   void MouseButtonEvent(int button, int action,
                         int mods);
 protected:
-  friend class InterruptController;
+  friend class C256SystemBus;
 
   void RaiseIRQ();
   void ClearIRQ();
 
  private:
+  // Records 'event' if journaling and delivers it, unless replaying, when
+  // input only comes from the journal.
+  void HandleInput(InputJournal::Event event);
+  void DeliverInput(const InputJournal::Event& event);
+  void ScheduleNextReplayInput();
+  void RunCpuThreadTasks();
 
 
   uint32_t current_frame_ = 0;
   uint64_t total_scanlines_ = 0;
+  // Scanlines are timed from 'scanline_base_', which started at
+  // 'scanline_base_cycle_', at 'lines_per_frame_'.
+  uint64_t scanline_base_ = 0;
+  uint64_t scanline_base_cycle_ = 0;
+  uint16_t lines_per_frame_;
   uint64_t profile_last_cycles = 0;
 
   ProfileInfo profile_info_;
@@ -106,9 +154,23 @@ protected:
   std::chrono::time_point<std::chrono::high_resolution_clock> next_frame_clock;
 
   std::unique_ptr<C256SystemBus> system_bus_;
+  InputJournal input_journal_;
+  SymbolTable symbols_;
   Loader loader_;
+  InputInjector input_injector_;
+  // Guards video_recorder_, which is fed on the CPU thread.
+  std::mutex video_recorder_mutex_;
+  VideoRecorder video_recorder_;
+
+  // Set while Run() is emulating, on 'cpu_thread_'.
+  std::atomic_bool cpu_running_ = false;
+  std::thread::id cpu_thread_;
+  std::mutex cpu_thread_tasks_mutex_;
+  std::vector<std::function<void()>> cpu_thread_tasks_;
+  std::atomic_bool cpu_thread_tasks_pending_ = false;
 
   std::unique_ptr<GUI> gui_;
+  std::function<void(uint32_t)> frame_callback_;
 
   WDC65C816 cpu_;
   EventQueue events_;